@@ -32,6 +32,10 @@ mr_gpio_t pin3 = { .port = 1, .pin = 5 };
 
 //=========================== defines =========================================
 
+#ifndef MARI_FIXED_SCAN_CHANNEL
+#define MARI_FIXED_SCAN_CHANNEL 37  // mari hops over the advertising channels, this test stays on the first one
+#endif
+
 typedef struct {
     uint64_t asn;
 } txrx_vars_t;
@@ -40,7 +44,7 @@ typedef struct {
 
 txrx_vars_t txrx_vars = { 0 };
 
-extern schedule_t schedule_only_beacons, schedule_huge;
+extern const schedule_t schedule_only_beacons, schedule_huge;
 
 //=========================== prototypes ======================================
 
@@ -2,7 +2,13 @@
  * @file
  * @ingroup     app
  *
- * @brief       Mari Gateway application example
+ * @brief       Cost and false positives of the bloom filter of the beacons, on the device
+ *
+ * Device counterpart of sim/bench/bench_bloom_params. For the uplinks of each
+ * built-in schedule, the filter is sized by mr_bloom_set_size, as the gateway
+ * does, and built from the ids below with FNV-1a and with a mix64 finalizer.
+ * The time to build it, and the share of random ids found in it although they
+ * were never added, are printed for both hash functions.
  *
  * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
  *
@@ -14,23 +20,23 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-#include "mr_gpio.h"
 #include "mr_timer_hf.h"
+#include "bloom.h"
+#include "scheduler.h"
 
 //=========================== defines ==========================================
 
-#define BLOOM_M_BITS   1024
-#define BLOOM_M_BYTES  (BLOOM_M_BITS / 8)
-#define BLOOM_K_HASHES 3
-
 #define MARI_APP_TIMER_DEV 1
-#define NODES_MAX          101
-#define NODES_LEN          101  // number of nodes to actually test the filter against
+#define NODES_MAX          102    // uplinks of the largest built-in schedule
+#define BENCH_PROBES       10000  // ids that are not in the filter, tested against it
+#define BENCH_REPEATS      10     // times each filter is built, for the cost
+
+typedef uint64_t (*hash_t)(uint64_t input);
 
 //=========================== variables ==========================================
 
 // clang-format off
-uint64_t nodes[NODES_MAX] = {
+static const uint64_t nodes[NODES_MAX] = {
     0x66b6ce28d5f79f9d, 0x7e3e2fa977053dbd, 0xa9464aa41e476850, 0xc3392ba31b942960,
     0xf6366a989412c4a2, 0xe15eb948f01628f5, 0x8134acdc4d850865, 0x50fe0f61b2c89138,
     0x33b01f0eb8f32556, 0xfd6f4778fa206d98, 0xcc5e612c52f7a464, 0x83977e67a587f525,
@@ -56,131 +62,49 @@ uint64_t nodes[NODES_MAX] = {
     0x9976197f8dc99000, 0x4d10504373a198e5, 0xa3b52cd833d3169c, 0x99d9c043335a2e78,
     0x16163f11d4d0a8ab, 0xed7842f285d0018f, 0x667b6848fe3c0b82, 0x73507722ba719faf,
     0x53f1770e59755fc6, 0xb36a6a60fd5dd751, 0xcf88c87179119062, 0x41140562c6dddcc9,
+    0x2c1f9a7e5d3b8640,
 };
 // clang-format on
 
-mr_gpio_t pin2 = { .port = 1, .pin = 4 };
-mr_gpio_t pin3 = { .port = 1, .pin = 5 };
+extern const schedule_t schedule_tiny, schedule_medium, schedule_big, schedule_huge;
 
-//=========================== functions ==========================================
+static const schedule_t *_schedules[] = { &schedule_tiny, &schedule_medium, &schedule_big, &schedule_huge };
 
-// FNV-1a 64-bit hash
-static __attribute__((unused)) uint64_t fnv1a64(uint64_t input) {
-    uint64_t hash = 0xcbf29ce484222325ULL;
-    for (int b = 0; b < 8; b++) {
-        uint8_t byte = (input >> (56 - b * 8)) & 0xFF;
-        hash ^= byte;
-        hash *= 0x100000001b3ULL;
-    }
-    return hash;
-}
+static uint8_t  _bloom[MARI_BLOOM_M_BYTES];
+static uint64_t _rng = 0x5EED;
 
-// Thomas Wang’s 64-bit mix hash
-static inline __attribute__((unused)) uint64_t mix64(uint64_t x) {
-    x ^= x >> 33;
-    x *= 0xff51afd7ed558ccdULL;
-    x ^= x >> 33;
-    x *= 0xc4ceb9fe1a85ec53ULL;
-    x ^= x >> 33;
-    return x;
-}
-
-void mr_scheduler_gateway_gen_bloom_from_list(uint64_t *nodes, size_t count, uint8_t *bloom_output) {
-    (void)bloom_output;
-    mr_gpio_set(&pin2);
-    memset(bloom_output, 0, BLOOM_M_BYTES);
-    mr_gpio_clear(&pin2);  // 16.7 us in DEBUG
-
-    // f*ck off warnings!
-    uint64_t idx = 0;
-    (void)idx;
-    uint64_t id, h1, h2;
-    (void)id;
-    (void)h1;
-    (void)h2;
-
-    // benchmark the differnt steps, separately
-    id = nodes[0];
-    mr_gpio_set(&pin3);
-    h1 = fnv1a64(id);
-    h2 = fnv1a64(id ^ 0x5bd1e995);
-    (void)h1;
-    (void)h2;
-    mr_gpio_clear(&pin3);  // 15.9 us in DEBUG
-
-    mr_gpio_set(&pin3);
-    for (int k = 0; k < BLOOM_K_HASHES; k++) {
-        // uint64_t idx = (h1 + k * h2) % BLOOM_M_BITS;
-        idx = (h1 + k * h2) & (BLOOM_M_BITS - 1);  // Fast bitmask instead of division
-        bloom_output[idx / 8] |= (1 << (idx % 8));
-    }
-    mr_gpio_clear(&pin3);  // 2.65 us in DEBUG
-
-    // benchmark the whole loop
-    mr_gpio_set(&pin2);
-    for (size_t i = 0; i < count; i++) {
-        id = nodes[i];
-        (void)id;
-
-        h1 = fnv1a64(id);
-        h2 = fnv1a64(id ^ 0x5bd1e995);
-        (void)h1;
-        (void)h2;
-
-        for (int k = 0; k < BLOOM_K_HASHES; k++) {
-            // uint64_t idx = (h1 + k * h2) % BLOOM_M_BITS;
-            idx = (h1 + k * h2) & (BLOOM_M_BITS - 1);  // Fast bitmask instead of division
-            bloom_output[idx / 8] |= (1 << (idx % 8));
-        }
-    }
-    mr_gpio_clear(&pin2);  // 1749 us in DEBUG
-}
-
-bool mr_scheduler_node_bloom_contains(uint64_t node_id, const uint8_t *bloom) {
-    uint64_t h1 = fnv1a64(node_id);
-    uint64_t h2 = fnv1a64(node_id ^ 0x5bd1e995);
+//=========================== prototypes =======================================
 
-    for (int k = 0; k < BLOOM_K_HASHES; k++) {
-        uint64_t idx = (h1 + k * h2) % BLOOM_M_BITS;
-        if ((bloom[idx / 8] & (1 << (idx % 8))) == 0) {
-            return false;
-        }
-    }
-    return true;
-}
+static uint32_t _build(hash_t hash, size_t n_nodes, uint16_t m_bits, uint8_t k);
+static uint32_t _false_positives(hash_t hash, uint16_t m_bits, uint8_t k);
+static uint64_t _mix64(uint64_t x);
+static uint64_t _random(void);
 
 //============================ main ============================================
 
 int main(void) {
-    printf("Test Mari Bloom\n");
     mr_timer_hf_init(MARI_APP_TIMER_DEV);
-    mr_gpio_init(&pin2, MR_GPIO_OUT);
-    mr_gpio_init(&pin3, MR_GPIO_OUT);
-
-    uint8_t  bloom[BLOOM_M_BYTES];
-    uint32_t now_ts, elapsed_ts;
-
-    now_ts = mr_timer_hf_now(MARI_APP_TIMER_DEV);
-    mr_scheduler_gateway_gen_bloom_from_list(nodes, NODES_LEN, bloom);
-    elapsed_ts = mr_timer_hf_now(MARI_APP_TIMER_DEV) - now_ts;
-    printf("Bloom of %d bytes generated in %d us\n", BLOOM_M_BYTES, elapsed_ts);
-
-    size_t len_test = 10;  // NODES_LEN
-    for (size_t i = 0; i < len_test; i++) {
-        now_ts     = mr_timer_hf_now(MARI_APP_TIMER_DEV);
-        bool found = mr_scheduler_node_bloom_contains(nodes[i], bloom);
-        elapsed_ts = mr_timer_hf_now(MARI_APP_TIMER_DEV) - now_ts;
-        // printf("Bloom tested in %d us\n", elapsed_ts);
-        printf("Node %d = 0x%llX is %s in bloom  |  %d us\n", i, nodes[i], found ? "likely" : "NOT", elapsed_ts);
-    }
 
-    // Try a fake node
-    uint64_t fake_node = 0xAAAAAAAAAAAAAAAA;
-    now_ts             = mr_timer_hf_now(MARI_APP_TIMER_DEV);
-    bool found         = mr_scheduler_node_bloom_contains(fake_node, bloom);
-    elapsed_ts         = mr_timer_hf_now(MARI_APP_TIMER_DEV) - now_ts;
-    // printf("Bloom tested in %d us\n", elapsed_ts);
-    printf("Fake node 0x%llX is %s in bloom  |  %d us\n", fake_node, found ? "likely" : "NOT", elapsed_ts);
+    printf("Bloom filter of the beacons, %d probes for the false positives\n\n", BENCH_PROBES);
+    printf("schedule nodes    m  k   fnv1a (us, false pos.)   mix64 (us, false pos.)\n");
+    for (size_t i = 0; i < sizeof(_schedules) / sizeof(_schedules[0]); i++) {
+        size_t n_nodes = _schedules[i]->max_nodes;
+        if (n_nodes > NODES_MAX) {
+            n_nodes = NODES_MAX;
+        }
+        mr_bloom_set_size(n_nodes);
+        uint16_t m_bits = mr_bloom_get_m_bits();
+        uint8_t  k      = mr_bloom_get_k_hashes();
+
+        uint32_t fnv1a_us  = _build(&mr_bloom_hash_fnv1a64, n_nodes, m_bits, k);
+        uint32_t fnv1a_fps = _false_positives(&mr_bloom_hash_fnv1a64, m_bits, k);
+        uint32_t mix64_us  = _build(&_mix64, n_nodes, m_bits, k);
+        uint32_t mix64_fps = _false_positives(&_mix64, m_bits, k);
+        printf("%-8d %5d %4d %2d %8lu %6lu.%02lu %%        %8lu %6lu.%02lu %%\n", _schedules[i]->id, (int)n_nodes, m_bits, k,
+               fnv1a_us, fnv1a_fps * 100 / BENCH_PROBES, fnv1a_fps * 10000 / BENCH_PROBES % 100,
+               mix64_us, mix64_fps * 100 / BENCH_PROBES, mix64_fps * 10000 / BENCH_PROBES % 100);
+    }
+    puts("Finished.");
 
     // main loop
     while (1) {
@@ -189,3 +113,57 @@ int main(void) {
         __WFE();
     }
 }
+
+//=========================== private ==========================================
+
+// builds the filter of the first n_nodes ids, and returns the average time it took, in us
+static uint32_t _build(hash_t hash, size_t n_nodes, uint16_t m_bits, uint8_t k) {
+    uint32_t start_ts = mr_timer_hf_now(MARI_APP_TIMER_DEV);
+    for (size_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        memset(_bloom, 0, m_bits / 8);
+        for (size_t i = 0; i < n_nodes; i++) {
+            uint64_t h1 = hash(nodes[i]);
+            uint64_t h2 = hash(nodes[i] ^ MARI_BLOOM_FNV1A_H2_SALT);
+            for (uint8_t j = 0; j < k; j++) {
+                uint16_t idx = MARI_BLOOM_BIT_INDEX(h1, h2, j, m_bits);
+                _bloom[idx / 8] |= 1 << (idx % 8);
+            }
+        }
+    }
+    return (mr_timer_hf_now(MARI_APP_TIMER_DEV) - start_ts) / BENCH_REPEATS;
+}
+
+// how many random ids, which are not in the filter, are found in it
+static uint32_t _false_positives(hash_t hash, uint16_t m_bits, uint8_t k) {
+    uint32_t found = 0;
+    for (uint32_t probe = 0; probe < BENCH_PROBES; probe++) {
+        uint64_t node_id  = _random();
+        uint64_t h1       = hash(node_id);
+        uint64_t h2       = hash(node_id ^ MARI_BLOOM_FNV1A_H2_SALT);
+        bool     contains = true;
+        for (uint8_t j = 0; j < k && contains; j++) {
+            uint16_t idx = MARI_BLOOM_BIT_INDEX(h1, h2, j, m_bits);
+            contains     = (_bloom[idx / 8] & (1 << (idx % 8))) != 0;
+        }
+        found += contains;
+    }
+    return found;
+}
+
+// Thomas Wang's 64-bit mix hash
+static uint64_t _mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// splitmix64
+static uint64_t _random(void) {
+    uint64_t z = (_rng += 0x9E3779B97F4A7C15ULL);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
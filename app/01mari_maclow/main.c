@@ -21,34 +21,34 @@
 #include "mari.h"
 
 /* Very simple test schedule */
-schedule_t schedule_test_app = {
+const schedule_t schedule_test_app = {
     .id            = 32,  // make sure it doesn't collide
     .max_nodes     = 0,
     .backoff_n_min = 5,
     .backoff_n_max = 9,
     .n_cells       = 5,
     .cells         = {
-        //{'B', 0, NULL},
-        //{'S', 1, NULL},
-        //{'D', 2, NULL},
-        //{'U', 3, NULL},
-        //{'U', 4, NULL},
-
-        { 'S', 0, NULL },
-        { 'B', 1, NULL },
-        { 'B', 2, NULL },
-        { 'B', 3, NULL },
-        { 'B', 4, NULL },
-
-        //{'U', 0, NULL},
-        //{'U', 1, NULL},
-        //{'U', 2, NULL},
-        //{'U', 3, NULL},
-        //{'U', 4, NULL},
+        //{'B', 0},
+        //{'S', 1},
+        //{'D', 2},
+        //{'U', 3},
+        //{'U', 4},
+
+        { 'S', 0 },
+        { 'B', 1 },
+        { 'B', 2 },
+        { 'B', 3 },
+        { 'B', 4 },
+
+        //{'U', 0},
+        //{'U', 1},
+        //{'U', 2},
+        //{'U', 3},
+        //{'U', 4},
     }
 };
 
-extern schedule_t          schedule_minuscule, schedule_small, schedule_huge, schedule_only_beacons, schedule_only_beacons_optimized_scan;
+extern const schedule_t    schedule_minuscule, schedule_small, schedule_huge, schedule_only_beacons, schedule_only_beacons_optimized_scan;
 extern mr_slot_durations_t slot_durations;
 
 // static void radio_callback(uint8_t *packet, uint8_t length);
@@ -68,6 +68,8 @@ int main(void) {
 
     mr_assoc_init(MARI_NET_ID_DEFAULT, mari_event_callback);
 
+    mr_queue_init(mari_event_callback);
+
     mr_scheduler_init(&schedule);
     printf("\n==== Device of type %c and id %llx is using schedule 0x%0X ====\n\n", node_type, mr_device_id(), schedule.id);
 
@@ -104,9 +106,11 @@ void mari_event_callback(mr_event_t event, mr_event_data_t event_data) {
 
             uint8_t packet_len = mr_build_packet_data(packet, event_data.data.gateway_info.gateway_id, data, 5);
 
-            mr_queue_add(packet, packet_len);
-            mr_queue_add(packet, packet_len);
-            mr_queue_add(packet, packet_len);
+            for (uint8_t i = 0; i < 3; i++) {
+                if (!mr_queue_add(packet, packet_len)) {
+                    printf("Queue full, dropped packet %d\n", i);
+                }
+            }
             break;
         case MARI_DISCONNECTED:
             printf("Disconnected\n");
@@ -2,7 +2,14 @@
  * @file
  * @ingroup     drv_scheduler
  *
- * @brief       Example on how to use the TSCH scheduler
+ * @brief       Example on how to use the TSCH scheduler, and benchmark of its tick
+ *
+ * First ticks a small schedule slot by slot, assigning and then removing an
+ * uplink cell of this device. Then counts the CPU cycles taken by
+ * mr_scheduler_tick, for every built-in schedule and both roles, next to the
+ * previous implementation of the tick, which switched on the cell type and
+ * computed two 64-bit modulos of the ASN. Both implementations must give the
+ * same radio action and channel on every slot, the benchmark stops otherwise.
  *
  * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
  *
@@ -14,36 +21,100 @@
 #include "mr_timer_hf.h"
 #include "mr_device.h"
 #include "scheduler.h"
+#include "association.h"
 #include "mac.h"
 #include "mari.h"
 
-#define SLOT 1000 * 1000  // 1 s
+#define SLOT 1000 * 1000  // 1 s, slot duration of the example
+
+#define BENCH_SLOTS     10000
+#define BENCH_FIRST_ASN ((1ULL << 40) + 12345)  // large enough for the modulos to need the full 64-bit division
+
+typedef mr_slot_info_t (*tick_t)(uint64_t asn);
+
+typedef struct {
+    uint32_t total;
+    uint32_t max;
+} bench_cycles_t;
 
 // make some schedules available for testing
 #include "test_schedules.c"
-extern schedule_t schedule_minuscule, schedule_only_beacons_optimized_scan;
+extern const schedule_t schedule_test_app;
+extern const schedule_t schedule_tiny, schedule_medium, schedule_big, schedule_huge;
+
+static const schedule_t *_schedules[] = { &schedule_tiny, &schedule_medium, &schedule_big, &schedule_huge };
+
+static bool _owned[MARI_N_CELLS_MAX];  // uplink cells assigned to this device, as the previous cell_t stored it
+
+static void           _example(void);
+static mr_slot_info_t _tick_switch(uint64_t asn);
+static bool           _run(tick_t tick, tick_t reference, bench_cycles_t *cycles);
 
 int main(void) {
     // initialize high frequency timer
     mr_timer_hf_init(MARI_TIMER_DEV);
 
-    // initialize schedule
-    schedule_t     schedule  = schedule_minuscule;
-    mr_node_type_t node_type = MARI_NODE;
+    // enable the cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    mari_set_node_type(MARI_NODE);
+    mr_scheduler_init(&schedule_test_app);
+
+    _example();
 
-    mari_set_node_type(node_type);
+    printf("Device id %llx, scheduler tick, %d consecutive slots\n\n", mr_device_id(), BENCH_SLOTS);
+    printf("schedule cells role     switch (avg/max cycles)  table (avg/max cycles)\n");
+    for (size_t i = 0; i < sizeof(_schedules) / sizeof(_schedules[0]); i++) {
+        const schedule_t *schedule = _schedules[i];
+        mr_scheduler_set_schedule(schedule->id);
 
-    mr_scheduler_init(&schedule);
+        // as a node, own the first uplink cell of the schedule
+        mr_scheduler_node_deassign_myself_from_schedule();
+        for (size_t j = 0; j < schedule->n_cells; j++) {
+            _owned[j] = false;
+        }
+        for (size_t j = 0; j < schedule->n_cells; j++) {
+            if (schedule->cells[j].type == SLOT_TYPE_UPLINK) {
+                mr_scheduler_node_assign_myself_to_cell(j);
+                _owned[j] = true;
+                break;
+            }
+        }
+
+        mr_node_type_t roles[] = { MARI_GATEWAY, MARI_NODE };
+        for (size_t j = 0; j < 2; j++) {
+            mari_set_node_type(roles[j]);
+            bench_cycles_t with_switch = { 0 };
+            bench_cycles_t with_table  = { 0 };
+            _run(&_tick_switch, NULL, &with_switch);
+            if (!_run(&mr_scheduler_tick, &_tick_switch, &with_table)) {
+                printf("FAILED: the tick of schedule %d as a %s does not match the previous implementation\n", schedule->id, roles[j] == MARI_GATEWAY ? "gateway" : "node");
+                while (1) {
+                    __WFE();
+                }
+            }
+            printf("%-8d %5d %-8s %10lu / %-10lu %10lu / %-10lu\n", schedule->id, (int)schedule->n_cells, roles[j] == MARI_GATEWAY ? "gateway" : "node",
+                   with_switch.total / BENCH_SLOTS, with_switch.max, with_table.total / BENCH_SLOTS, with_table.max);
+        }
+    }
+    puts("Finished.");
+
+    while (1) {
+        __WFE();
+    }
+}
 
-    printf("Device of type %c and id %llx is using schedule %d\n\n", node_type, mr_device_id(), schedule.id);
+// tick the test schedule as a node, with an uplink cell between the first and the last slotframe
+static void _example(void) {
+    const schedule_t *schedule = &schedule_test_app;
+    printf("Device of type %c and id %llx is using schedule %d\n\n", mari_get_node_type(), mr_device_id(), schedule->id);
 
-    // loop n_slotframes*n_cells times and make the scheduler tick
-    // also, try to assign and deassign uplink cell at specific slotframes
-    size_t n_slotframes = 4;
-    // uint64_t asn = (1ULL << 48) + 123456789; // use a large number to test scheduler tick duration
-    uint64_t asn = 0;
+    size_t   n_slotframes = 4;
+    uint64_t asn          = 0;
     for (size_t j = 0; j < n_slotframes; j++) {
-        for (size_t i = 0; i < schedule.n_cells; i++) {
+        for (size_t i = 0; i < schedule->n_cells; i++) {
             uint32_t       start_ts  = mr_timer_hf_now(MARI_TIMER_DEV);
             mr_slot_info_t slot_info = mr_scheduler_tick(asn++);
             printf("Scheduler tick took %d us\n", mr_timer_hf_now(MARI_TIMER_DEV) - start_ts);
@@ -53,18 +124,83 @@ int main(void) {
             mr_timer_hf_delay_us(MARI_TIMER_DEV, SLOT);
         }
         puts(".");
-        if (j == 0 && mr_scheduler_gateway_assign_next_available_uplink_cell(mr_device_id(), 0) < 0) {  // try to assign at the end of first slotframe
-            printf("Failed to assign uplink cell\n");
-            return 1;
+        if (j == 0) {  // take the first uplink cell at the end of the first slotframe
+            for (size_t i = 0; i < schedule->n_cells; i++) {
+                if (schedule->cells[i].type == SLOT_TYPE_UPLINK) {
+                    mr_scheduler_node_assign_myself_to_cell(i);
+                    printf("Assigned to uplink cell %d\n", (int)i);
+                    break;
+                }
+            }
+        } else if (j == n_slotframes - 2) {  // and leave it at the end of the second-to-last slotframe
+            mr_scheduler_node_deassign_myself_from_schedule();
+            puts("Deassigned from the schedule");
         }
-        // else if (j == n_slotframes-2 && !mr_scheduler_gateway_deassign_uplink_cell(mr_device_id())) { // try to deassign at the end of the second-to-last slotframe
-        //     printf("Failed to deassign uplink cell\n");
-        //     return 1;
-        // }
     }
-    puts("Finished.");
+    puts("");
+}
 
-    while (1) {
-        __WFE();
+// previous implementation of mr_scheduler_tick
+static mr_slot_info_t _tick_switch(uint64_t asn) {
+    const schedule_t *schedule   = mr_scheduler_get_active_schedule_ptr();
+    size_t            cell_index = asn % schedule->n_cells;
+    const cell_t     *cell       = &schedule->cells[cell_index];
+
+    mr_slot_info_t slot_info = {
+        .radio_action = MARI_RADIO_ACTION_SLEEP,
+        .channel      = mr_scheduler_get_channel(cell->type, asn, cell->channel_offset),
+        .type         = cell->type,
+    };
+    if (mari_get_node_type() == MARI_GATEWAY) {
+        switch (cell->type) {
+            case SLOT_TYPE_BEACON:
+            case SLOT_TYPE_DOWNLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_TX;
+                break;
+            case SLOT_TYPE_SHARED_UPLINK:
+            case SLOT_TYPE_UPLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_RX;
+                break;
+        }
+    } else {
+        switch (cell->type) {
+            case SLOT_TYPE_BEACON:
+            case SLOT_TYPE_DOWNLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_RX;
+                break;
+            case SLOT_TYPE_SHARED_UPLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_TX;
+                break;
+            case SLOT_TYPE_UPLINK:
+                slot_info.radio_action = _owned[cell_index] ? MARI_RADIO_ACTION_TX : MARI_RADIO_ACTION_SLEEP;
+                break;
+        }
+        if (cell->type == SLOT_TYPE_SHARED_UPLINK) {
+            mr_assoc_node_tick_backoff();
+        }
+    }
+    return slot_info;
+}
+
+// times tick on consecutive slots, and, when reference is not NULL, checks the radio action and channel of every slot against it
+static bool _run(tick_t tick, tick_t reference, bench_cycles_t *cycles) {
+    for (uint64_t asn = BENCH_FIRST_ASN; asn < BENCH_FIRST_ASN + BENCH_SLOTS; asn++) {
+        uint32_t       start     = DWT->CYCCNT;
+        mr_slot_info_t slot_info = tick(asn);
+        uint32_t       elapsed   = DWT->CYCCNT - start;
+        cycles->total += elapsed;
+        if (elapsed > cycles->max) {
+            cycles->max = elapsed;
+        }
+
+        if (reference != NULL) {
+            mr_slot_info_t expected = reference(asn);
+            if (slot_info.radio_action != expected.radio_action || slot_info.channel != expected.channel) {
+                printf("Mismatch at asn %llu: action %c, channel %d, expected action %c, channel %d\n", asn, slot_info.radio_action, slot_info.channel,
+                       expected.radio_action, expected.channel);
+                return false;
+            }
+        }
     }
+    return true;
 }
@@ -1,7 +1,7 @@
 #include "scheduler.h"
 
 /* Very simple test schedule */
-schedule_t schedule_test_app = {
+const schedule_t schedule_test_app = {
     .id            = 10,  // make sure it doesn't collide
     .max_nodes     = 2,
     .backoff_n_min = 5,
@@ -9,16 +9,16 @@ schedule_t schedule_test_app = {
     .n_cells       = 5,
     .cells         = {
         // Only downlink slot_durations
-        { 'B', 0, NULL },
-        { 'S', 1, NULL },
-        { 'D', 2, NULL },
-        { 'U', 3, NULL },
-        { 'U', 4, NULL },
+        { 'B', 0 },
+        { 'S', 1 },
+        { 'D', 2 },
+        { 'U', 3 },
+        { 'U', 4 },
     }
 };
 
 /* Uplink only test schedule */
-schedule_t schedule_all_uplink = {
+const schedule_t schedule_all_uplink = {
     .id            = 10,  // make sure it doesn't collide
     .max_nodes     = 2,
     .backoff_n_min = 5,
@@ -26,16 +26,16 @@ schedule_t schedule_all_uplink = {
     .n_cells       = 5,
     .cells         = {
         // Only downlink slot_durations
-        { 'U', 0, NULL },
-        { 'U', 1, NULL },
-        { 'U', 2, NULL },
-        { 'U', 3, NULL },
-        { 'U', 4, NULL },
+        { 'U', 0 },
+        { 'U', 1 },
+        { 'U', 2 },
+        { 'U', 3 },
+        { 'U', 4 },
     }
 };
 
 /* Downlink only test schedule */
-schedule_t schedule_all_downlink = {
+const schedule_t schedule_all_downlink = {
     .id            = 10,  // make sure it doesn't collide
     .max_nodes     = 2,
     .backoff_n_min = 5,
@@ -43,10 +43,10 @@ schedule_t schedule_all_downlink = {
     .n_cells       = 5,
     .cells         = {
         // Only downlink slot_durations
-        { 'D', 0, NULL },
-        { 'D', 1, NULL },
-        { 'D', 2, NULL },
-        { 'D', 3, NULL },
-        { 'D', 4, NULL },
+        { 'D', 0 },
+        { 'D', 1 },
+        { 'D', 2 },
+        { 'D', 3 },
+        { 'D', 4 },
     }
 };
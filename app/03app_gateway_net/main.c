@@ -48,8 +48,8 @@ typedef struct {
 
 gateway_vars_t _app_vars = { 0 };
 
-extern schedule_t schedule_tiny, schedule_medium, schedule_big, schedule_huge;
-schedule_t       *schedule_app = &schedule_huge;
+extern const schedule_t schedule_tiny, schedule_medium, schedule_big, schedule_huge;
+const schedule_t       *schedule_app = &schedule_huge;
 
 volatile __attribute__((section(".shared_data"))) ipc_shared_data_t ipc_shared_data;
 
@@ -107,7 +107,8 @@ int main(void) {
 
                     ipc_shared_data.radio_to_uart_len = event_data.data.new_packet.len + 1;
                     ipc_shared_data.radio_to_uart[0]  = MARI_EDGE_DATA;
-                    memcpy((void *)ipc_shared_data.radio_to_uart + 1, event_data.data.new_packet.header, event_data.data.new_packet.len);
+                    memcpy((void *)ipc_shared_data.radio_to_uart + 1, event_data.data.new_packet.header, sizeof(mr_packet_header_t));
+                    memcpy((void *)ipc_shared_data.radio_to_uart + 1 + sizeof(mr_packet_header_t), event_data.data.new_packet.payload, event_data.data.new_packet.payload_len);
                     send_to_uart = true;
                     break;
                 }
@@ -167,7 +168,9 @@ int main(void) {
                 metrics_handle_tx_probe(header->dst, payload);
             }
 
-            mari_tx(mari_frame, mari_frame_len);
+            if (!mari_tx(mari_frame, mari_frame_len)) {
+                printf("Transmit queue full, dropped a packet to %016llX\n", header->dst);
+            }
         }
 
         if (_app_vars.to_uart_gateway_loop_ready) {
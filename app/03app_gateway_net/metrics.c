@@ -13,6 +13,7 @@
 
 #include "mr_radio.h"
 #include "mac.h"
+#include "mari.h"
 #include "models.h"
 
 #include "metrics.h"
@@ -28,7 +29,7 @@ typedef struct {
 //=========================== variables ========================================
 
 typedef struct {
-    node_metrics_t nodes[MARI_N_CELLS_MAX];
+    node_metrics_t nodes[MARI_MAX_NODES];
 } metrics_vars_t;
 
 metrics_vars_t metrics_vars = { 0 };
@@ -39,7 +40,7 @@ void metrics_init(void) {
 }
 
 void metrics_add_node(uint64_t node_id) {
-    for (uint8_t i = 0; i < MARI_N_CELLS_MAX; i++) {
+    for (size_t i = 0; i < MARI_MAX_NODES; i++) {
         if (metrics_vars.nodes[i].node_id == 0) {
             metrics_vars.nodes[i].node_id = node_id;
             break;
@@ -48,7 +49,7 @@ void metrics_add_node(uint64_t node_id) {
 }
 
 void metrics_clear_node(uint64_t node_id) {
-    for (uint8_t i = 0; i < MARI_N_CELLS_MAX; i++) {
+    for (size_t i = 0; i < MARI_MAX_NODES; i++) {
         if (metrics_vars.nodes[i].node_id == node_id) {
             metrics_vars.nodes[i].node_id  = 0;
             metrics_vars.nodes[i].tx_count = 0;
@@ -68,7 +69,7 @@ void metrics_handle_rx_probe(uint64_t node_id, uint8_t *payload) {
     metrics_payload->gw_rx_asn  = mr_mac_get_asn();
     metrics_payload->rssi_at_gw = mr_radio_rssi();
 
-    for (uint8_t i = 0; i < MARI_N_CELLS_MAX; i++) {
+    for (size_t i = 0; i < MARI_MAX_NODES; i++) {
         if (metrics_vars.nodes[i].node_id == node_id) {
             metrics_payload->gw_rx_count = ++metrics_vars.nodes[i].rx_count;
             break;
@@ -81,7 +82,7 @@ void metrics_handle_tx_probe(uint64_t node_id, uint8_t *payload) {
 
     metrics_payload->gw_tx_enqueued_asn = mr_mac_get_asn();
 
-    for (uint8_t i = 0; i < MARI_N_CELLS_MAX; i++) {
+    for (size_t i = 0; i < MARI_MAX_NODES; i++) {
         if (metrics_vars.nodes[i].node_id == node_id) {
             metrics_payload->gw_tx_count = ++metrics_vars.nodes[i].tx_count;
             break;
@@ -43,9 +43,9 @@ uint8_t packet[MARI_PACKET_MAX_SIZE] = { 0 };
 uint8_t payload[]                    = { 0xFA, 0xFA, 0xFA, 0xFA, 0xFA };
 uint8_t payload_len                  = 5;
 
-extern schedule_t schedule_minuscule, schedule_tiny, schedule_huge;
+extern const schedule_t schedule_minuscule, schedule_tiny, schedule_huge;
 
-schedule_t *schedule_app = &schedule_huge;
+const schedule_t *schedule_app = &schedule_huge;
 
 //=========================== prototypes =======================================
 
@@ -104,7 +104,7 @@ void mari_event_callback(mr_event_t event, mr_event_data_t event_data) {
 
 void tx_to_all_connected(void) {
     uint64_t nodes[MARI_MAX_NODES] = { 0 };
-    uint8_t  nodes_len             = mari_gateway_get_nodes(nodes);
+    size_t   nodes_len             = mari_gateway_get_nodes(nodes);
     for (int i = 0; i < nodes_len; i++) {
         // printf("Enqueing TX to node %d: %016llX\n", i, nodes[i]);
         payload[0]         = i;
@@ -57,8 +57,8 @@ typedef struct __attribute__((packed)) {
 node_vars_t  node_vars  = { 0 };
 node_stats_t node_stats = { 0 };
 
-extern schedule_t schedule_minuscule, schedule_tiny, schedule_huge;
-schedule_t       *schedule_app = &schedule_huge;
+extern const schedule_t schedule_minuscule, schedule_tiny, schedule_huge;
+const schedule_t       *schedule_app = &schedule_huge;
 
 // example status packet, to use as periodic uplink packet
 uint8_t status_packet_mock[4] = {
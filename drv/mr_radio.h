@@ -31,6 +31,7 @@
 
 #define MR_BLE_PAYLOAD_MAX_LENGTH        UINT8_MAX
 #define MR_IEEE802154_PAYLOAD_MAX_LENGTH (125UL)  ///< Total usable payload for IEEE 802.15.4 is 125 octets (PSDU) when CRC is activated
+#define MR_RADIO_TX_HEADROOM             (2)      ///< Bytes in front of a packet given to mr_radio_tx_prepare_in_place, overwritten with the PDU header and length
 
 /// Modes supported by the radio
 typedef enum {
@@ -126,7 +127,28 @@ void mr_radio_disable(void);
 bool mr_radio_pending_rx_read(void);
 void mr_radio_get_rx_packet(uint8_t *packet, uint8_t *length);
 
+/**
+ * @brief Gets the received packet without copying it
+ *
+ * @param[out] length   Length of the packet
+ *
+ * @return the packet, in the buffer of the radio, valid until the radio is enabled again
+ */
+uint8_t *mr_radio_get_rx_packet_in_place(uint8_t *length);
+
 void mr_radio_tx_prepare(const uint8_t *tx_buffer, uint8_t length);
+
+/**
+ * @brief Prepares the radio to send a packet straight from the buffer of the caller, without copying it
+ *
+ * The radio reads the packet with EasyDMA while it is sent, so the buffer must not change until the radio is
+ * disabled. The MR_RADIO_TX_HEADROOM bytes in front of the packet must belong to the same buffer, they are
+ * overwritten with the header of the PDU.
+ *
+ * @param[in] packet    Packet to send, preceded by MR_RADIO_TX_HEADROOM bytes of headroom
+ * @param[in] length    Length of the packet, headroom excluded
+ */
+void mr_radio_tx_prepare_in_place(uint8_t *packet, uint8_t length);
 void mr_radio_tx_dispatch(void);
 
 #endif  // __MR_RADIO_H
@@ -79,6 +79,7 @@ static radio_vars_t radio_vars = { 0 };
 //========================== prototypes ========================================
 
 static void _radio_enable(void);
+static void _radio_set_packet_ptr(radio_pdu_t *pdu);
 
 //=========================== public ===========================================
 
@@ -198,11 +199,7 @@ void mr_radio_init(radio_ts_packet_t start_pac_cb, radio_ts_packet_t end_pac_cb,
     }
 
     // Configure pointer to PDU for EasyDMA
-    if (mode == MR_RADIO_IEEE802154_250Kbit) {
-        NRF_RADIO->PACKETPTR = (uint32_t)((uint8_t *)&radio_vars.pdu + 1);  // Skip header for IEEE 802.15.4
-    } else {
-        NRF_RADIO->PACKETPTR = (uint32_t)&radio_vars.pdu;
-    }
+    _radio_set_packet_ptr(&radio_vars.pdu);
 
     // Assign the callbacks that will be called in the RADIO_IRQHandler
     radio_vars.start_pac_cb = start_pac_cb;
@@ -258,6 +255,12 @@ void mr_radio_get_rx_packet(uint8_t *packet, uint8_t *length) {
     radio_vars.pending_rx_read = false;
 }
 
+uint8_t *mr_radio_get_rx_packet_in_place(uint8_t *length) {
+    *length                    = radio_vars.pdu.length;
+    radio_vars.pending_rx_read = false;
+    return radio_vars.pdu.payload;
+}
+
 //--------------------------- send and receive --------------------------------
 
 // TODO: split into mr_radio_rx_prepare and mr_radio_rx_dispatch
@@ -267,6 +270,9 @@ void mr_radio_rx(void) {
         return;
     }
 
+    // receive in the buffer of the driver, the last transmission may have pointed the radio elsewhere
+    _radio_set_packet_ptr(&radio_vars.pdu);
+
     // enable the radio shorts and interrupts
     NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON | (RADIO_SHORTS_RXREADY_START_Enabled << RADIO_SHORTS_RXREADY_START_Pos);
     _radio_enable();
@@ -279,6 +285,18 @@ void mr_radio_tx_prepare(const uint8_t *tx_buffer, uint8_t length) {
     // TODO: check for IDLE?
     radio_vars.pdu.length = length;
     memcpy(radio_vars.pdu.payload, tx_buffer, length);
+    _radio_set_packet_ptr(&radio_vars.pdu);
+
+    // ramp up the radio for tx (packet will not be sent yet)
+    NRF_RADIO->TASKS_TXEN = RADIO_TASKS_TXEN_TASKS_TXEN_Trigger << RADIO_TASKS_TXEN_TASKS_TXEN_Pos;
+}
+
+void mr_radio_tx_prepare_in_place(uint8_t *packet, uint8_t length) {
+    // the header and length of the PDU go in the headroom, right in front of the packet
+    radio_pdu_t *pdu = (radio_pdu_t *)(packet - MR_RADIO_TX_HEADROOM);
+    pdu->header      = 0;
+    pdu->length      = length;
+    _radio_set_packet_ptr(pdu);
 
     // ramp up the radio for tx (packet will not be sent yet)
     NRF_RADIO->TASKS_TXEN = RADIO_TASKS_TXEN_TASKS_TXEN_Trigger << RADIO_TASKS_TXEN_TASKS_TXEN_Pos;
@@ -307,6 +325,14 @@ static void _radio_enable(void) {
     NRF_RADIO->INTENSET        = RADIO_INTERRUPTS;
 }
 
+static void _radio_set_packet_ptr(radio_pdu_t *pdu) {
+    if (radio_vars.mode == MR_RADIO_IEEE802154_250Kbit) {
+        NRF_RADIO->PACKETPTR = (uint32_t)&pdu->length;  // Skip header for IEEE 802.15.4
+    } else {
+        NRF_RADIO->PACKETPTR = (uint32_t)pdu;
+    }
+}
+
 //=========================== interrupt handlers ===============================
 
 /**
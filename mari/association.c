@@ -10,6 +10,7 @@
  */
 
 #include <nrf.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -60,14 +61,15 @@ mr_gpio_t led3 = { .port = 0, .pin = 31 };
 //=========================== defines =========================================
 
 #define MARI_BACKOFF_N_MIN 4
-#define MARI_BACKOFF_N_MAX 6
+#define MARI_BACKOFF_N_MAX 6  // raised to log2 of the maximum number of nodes, for large schedules
 
-#define MARI_JOIN_TIMEOUT_SINCE_SYNCED (1000 * 1000 * 5)  // 5 seconds. after this time, go back to scanning. NOTE: have it be based on slotframe size?
+#define MARI_JOIN_TIMEOUT_SINCE_SYNCED (1000 * 1000 * 5)  // 5 seconds. after this time, go back to scanning
+#define MARI_JOIN_TIMEOUT_SLOTFRAMES   8                  // unless the slotframes are so long that this is longer
 
 // after this amount of time, consider that a join request failed (very likely due to a collision during the shared uplink slot)
-// currently set to 2 slot durations -- enough when the schedule always have a shared-uplink followed by a downlink,
+// currently set to the shared uplink slot and half of the next one -- enough when the schedule always have a shared-uplink followed by a downlink,
 // and the gateway prioritizes join responses over all other downstream packets
-#define MARI_JOINING_STATE_TIMEOUT ((MARI_WHOLE_SLOT_DURATION * (2 - 1)) + (MARI_WHOLE_SLOT_DURATION / 2))  // apply a half-slot duration just so that the timeout happens before the slot boundary
+#define MARI_JOINING_STATE_TIMEOUT (MARI_SHARED_UPLINK_SLOT_DURATION + (MARI_WHOLE_SLOT_DURATION / 2))  // apply a half-slot duration just so that the timeout happens before the slot boundary
 
 typedef struct {
     mr_assoc_state_t state;
@@ -78,10 +80,11 @@ typedef struct {
     // node
     uint32_t       last_received_from_gateway_asn;  ///< Last received packet when in joined state
     int16_t        backoff_n;
-    uint8_t        backoff_random_time;                ///< Number of slots to wait before re-trying to join
+    uint16_t       backoff_random_time;                ///< Number of slots to wait before re-trying to join
     uint32_t       join_response_timeout_ts;           ///< Time when the node will give up joining
     uint16_t       synced_gateway_remaining_capacity;  ///< Number of nodes that my gateway can still accept
     mr_event_tag_t is_pending_disconnect;              ///< Whether the node is pending a disconnect
+    bool           compact_header;                     ///< Whether the gateway agreed to compact headers in the join response
 } assoc_vars_t;
 
 //=========================== variables =======================================
@@ -90,7 +93,7 @@ assoc_vars_t assoc_vars = { 0 };
 
 //=========================== prototypes ======================================
 
-uint8_t mr_assoc_node_compute_backoff_random_time(uint8_t backoff_n);
+uint16_t mr_assoc_node_compute_backoff_random_time(uint8_t backoff_n);
 void    mr_assoc_node_init_backoff(void);
 
 //=========================== public ==========================================
@@ -180,7 +183,8 @@ void mr_assoc_node_start_joining(void) {
     mr_assoc_set_state(JOIN_STATE_JOINING);
 }
 
-void mr_assoc_node_handle_joined(uint64_t gateway_id) {
+void mr_assoc_node_handle_joined(uint64_t gateway_id, bool compact_header) {
+    assoc_vars.compact_header = compact_header;
     mr_assoc_set_state(JOIN_STATE_JOINED);
     mr_queue_reset();  // clear the queue to avoid sending old packets
     mr_event_data_t event_data = { .data.gateway_info.gateway_id = gateway_id };
@@ -229,7 +233,11 @@ bool mr_assoc_node_too_long_synced_without_joining(void) {
 
     uint32_t now_ts    = mr_timer_hf_now(MARI_TIMER_DEV);
     uint32_t synced_ts = mr_mac_get_synced_ts();
-    return now_ts - synced_ts > MARI_JOIN_TIMEOUT_SINCE_SYNCED;
+    uint32_t timeout   = MARI_JOIN_TIMEOUT_SLOTFRAMES * mr_scheduler_get_duration_us();
+    if (timeout < MARI_JOIN_TIMEOUT_SINCE_SYNCED) {
+        timeout = MARI_JOIN_TIMEOUT_SINCE_SYNCED;
+    }
+    return now_ts - synced_ts > timeout;
 }
 
 // to be called when the node is ready to join, i.e., when it gets synced with the gateway
@@ -259,21 +267,32 @@ void mr_assoc_node_register_collision_backoff(void) {
         assoc_vars.backoff_n = MARI_BACKOFF_N_MIN;
     } else {
         // increment the n in [0, 2^n - 1], but only if n is less than the max
+        // with many nodes contending for the shared uplink cells, the window must be about as large as their number
+        uint8_t n_max = MARI_BACKOFF_N_MAX;
+        while (n_max < 15 && (1u << (n_max + 1)) <= mr_scheduler_get_max_nodes()) {
+            n_max++;
+        }
         uint8_t new_n        = assoc_vars.backoff_n + 1;
-        assoc_vars.backoff_n = new_n < MARI_BACKOFF_N_MAX ? new_n : MARI_BACKOFF_N_MAX;
+        assoc_vars.backoff_n = new_n < n_max ? new_n : n_max;
     }
 
     assoc_vars.backoff_random_time = mr_assoc_node_compute_backoff_random_time(assoc_vars.backoff_n);
 }
 
-uint8_t mr_assoc_node_compute_backoff_random_time(uint8_t backoff_n) {
+uint16_t mr_assoc_node_compute_backoff_random_time(uint8_t backoff_n) {
     // first, compute the maximum value for the random number
-    uint8_t max = (1 << backoff_n) - 1;
+    uint16_t max = (1 << backoff_n) - 1;
 
     // then, read a random number from the RNG
-    // NOTE: the RNG call to read 1 byte in fast mode takes about 160 us
-    uint8_t random_number;
-    mr_rng_read_u8_fast(&random_number);
+    // NOTE: the RNG call to read 1 byte in fast mode takes about 160 us, so only read a second one for large windows
+    uint8_t  random_byte;
+    uint16_t random_number;
+    mr_rng_read_u8_fast(&random_byte);
+    random_number = random_byte;
+    if (max > UINT8_MAX) {
+        mr_rng_read_u8_fast(&random_byte);
+        random_number |= (uint16_t)random_byte << 8;
+    }
 
     // finally, make sure random number is in the interval [0, max]
     // using modulo does not give perfect uniformity,
@@ -335,78 +354,52 @@ bool mr_assoc_node_matches_network_id(uint16_t network_id) {
     return assoc_vars.network_id == network_id;
 }
 
+// whether data and keep-alive packets to and from the gateway use compact headers
+bool mr_assoc_node_uses_compact_header(void) {
+    return assoc_vars.compact_header && assoc_vars.state == JOIN_STATE_JOINED;
+}
+
 // ------------ gateway functions ---------
 
 bool mr_assoc_gateway_node_is_joined(uint64_t node_id) {
-    schedule_t *schedule = mr_scheduler_get_active_schedule_ptr();
-    for (size_t i = 0; i < schedule->n_cells; i++) {
-        if (schedule->cells[i].type != SLOT_TYPE_UPLINK) {
-            // we only care about uplink cells
-            continue;
-        }
-        if (schedule->cells[i].assigned_node_id == node_id) {
-            // this node is assigned to a cell, so it is joined
-            return true;
-        }
-    }
-    return false;
+    // a node is joined if it is assigned to a cell
+    return mr_scheduler_gateway_get_node_cell(node_id) >= 0;
 }
 
 bool mr_assoc_gateway_keep_node_alive(uint64_t node_id, uint64_t asn) {
     // save the asn of the last packet received from a certain node_id
-    schedule_t *schedule = mr_scheduler_get_active_schedule_ptr();
-    for (size_t i = 0; i < schedule->n_cells; i++) {
-        if (schedule->cells[i].type != SLOT_TYPE_UPLINK) {
-            // we only care about uplink cells
-            continue;
-        }
-        if (schedule->cells[i].assigned_node_id == node_id) {
-            // save the asn so we know this node is alive
-            schedule->cells[i].last_received_asn = asn;
-        }
+    int16_t cell_index = mr_scheduler_gateway_get_node_cell(node_id);
+    if (cell_index < 0) {
+        return false;
     }
-    // should never reach here
-    return false;
+    mr_scheduler_gateway_keep_cell_alive(cell_index, asn);
+    return true;
 }
 
 void mr_assoc_gateway_clear_old_nodes(uint64_t asn) {
     // clear all nodes that have not been heard from in the last N asn
     // also deassign the cells from the scheduler
-    uint64_t max_asn_old = mr_scheduler_get_active_schedule_slot_count() * MARI_MAX_SLOTFRAMES_NO_RX_LEAVE;
-
-    schedule_t *schedule = mr_scheduler_get_active_schedule_ptr();
-    for (size_t i = 0; i < schedule->n_cells; i++) {
-        if (schedule->cells[i].type != SLOT_TYPE_UPLINK) {
-            // we only care about uplink cells
-            continue;
-        }
-        cell_t *cell = &schedule->cells[i];
-        if (cell->assigned_node_id != 0 && asn - cell->last_received_asn > max_asn_old) {
-            mr_event_data_t event_data = (mr_event_data_t){ .data.node_info.node_id = cell->assigned_node_id, .tag = MARI_PEER_LOST_TIMEOUT };
-            // inform the scheduler
-            mr_scheduler_gateway_decrease_nodes_counter();
-            // clear the cell
-            cell->assigned_node_id  = NULL;
-            cell->last_received_asn = 0;
-            // inform the application
-            assoc_vars.mari_event_callback(MARI_NODE_LEFT, event_data);
-        }
+    // the scheduler keeps the nodes bucketed by expiry asn, so only the ones expiring now are visited
+    // popping a node also clears its cell in the scheduler
+    uint64_t node_id;
+    while ((node_id = mr_scheduler_gateway_pop_expired_node(asn)) != 0) {
+        mr_event_data_t event_data = (mr_event_data_t){ .data.node_info.node_id = node_id, .tag = MARI_PEER_LOST_TIMEOUT };
+        // inform the application
+        assoc_vars.mari_event_callback(MARI_NODE_LEFT, event_data);
     }
 }
 
 // ------------ packet handlers -------
 
 void mr_assoc_handle_beacon(uint8_t *packet, uint8_t length, uint8_t channel, uint32_t ts) {
-    (void)length;
-
-    if (packet[1] != MARI_PACKET_BEACON) {
+    if (length < offsetof(mr_beacon_packet_header_t, membership) || packet[1] != MARI_PACKET_BEACON) {
         return;
     }
 
     // now that we know it's a beacon packet, parse and process it
     mr_beacon_packet_header_t *beacon = (mr_beacon_packet_header_t *)packet;
 
-    if (beacon->version != MARI_PROTOCOL_VERSION) {
+    if ((beacon->version & MARI_HEADER_VERSION_MASK) != MARI_PROTOCOL_VERSION) {
         // ignore packet with different protocol version
         return;
     }
@@ -418,7 +411,15 @@ void mr_assoc_handle_beacon(uint8_t *packet, uint8_t length, uint8_t channel, ui
 
     bool from_my_gateway = beacon->src == mr_mac_get_synced_gateway();
     if (from_my_gateway && mr_assoc_is_joined()) {
-        bool still_joined = mr_bloom_node_contains(mr_device_id(), beacon->bloom_filter);
+        bool   still_joined;
+        size_t membership_len = length - offsetof(mr_beacon_packet_header_t, membership);
+        if (beacon->version & MARI_HEADER_OCCUPANCY) {
+            still_joined = mr_scheduler_node_in_occupancy(beacon->membership, membership_len);
+        } else if (membership_len < mr_bloom_get_m_bits() / 8 || beacon->active_schedule_id != mr_scheduler_get_active_schedule_id()) {
+            still_joined = true;  // the filter is sized for another schedule, or was not sent
+        } else {
+            still_joined = mr_bloom_node_contains_myself(beacon->membership);
+        }
         if (!still_joined) {
             // node no longer joined to this gateway, so need to leave
             assoc_vars.is_pending_disconnect = MARI_PEER_LOST_BLOOM;
@@ -431,9 +432,21 @@ void mr_assoc_handle_beacon(uint8_t *packet, uint8_t length, uint8_t channel, ui
     if (from_my_gateway && assoc_vars.state >= JOIN_STATE_SYNCED) {
         // save the remaining capacity of my gateway
         assoc_vars.synced_gateway_remaining_capacity = beacon->remaining_capacity;
+
+        // follow the schedule of my gateway, staying on the same uplink cell number
+        if (beacon->active_schedule_id != mr_scheduler_get_active_schedule_id()) {
+            // the announcement of the switch was missed
+            mr_scheduler_switch_schedule(beacon->active_schedule_id, 0);
+        }
+        if (beacon->switch_asn != 0) {
+            mr_scheduler_switch_schedule(beacon->next_schedule_id, beacon->switch_asn);
+        }
+
+        // the mac estimates the link with my gateway from every frame, the scan list is for the other gateways
+        return;
     }
 
-    if (beacon->remaining_capacity == 0) {  // TODO: what if I am joined to this gateway? add a check for it.
+    if (beacon->remaining_capacity == 0) {
         // this gateway is full, ignore it
         return;
     }
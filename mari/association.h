@@ -42,7 +42,8 @@ uint16_t         mr_assoc_get_network_id(void);
 void mr_assoc_node_handle_synced(void);
 bool mr_assoc_node_ready_to_join(void);
 void mr_assoc_node_start_joining(void);
-void mr_assoc_node_handle_joined(uint64_t gateway_id);
+void mr_assoc_node_handle_joined(uint64_t gateway_id, bool compact_header);
+bool mr_assoc_node_uses_compact_header(void);
 bool mr_assoc_node_handle_failed_join(void);
 bool mr_assoc_node_too_long_waiting_for_join_response(void);
 bool mr_assoc_node_too_long_synced_without_joining(void);
@@ -53,6 +54,7 @@ bool mr_assoc_node_matches_network_id(uint16_t network_id);
 
 void mr_assoc_node_register_collision_backoff(void);
 void mr_assoc_node_reset_backoff(void);
+void mr_assoc_node_tick_backoff(void);
 
 bool mr_assoc_node_should_leave(uint32_t asn);
 void mr_assoc_node_keep_gateway_alive(uint64_t asn);
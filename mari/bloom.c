@@ -14,24 +14,39 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "mr_device.h"
 #include "bloom.h"
 #include "scheduler.h"
 
 //=========================== defines ==========================================
 
 typedef struct {
+    // size of the filter, from the active schedule
+    uint16_t m_bits;
+    uint8_t  k_hashes;
+
     // used by the gateway
-    bool    is_dirty;                   // true if the bloom filter needs to be re-computed
-    bool    is_available;               // true if the bloom filter is being computed
-    uint8_t bloom[MARI_BLOOM_M_BYTES];  // bloom filter output
+    bool     is_dirty;                     // true if the bloom filter needs to be re-computed
+    bool     is_available;                 // true if the bloom filter is being computed
+    uint32_t bloom[MARI_BLOOM_M_WORDS];    // bloom filter output, bit i of the filter is bit i % 32 of word i / 32
+    uint8_t  counters[MARI_BLOOM_M_BITS];  // how many nodes set each bit, so that a leave can clear it
+
+    // used by the node, whose id never changes
+    uint16_t node_bits[MARI_BLOOM_K_MAX];  // bits of the node in the bloom filter
+    uint64_t node_h1;                      // H1 hash of the node ID
+    uint64_t node_h2;                      // H2 hash of the node ID
 } bloom_vars_t;
 
 //=========================== variables ========================================
 
-static bloom_vars_t bloom_vars = { 0 };
+static bloom_vars_t bloom_vars = { .m_bits = MARI_BLOOM_M_BITS, .k_hashes = 2 };
 
 //=========================== prototypes =======================================
 
+static inline uint16_t _bit_index(uint64_t h1, uint64_t h2, int k);
+static void            _compute_node_bits(void);
+static void            _mark_dirty_if_computing(void);
+
 //=========================== public ===========================================
 
 // FNV-1a 64-bit hash
@@ -45,11 +60,57 @@ uint64_t mr_bloom_hash_fnv1a64(uint64_t input) {
     return hash;
 }
 
+void mr_bloom_set_size(size_t n_uplinks) {
+    if (n_uplinks == 0) {
+        n_uplinks = 1;
+    }
+    uint32_t m_bits = mr_bloom_m_bits_for(n_uplinks);
+    // k = m / n * ln(2), rounded
+    uint32_t k_hashes = (m_bits * 693 + n_uplinks * 500) / (n_uplinks * 1000);
+    if (k_hashes < 1) {
+        k_hashes = 1;
+    } else if (k_hashes > MARI_BLOOM_K_MAX) {
+        k_hashes = MARI_BLOOM_K_MAX;
+    }
+
+    if (m_bits == bloom_vars.m_bits && k_hashes == bloom_vars.k_hashes) {
+        return;
+    }
+    bloom_vars.m_bits   = m_bits;
+    bloom_vars.k_hashes = k_hashes;
+
+    // the bits of every node moved: the gateway recomputes its filter, the node its own bits
+    bloom_vars.is_available = false;
+    bloom_vars.is_dirty     = true;
+    _compute_node_bits();
+}
+
+uint16_t mr_bloom_m_bits_for(size_t n_uplinks) {
+    if (n_uplinks == 0) {
+        n_uplinks = 1;
+    }
+    uint32_t m_bits = ((n_uplinks * MARI_BLOOM_BITS_PER_NODE + 7) / 8) * 8;  // whole bytes
+    if (m_bits > MARI_BLOOM_M_BITS) {
+        m_bits = MARI_BLOOM_M_BITS;
+    }
+    return m_bits;
+}
+
+uint16_t mr_bloom_get_m_bits(void) {
+    return bloom_vars.m_bits;
+}
+
+uint8_t mr_bloom_get_k_hashes(void) {
+    return bloom_vars.k_hashes;
+}
+
 // -------- gateway ---------
 
 void mr_bloom_gateway_init(void) {
-    bloom_vars.is_dirty     = false;
-    bloom_vars.is_available = false;
+    bloom_vars.is_dirty = false;
+    memset(bloom_vars.bloom, 0, sizeof(bloom_vars.bloom));
+    memset(bloom_vars.counters, 0, MARI_BLOOM_M_BITS);
+    bloom_vars.is_available = true;  // no node has joined yet
 }
 
 void mr_bloom_gateway_set_dirty(void) {
@@ -61,60 +122,107 @@ void mr_bloom_gateway_set_clean(void) {
 }
 
 bool mr_bloom_gateway_is_dirty(void) {
-    return bloom_vars.is_dirty;
+    return __atomic_load_n(&bloom_vars.is_dirty, __ATOMIC_ACQUIRE);
 }
 
 bool mr_bloom_gateway_is_available(void) {
-    return bloom_vars.is_available;
+    return __atomic_load_n(&bloom_vars.is_available, __ATOMIC_ACQUIRE);
 }
 
+// the words are little-endian, as on the nRF, so bit i of the filter is bit i % 8 of byte i / 8 in the beacon
 uint8_t mr_bloom_gateway_copy(uint8_t *output) {
-    memcpy(output, bloom_vars.bloom, MARI_BLOOM_M_BYTES);
-    return MARI_BLOOM_M_BYTES;
+    memcpy(output, bloom_vars.bloom, bloom_vars.m_bits / 8);
+    return bloom_vars.m_bits / 8;
 }
 
+// runs in the event loop, while joins and leaves patch the filter from the radio interrupt
 void mr_bloom_gateway_compute(void) {
-    bloom_vars.is_available = false;
-    memset(bloom_vars.bloom, 0, MARI_BLOOM_M_BYTES);
-
-    schedule_t *schedule_ptr = mr_scheduler_get_active_schedule_ptr();
-
-    for (size_t i = 0; i < schedule_ptr->n_cells; i++) {
-        cell_t *cell = &schedule_ptr->cells[i];
-        if (cell->type != SLOT_TYPE_UPLINK) {
-            continue;  // skip non-uplink cells
-        }
-        if (cell->assigned_node_id == NULL) {
+    __atomic_store_n(&bloom_vars.is_available, false, __ATOMIC_RELEASE);
+    // clear the request before scanning the uplinks: a join or leave from now on requests another pass
+    (void)__atomic_exchange_n(&bloom_vars.is_dirty, false, __ATOMIC_ACQ_REL);
+    memset(bloom_vars.counters, 0, MARI_BLOOM_M_BITS);
+
+    size_t          n_uplinks;
+    const uplink_t *uplinks = mr_scheduler_get_uplinks(&n_uplinks);
+
+    // build the filter a word at a time on the stack, and replace the previous one with a single copy
+    uint32_t bloom[MARI_BLOOM_M_WORDS] = { 0 };
+    for (size_t i = 0; i < n_uplinks; i++) {
+        const uplink_t *uplink = &uplinks[i];
+        if (uplink->assigned_node_id == 0) {
             continue;  // skip empty cells
         }
+        for (int k = 0; k < bloom_vars.k_hashes; k++) {
+            uint16_t idx = _bit_index(uplink->bloom_h1, uplink->bloom_h2, k);
+            if (bloom_vars.counters[idx] < UINT8_MAX) {
+                bloom_vars.counters[idx]++;
+            }
+            bloom[idx / 32] |= (uint32_t)1 << (idx % 32);
+        }
+    }
+    memcpy(bloom_vars.bloom, bloom, sizeof(bloom));
+    __atomic_store_n(&bloom_vars.is_available, true, __ATOMIC_RELEASE);
+}
 
-        uint64_t h1 = cell->bloom_h1;
-        uint64_t h2 = cell->bloom_h2;
+void mr_bloom_gateway_add(uint64_t h1, uint64_t h2) {
+    for (int k = 0; k < bloom_vars.k_hashes; k++) {
+        uint16_t idx = _bit_index(h1, h2, k);
+        if (bloom_vars.counters[idx] < UINT8_MAX) {
+            bloom_vars.counters[idx]++;
+        }
+        bloom_vars.bloom[idx / 32] |= (uint32_t)1 << (idx % 32);
+    }
+    _mark_dirty_if_computing();
+}
 
-        for (int k = 0; k < MARI_BLOOM_K_HASHES; k++) {
-            uint64_t idx = (h1 + k * h2) & (MARI_BLOOM_M_BITS - 1);  // Fast bitmask instead of division
-            bloom_vars.bloom[idx / 8] |= (1 << (idx % 8));
+void mr_bloom_gateway_remove(uint64_t h1, uint64_t h2) {
+    for (int k = 0; k < bloom_vars.k_hashes; k++) {
+        uint16_t idx = _bit_index(h1, h2, k);
+        if (bloom_vars.counters[idx] == 0 || bloom_vars.counters[idx] == UINT8_MAX) {
+            continue;  // a saturated counter is never decremented: a false positive rather than a false negative
+        }
+        if (--bloom_vars.counters[idx] == 0) {
+            bloom_vars.bloom[idx / 32] &= ~((uint32_t)1 << (idx % 32));
         }
     }
-    bloom_vars.is_available = true;
+    _mark_dirty_if_computing();
 }
 
 void mr_bloom_gateway_event_loop(void) {
-    // check if the bloom filter needs to be re-computed
+    // check if the bloom filter needs to be re-computed, the compute clears the request so one made meanwhile is kept
     if (mr_bloom_gateway_is_dirty()) {
         mr_bloom_gateway_compute();
-        mr_bloom_gateway_set_clean();
     }
 }
 
 // -------- node ---------
 
+void mr_bloom_node_init(void) {
+    bloom_vars.node_h1 = mr_bloom_hash_fnv1a64(mr_device_id());
+    bloom_vars.node_h2 = mr_bloom_hash_fnv1a64(mr_device_id() ^ MARI_BLOOM_FNV1A_H2_SALT);
+    _compute_node_bits();
+}
+
+uint64_t mr_bloom_node_get_h2(void) {
+    return bloom_vars.node_h2;
+}
+
+bool mr_bloom_node_contains_myself(const uint8_t *bloom) {
+    for (int k = 0; k < bloom_vars.k_hashes; k++) {
+        uint16_t idx = bloom_vars.node_bits[k];
+        if ((bloom[idx / 8] & (1 << (idx % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool mr_bloom_node_contains(uint64_t node_id, const uint8_t *bloom) {
     uint64_t h1 = mr_bloom_hash_fnv1a64(node_id);
     uint64_t h2 = mr_bloom_hash_fnv1a64(node_id ^ MARI_BLOOM_FNV1A_H2_SALT);
 
-    for (int k = 0; k < MARI_BLOOM_K_HASHES; k++) {
-        uint64_t idx = (h1 + k * h2) & (MARI_BLOOM_M_BITS - 1);  // Fast bitmask instead of division
+    for (int k = 0; k < bloom_vars.k_hashes; k++) {
+        uint16_t idx = _bit_index(h1, h2, k);
         if ((bloom[idx / 8] & (1 << (idx % 8))) == 0) {
             return false;
         }
@@ -123,3 +231,20 @@ bool mr_bloom_node_contains(uint64_t node_id, const uint8_t *bloom) {
 }
 
 //=========================== private ==========================================
+
+static inline uint16_t _bit_index(uint64_t h1, uint64_t h2, int k) {
+    return MARI_BLOOM_BIT_INDEX(h1, h2, k, bloom_vars.m_bits);
+}
+
+static void _compute_node_bits(void) {
+    for (int k = 0; k < bloom_vars.k_hashes; k++) {
+        bloom_vars.node_bits[k] = _bit_index(bloom_vars.node_h1, bloom_vars.node_h2, k);
+    }
+}
+
+// a compute in progress may have scanned the uplink already, and overwrites the filter and counters when it ends
+static void _mark_dirty_if_computing(void) {
+    if (!__atomic_load_n(&bloom_vars.is_available, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&bloom_vars.is_dirty, true, __ATOMIC_RELEASE);
+    }
+}
@@ -13,14 +13,28 @@
  */
 
 #include <nrf.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 //=========================== defines =========================================
 
-#define MARI_BLOOM_M_BITS   1024
-#define MARI_BLOOM_M_BYTES  (MARI_BLOOM_M_BITS / 8)
-#define MARI_BLOOM_K_HASHES 2
+// Largest filter, the schedules with fewer uplinks use a smaller one (see mr_bloom_set_size). 1024 bits cover the
+// pre-stored schedules at MARI_BLOOM_BITS_PER_NODE. With MARI_LARGE_SCHEDULES, the filter takes all the room left in
+// a beacon after its 35 bytes of header, 1760 bits, and still falls short of it beyond 176 uplinks: at 512, with k = 2,
+// about 20 % of the nodes the gateway dropped do not find out from the beacons, until the set of joined nodes changes.
+#ifdef MARI_LARGE_SCHEDULES
+#define MARI_BLOOM_M_BITS 1760
+#else
+#define MARI_BLOOM_M_BITS 1024
+#endif
+#define MARI_BLOOM_M_BYTES       (MARI_BLOOM_M_BITS / 8)
+#define MARI_BLOOM_M_WORDS       (MARI_BLOOM_M_BITS / 32)
+#define MARI_BLOOM_K_MAX         6
+#define MARI_BLOOM_BITS_PER_NODE 10  // about 1 % of false positives, as long as the filter is not at its largest
+
+// bit k of a node in a filter of m_bits, with a multiply-shift rather than a modulo, so that m_bits need not be a power of two
+#define MARI_BLOOM_BIT_INDEX(h1, h2, k, m_bits) ((uint16_t)(((uint64_t)(uint32_t)((h1) + (k) * (h2)) * (m_bits)) >> 32))
 
 #define MARI_BLOOM_FNV1A_H2_SALT 0x5bd1e995
 
@@ -30,6 +44,18 @@
 
 uint64_t mr_bloom_hash_fnv1a64(uint64_t input);
 
+/**
+ * @brief Sizes the filter for a schedule: MARI_BLOOM_BITS_PER_NODE bits per uplink, up to MARI_BLOOM_M_BITS, and the
+ *        number of hashes with the fewest false positives, up to MARI_BLOOM_K_MAX.
+ *
+ * Gateway and nodes size it the same way from the same schedule. When the size changes, the filter of the gateway
+ * is unavailable until it is recomputed.
+ */
+void     mr_bloom_set_size(size_t n_uplinks);
+uint16_t mr_bloom_m_bits_for(size_t n_uplinks);  // the size mr_bloom_set_size would pick, without setting it
+uint16_t mr_bloom_get_m_bits(void);
+uint8_t  mr_bloom_get_k_hashes(void);
+
 void    mr_bloom_gateway_init(void);
 void    mr_bloom_gateway_set_dirty(void);
 void    mr_bloom_gateway_set_clean(void);
@@ -37,8 +63,13 @@ bool    mr_bloom_gateway_is_dirty(void);
 bool    mr_bloom_gateway_is_available(void);
 uint8_t mr_bloom_gateway_copy(uint8_t *output);
 void    mr_bloom_gateway_compute(void);
+void    mr_bloom_gateway_add(uint64_t h1, uint64_t h2);
+void    mr_bloom_gateway_remove(uint64_t h1, uint64_t h2);
 void    mr_bloom_gateway_event_loop(void);
 
-bool mr_bloom_node_contains(uint64_t node_id, const uint8_t *bloom);
+void     mr_bloom_node_init(void);
+uint64_t mr_bloom_node_get_h2(void);
+bool     mr_bloom_node_contains_myself(const uint8_t *bloom);  // same as mr_bloom_node_contains, with the bits of the node computed at init
+bool     mr_bloom_node_contains(uint64_t node_id, const uint8_t *bloom);
 
 #endif  // __BLOOM_H
@@ -78,6 +78,8 @@ typedef struct {
     uint64_t       asn;                ///< Absolute slot number
     mr_slot_info_t current_slot_info;  ///< Information about the current slot
 
+    const mr_slot_durations_t *current_durations;  ///< Intra-slot durations of the current slot, which depend on its type
+
     mr_event_cb_t mari_event_callback;  ///< Function pointer, stores the application callback
 
     mr_received_packet_t received_packet;  ///< Last received packet
@@ -86,15 +88,11 @@ typedef struct {
     uint32_t scan_started_ts;       ///< Timestamp of the start of the scan
     uint32_t scan_expected_end_ts;  ///< Timestamp of the expected end of the scan
     uint32_t current_scan_item_ts;  ///< Timestamp of the current scan item
+    uint8_t  scan_channel;          ///< Advertising channel the node is scanning on
 
     bool is_bg_scanning;           ///< Whether the node is scanning for gateways in the background
     bool bg_scan_sleep_next_slot;  ///< Whether the next slot is a sleep slot
 
-    ///< This timestamp keeps track of a full handover scan, that is, a scan that
-    ///< Potentially spans multiple background scans (the bg scans are typically very short)
-    uint32_t full_bg_scan_started_ts;
-    uint32_t full_bg_scan_expected_end_ts;  ///< Timestamp of the expected end of the full handover scan
-
     uint64_t synced_gateway;     ///< ID of the gateway the node is synchronized with
     uint16_t synced_network_id;  ///< Network ID of the gateway the node is synchronized with
     uint32_t synced_ts;          ///< Timestamp of the last synchronization
@@ -117,6 +115,34 @@ mr_slot_durations_t slot_durations = {
     .whole_slot = MARI_WHOLE_SLOT_DURATION,
 };
 
+// beacon slots, sized for a beacon, as long as the beacons of the active schedule (see mr_mac_set_beacon_length)
+mr_slot_durations_t slot_durations_beacon = {
+    .tx_offset = MARI_TS_TX_OFFSET,
+    .tx_max    = MARI_SLOT_TOA_WITH_PADDING(sizeof(mr_beacon_packet_header_t)),
+
+    .rx_guard  = MARI_RX_GUARD_TIME,
+    .rx_offset = MARI_TS_TX_OFFSET - MARI_RX_GUARD_TIME,
+    .rx_max    = (MARI_RX_GUARD_TIME * 2) + MARI_SLOT_TOA_WITH_PADDING(sizeof(mr_beacon_packet_header_t)),  // the frame may be this long, and start up to rx_guard late
+
+    .end_guard = MARI_END_GUARD_TIME,
+
+    .whole_slot = MARI_BEACON_SLOT_DURATION,
+};
+
+// shared uplink slots, sized for a join request
+mr_slot_durations_t slot_durations_shared_uplink = {
+    .tx_offset = MARI_TS_TX_OFFSET,
+    .tx_max    = MARI_SLOT_TOA_WITH_PADDING(sizeof(mr_packet_header_t)),
+
+    .rx_guard  = MARI_RX_GUARD_TIME,
+    .rx_offset = MARI_TS_TX_OFFSET - MARI_RX_GUARD_TIME,
+    .rx_max    = (MARI_RX_GUARD_TIME * 2) + MARI_SLOT_TOA_WITH_PADDING(sizeof(mr_packet_header_t)),
+
+    .end_guard = MARI_END_GUARD_TIME,
+
+    .whole_slot = MARI_SHARED_UPLINK_SLOT_DURATION,
+};
+
 //=========================== prototypes =======================================
 
 static inline void set_slot_state(mr_mac_state_t state);
@@ -138,18 +164,21 @@ static void activity_rie1(void);
 static void activity_ri4(uint32_t ts);
 static void activity_rie2(void);
 
-static void fix_drift(uint32_t ts);
+static void     fix_drift(uint32_t ts);
+static uint32_t slot_duration_at(uint64_t asn);
 
 static void start_scan(void);
 static void end_scan(void);
 static void handle_scan_and_trigger_association(uint32_t now_ts);
 static void activity_scan_start_frame(uint32_t ts);
 static void activity_scan_end_frame(uint32_t ts);
+static void scan_next_channel(void);
 static bool sync_to_gateway(uint32_t now_ts, mr_channel_info_t *selected_gateway, uint32_t handover_time_correction_us);
 
 static void start_or_continue_background_scan(void);
 static void end_background_scan(void);
-static void handle_bg_scan_and_trigger_handover(uint32_t now_ts);
+static bool select_gateway_for_handover(uint32_t now_ts, mr_channel_info_t *selected_gateway);
+static void trigger_handover(uint32_t now_ts, mr_channel_info_t *selected_gateway);
 
 static void isr_mac_radio_start_frame(uint32_t ts);
 static void isr_mac_radio_end_frame(uint32_t ts);
@@ -196,6 +225,14 @@ uint64_t mr_mac_get_asn(void) {
     return mac_vars.asn;
 }
 
+uint32_t mr_mac_get_rx_ts(void) {
+    return mac_vars.received_packet.start_ts;
+}
+
+uint8_t mr_mac_get_channel(void) {
+    return mac_vars.current_slot_info.channel;
+}
+
 uint32_t mr_mac_get_tiner_value(void) {
     return mr_timer_hf_now(MARI_TIMER_DEV);
 }
@@ -216,6 +253,23 @@ inline bool mr_mac_node_is_synced(void) {
     return mac_vars.synced_gateway != 0;
 }
 
+const mr_slot_durations_t *mr_mac_get_slot_durations(slot_type_t slot_type) {
+    switch (slot_type) {
+        case SLOT_TYPE_BEACON:
+            return &slot_durations_beacon;
+        case SLOT_TYPE_SHARED_UPLINK:
+            return &slot_durations_shared_uplink;
+        default:
+            return &slot_durations;
+    }
+}
+
+void mr_mac_set_beacon_length(size_t length) {
+    slot_durations_beacon.tx_max     = MARI_SLOT_TOA_WITH_PADDING(length);
+    slot_durations_beacon.rx_max     = (MARI_RX_GUARD_TIME * 2) + MARI_SLOT_TOA_WITH_PADDING(length);
+    slot_durations_beacon.whole_slot = MARI_BEACON_SLOT_DURATION_OF(length);
+}
+
 //=========================== private ==========================================
 
 static void set_slot_state(mr_mac_state_t state) {
@@ -247,6 +301,8 @@ static void new_slot_synced(void) {
     if (mari_get_node_type() == MARI_GATEWAY) {
         // too long without receiving a packet from certain nodes? disconnect them
         mr_assoc_gateway_clear_old_nodes(mac_vars.asn);
+        // follow the load: switch to a smaller or larger schedule
+        mr_scheduler_gateway_adapt_schedule(mac_vars.asn);
     } else if (mari_get_node_type() == MARI_NODE) {
         if (mr_assoc_node_should_leave(mac_vars.asn)) {
             // assoc module determined that the node should leave, so disconnect and back to scanning
@@ -271,6 +327,13 @@ static void new_slot_synced(void) {
     }
 
     mac_vars.current_slot_info = mr_scheduler_tick(mac_vars.asn++);
+    mac_vars.current_durations = mr_mac_get_slot_durations(mac_vars.current_slot_info.type);
+
+    // the inter-slot timer ticks every whole slot, so shorten this one to the duration of its type
+    mr_timer_hf_adjust_periodic_us(
+        MARI_TIMER_DEV,
+        MARI_TIMER_INTER_SLOT_CHANNEL,
+        (int32_t)mac_vars.current_durations->whole_slot - (int32_t)slot_durations.whole_slot);
 
     if (mac_vars.current_slot_info.radio_action == MARI_RADIO_ACTION_TX) {
         activity_ti1();
@@ -289,14 +352,12 @@ static void new_slot_synced(void) {
 }
 
 static void node_clear_synced_info(void) {
-    mac_vars.synced_gateway               = 0;
-    mac_vars.synced_network_id            = 0;
-    mac_vars.synced_ts                    = 0;
-    mac_vars.asn                          = 0;
-    mac_vars.is_scanning                  = false;
-    mac_vars.is_bg_scanning               = false;
-    mac_vars.full_bg_scan_started_ts      = 0;
-    mac_vars.full_bg_scan_expected_end_ts = 0;
+    mac_vars.synced_gateway    = 0;
+    mac_vars.synced_network_id = 0;
+    mac_vars.synced_ts         = 0;
+    mac_vars.asn               = 0;
+    mac_vars.is_scanning       = false;
+    mac_vars.is_bg_scanning    = false;
 }
 
 static void node_back_to_scanning(void) {
@@ -316,6 +377,7 @@ static void end_slot(void) {
 
 static void disable_radio_and_intra_slot_timers(void) {
     mr_radio_disable();
+    mr_queue_release_packet();  // the radio no longer reads the packet sent in this slot, if any
 
     // NOTE: clean all timers
     mr_timer_hf_cancel(MARI_TIMER_DEV, MARI_TIMER_CHANNEL_1);
@@ -344,11 +406,8 @@ static void start_scan(void) {
 
     set_slot_state(STATE_RX_DATA_LISTEN);
     mr_radio_disable();
-#ifdef MARI_FIXED_SCAN_CHANNEL
-    mr_radio_set_channel(MARI_FIXED_SCAN_CHANNEL);  // not doing channel hopping for now
-#else
-    puts("Channel hopping not implemented yet for scanning");
-#endif
+    scan_next_channel();  // each scan starts on another channel, in case a gateway always beacons on the same one
+    mr_radio_set_channel(mac_vars.scan_channel);
     mr_radio_rx();
 }
 
@@ -367,20 +426,16 @@ static void end_scan(void) {
 
 static void start_or_continue_background_scan(void) {
     // 1. prepare timestamps and and arm timer
+    uint32_t bg_scan_duration = MARI_BG_SCAN_DURATION(mac_vars.current_durations->whole_slot);
     if (!mac_vars.is_bg_scanning) {
         mac_vars.scan_started_ts      = mac_vars.start_slot_ts;  // reuse the slot start time as reference
-        mac_vars.scan_expected_end_ts = mac_vars.scan_started_ts + MARI_BG_SCAN_DURATION;
-    }
-
-    if (mac_vars.full_bg_scan_started_ts == 0) {
-        mac_vars.full_bg_scan_started_ts      = mac_vars.start_slot_ts;  // reuse the slot start time as reference
-        uint32_t handover_full_scan_duration  = mr_scheduler_get_duration_us();
-        mac_vars.full_bg_scan_expected_end_ts = mac_vars.full_bg_scan_started_ts + handover_full_scan_duration;
+        mac_vars.scan_expected_end_ts = mac_vars.scan_started_ts + bg_scan_duration;
+        scan_next_channel();
     }
 
     // check and save whether the next slot is a potential sleep slot
     cell_t next_slot                  = mr_scheduler_node_peek_slot(mac_vars.asn);  // remember: the asn was already incremented at new_slot_synced
-    bool   next_uplink_is_sleep_slot  = next_slot.type == SLOT_TYPE_UPLINK && next_slot.assigned_node_id != mr_device_id();
+    bool   next_uplink_is_sleep_slot  = next_slot.type == SLOT_TYPE_UPLINK && !mr_scheduler_node_owns_slot(mac_vars.asn);
     bool   next_slot_is_shared_uplink = next_slot.type == SLOT_TYPE_SHARED_UPLINK;
     mac_vars.bg_scan_sleep_next_slot  = next_uplink_is_sleep_slot || next_slot_is_shared_uplink;
 
@@ -389,18 +444,14 @@ static void start_or_continue_background_scan(void) {
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_1,    // remember that the inter-slot timer is already being used for the slot
         mac_vars.start_slot_ts,  // in this case, we use the slot start time as reference because we are synced
-        MARI_BG_SCAN_DURATION,   // scan for some time during this slot
+        bg_scan_duration,        // scan for some time during this slot
         &end_background_scan);
 
     // 2. turn on the radio, in case it was off (bg scan might be already running since the last slot)
     if (!mac_vars.is_bg_scanning) {
         set_slot_state(STATE_RX_DATA_LISTEN);
         mr_radio_disable();
-#ifdef MARI_FIXED_SCAN_CHANNEL
-        mr_radio_set_channel(MARI_FIXED_SCAN_CHANNEL);  // not doing channel hopping for now
-#else
-        puts("Channel hopping not implemented yet for scanning");
-#endif
+        mr_radio_set_channel(mac_vars.scan_channel);
         mr_radio_rx();
     }
     mac_vars.is_bg_scanning = true;
@@ -409,21 +460,21 @@ static void start_or_continue_background_scan(void) {
 static void end_background_scan(void) {
     uint32_t now_ts = mr_timer_hf_now(MARI_TIMER_DEV);
 
-    if (!mac_vars.bg_scan_sleep_next_slot) {
-        // if next slot is not sleep, stop the background scan and check if there is an alternative gateway to join
+    // the scan list keeps the last beacon of every gateway heard, so a better one is handed over to right away
+    mr_channel_info_t selected_gateway = { 0 };
+    bool              handover         = select_gateway_for_handover(now_ts, &selected_gateway);
+
+    if (!mac_vars.bg_scan_sleep_next_slot || handover) {
+        // if next slot is not sleep, or the node is leaving, stop the background scan
         mac_vars.is_bg_scanning = false;
         set_slot_state(STATE_SLEEP);
         disable_radio_and_intra_slot_timers();
+    }
+    // otherwise, the background scan will continue through the next slot
 
-        if (now_ts > mac_vars.full_bg_scan_expected_end_ts) {
-            // the full handover scan is over, so handle the scan results and may trigger a handover
-            handle_bg_scan_and_trigger_handover(now_ts);
-            // independent of whether a handover was triggered, reset the full handover scan timestamps
-            mac_vars.full_bg_scan_started_ts      = 0;
-            mac_vars.full_bg_scan_expected_end_ts = 0;
-        }
+    if (handover) {
+        trigger_handover(now_ts, &selected_gateway);
     }
-    // otherwise, do nothing, and the background scan will continue through the next slot
 }
 
 // --------------------- tx activities --------------------
@@ -434,10 +485,10 @@ static void activity_ti1(void) {
     set_slot_state(STATE_TX_OFFSET);
 
     // before arming the timers, check if there is a packet to send
-    uint8_t packet[MARI_PACKET_MAX_SIZE];
-    uint8_t packet_len = mr_queue_next_packet(mac_vars.current_slot_info.type, packet);
+    uint8_t  packet_len;
+    uint8_t *packet = mr_queue_next_packet(mac_vars.current_slot_info.type, &packet_len);
 
-    if (packet_len == 0) {
+    if (packet == NULL) {
         // nothing to tx
         mr_scheduler_stats_register_used_slot(false);
 
@@ -459,20 +510,20 @@ static void activity_ti1(void) {
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_1,
         mac_vars.start_slot_ts,
-        slot_durations.tx_offset,
+        mac_vars.current_durations->tx_offset,
         &activity_ti2);
 
     mr_timer_hf_set_oneshot_with_ref_diff_us(
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_2,
         mac_vars.start_slot_ts,
-        slot_durations.tx_offset + slot_durations.tx_max,
+        mac_vars.current_durations->tx_offset + mac_vars.current_durations->tx_max,
         &activity_tie1);
 
     // prepare the radio for tx
     mr_radio_disable();
     mr_radio_set_channel(mac_vars.current_slot_info.channel);
-    mr_radio_tx_prepare(packet, packet_len);
+    mr_radio_tx_prepare_in_place(packet, packet_len);  // the radio reads the queued buffer, until it is disabled
 }
 
 static void activity_ti2(void) {
@@ -516,21 +567,21 @@ static void activity_ri1(void) {
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_1,
         mac_vars.start_slot_ts,
-        slot_durations.rx_offset,
+        mac_vars.current_durations->rx_offset,
         &activity_ri2);
 
     mr_timer_hf_set_oneshot_with_ref_diff_us(
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_2,
         mac_vars.start_slot_ts,
-        slot_durations.tx_offset + slot_durations.rx_guard,
+        mac_vars.current_durations->tx_offset + mac_vars.current_durations->rx_guard,
         &activity_rie1);
 
     mr_timer_hf_set_oneshot_with_ref_diff_us(
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_3,
         mac_vars.start_slot_ts,
-        slot_durations.rx_offset + slot_durations.rx_max,
+        mac_vars.current_durations->rx_offset + mac_vars.current_durations->rx_max,
         &activity_rie2);
 }
 
@@ -584,17 +635,20 @@ static void activity_ri4(uint32_t ts) {
         return;
     }
 
-    mr_radio_get_rx_packet(mac_vars.received_packet.packet, &mac_vars.received_packet.packet_len);
+    // the packet is handled in place, before the radio is enabled again
+    mac_vars.received_packet.packet = mr_radio_get_rx_packet_in_place(&mac_vars.received_packet.packet_len);
 
     mr_packet_header_t *header = (mr_packet_header_t *)mac_vars.received_packet.packet;
 
-    if (header->version != MARI_PROTOCOL_VERSION) {
+    // the version byte also tells whether the header is a compact one
+    if ((header->version & MARI_HEADER_VERSION_MASK) != MARI_PROTOCOL_VERSION) {
         end_slot();
         return;
     }
 
-    if (mari_get_node_type() == MARI_NODE && mr_assoc_is_joined() && header->src == mac_vars.synced_gateway) {
-        // only fix drift if the packet comes from the gateway we are synced to
+    bool from_synced_gateway = mari_get_node_type() == MARI_NODE && mr_assoc_get_state() >= JOIN_STATE_SYNCED && mr_packet_is_from_gateway(mac_vars.received_packet.packet, mac_vars.synced_gateway);
+    if (from_synced_gateway) {
+        // only fix drift if the packet comes from the gateway we are synced to, already while joining, as joining can take a few slotframes
         // NOTE: this should ideally be done at ri3 (when the packet starts), but we don't have the id there.
         //       could use use the physical BLE address for that?
         fix_drift(mac_vars.received_packet.start_ts);
@@ -605,8 +659,14 @@ static void activity_ri4(uint32_t ts) {
     mac_vars.received_packet.rssi    = mr_radio_rssi();
     mac_vars.received_packet.end_ts  = ts;
     mac_vars.received_packet.asn     = mac_vars.asn;
+    if (from_synced_gateway) {
+        // the synced gateway is not in the background scans, its link estimate comes from every frame it sends
+        mr_scan_link_received(mac_vars.synced_gateway, mac_vars.received_packet.rssi, mac_vars.start_slot_ts);
+    }
 
-    header->stats.rssi = mr_radio_rssi();
+    if (!(header->version & MARI_HEADER_COMPACT)) {
+        header->stats.rssi = mr_radio_rssi();  // compact headers get it when they are expanded
+    }
 
     mr_handle_packet(mac_vars.received_packet.packet, mac_vars.received_packet.packet_len);
 
@@ -623,9 +683,8 @@ static void activity_rie2(void) {
 
 static void fix_drift(uint32_t ts) {
     DEBUG_GPIO_SPIIKE(&pin1);
-    uint32_t time_cpu_periph = 59;  // got this value by looking at the logic analyzer
 
-    uint32_t expected_ts     = mac_vars.start_slot_ts + slot_durations.tx_offset + time_cpu_periph;
+    uint32_t expected_ts     = mac_vars.start_slot_ts + slot_durations.tx_offset + MARI_TS_FRAME_START_DELAY;
     int32_t  clock_drift     = ts - expected_ts;
     uint32_t abs_clock_drift = abs(clock_drift);
 
@@ -639,8 +698,10 @@ static void fix_drift(uint32_t ts) {
     } else {
         // drift is too high, need to re-sync
         // FIXME: use `mr_assoc_node_handle_immediate_disconnect` instead
-        mr_event_data_t event_data = { .data.gateway_info.gateway_id = mac_vars.synced_gateway, .tag = MARI_OUT_OF_SYNC };
-        mac_vars.mari_event_callback(MARI_DISCONNECTED, event_data);
+        if (mr_assoc_is_joined()) {
+            mr_event_data_t event_data = { .data.gateway_info.gateway_id = mac_vars.synced_gateway, .tag = MARI_OUT_OF_SYNC };
+            mac_vars.mari_event_callback(MARI_DISCONNECTED, event_data);
+        }
         mr_assoc_set_state(JOIN_STATE_IDLE);
         set_slot_state(STATE_SLEEP);
         end_slot();
@@ -648,10 +709,21 @@ static void fix_drift(uint32_t ts) {
     }
 }
 
+// duration of the slot at an asn of the active schedule
+static uint32_t slot_duration_at(uint64_t asn) {
+    return mr_mac_get_slot_durations((slot_type_t)mr_scheduler_node_peek_slot(asn).type)->whole_slot;
+}
+
 // --------------------- handover --------------------
 
 static bool select_gateway_for_handover(uint32_t now_ts, mr_channel_info_t *selected_gateway) {
-    if (!mr_scan_select(selected_gateway, mac_vars.scan_started_ts, now_ts)) {
+    if (now_ts - mac_vars.synced_ts < MARI_HANDOVER_MIN_INTERVAL) {
+        // just recently performed a synchronization, will not try again so soon
+        return false;
+    }
+
+    // readings from any earlier background scan count, as long as they are recent enough
+    if (!mr_scan_select(selected_gateway, 0, now_ts)) {
         // no gateway found, do nothing
         return false;
     }
@@ -661,27 +733,23 @@ static bool select_gateway_for_handover(uint32_t now_ts, mr_channel_info_t *sele
         return false;
     }
 
-    if (selected_gateway->rssi < (mac_vars.received_packet.rssi + MARI_HANDOVER_RSSI_HYSTERESIS)) {
-        // the new gateway is not strong enough, ignore it
+    // the rssi of the selected gateway is its link estimate too
+    if (selected_gateway->rssi < mr_scan_link_quality(mac_vars.synced_gateway) + MARI_HANDOVER_HYSTERESIS) {
+        // the new gateway is not better by enough, ignore it
         return false;
     }
 
-    // FIXME: have this be the first condition to be checked; I put it here just for debugging
-    if (now_ts - mac_vars.synced_ts < MARI_HANDOVER_MIN_INTERVAL) {
-        // just recently performed a synchronization, will not try again so soon
+    // the sync walks the slots of the schedule in the beacon, which the gateway may have switched since (adaptive schedule):
+    // only trust a beacon from the last slotframe, the next background scans hear a newer one
+    uint32_t slotframe_duration = mr_scheduler_get_schedule_duration_us(selected_gateway->beacon.active_schedule_id);
+    if (now_ts - selected_gateway->timestamp > slotframe_duration) {
         return false;
     }
 
     return true;
 }
 
-static void handle_bg_scan_and_trigger_handover(uint32_t now_ts) {
-    mr_channel_info_t selected_gateway = { 0 };
-    if (!select_gateway_for_handover(now_ts, &selected_gateway)) {
-        // no handover, stop here
-        return;
-    }
-
+static void trigger_handover(uint32_t now_ts, mr_channel_info_t *selected_gateway) {
     // debug: show that a handover is going to happen
     DEBUG_GPIO_SET(&pin3);
     DEBUG_GPIO_CLEAR(&pin3);
@@ -695,8 +763,7 @@ static void handle_bg_scan_and_trigger_handover(uint32_t now_ts) {
         slot_durations.whole_slot << 4,  // 16 slots in the future
         &new_slot_synced);
 
-    uint32_t handover_time_correction_us = 206;  // magic number: measured using the logic analyzer
-    if (sync_to_gateway(now_ts, &selected_gateway, handover_time_correction_us)) {
+    if (sync_to_gateway(now_ts, selected_gateway, MARI_HANDOVER_TIME_CORRECTION)) {
         // found a gateway and synchronized to it
         mr_assoc_node_handle_synced();
     } else {
@@ -732,6 +799,11 @@ static void activity_scan_dispatch_new_schedule(void) {
         MARI_TIMER_INTER_SLOT_CHANNEL,
         slot_durations.whole_slot,
         &new_slot_synced);
+    // the slot starting now may be a short one, as in new_slot_synced
+    mr_timer_hf_adjust_periodic_us(
+        MARI_TIMER_DEV,
+        MARI_TIMER_INTER_SLOT_CHANNEL,
+        (int32_t)slot_duration_at(mac_vars.asn - 1) - (int32_t)slot_durations.whole_slot);
 }
 
 static bool sync_to_gateway(uint32_t now_ts, mr_channel_info_t *selected_gateway, uint32_t handover_time_correction_us) {
@@ -744,31 +816,36 @@ static bool sync_to_gateway(uint32_t now_ts, mr_channel_info_t *selected_gateway
     mac_vars.synced_network_id = selected_gateway->beacon.network_id;
     mac_vars.synced_ts         = now_ts;
 
-    // the selected gateway may have been scanned a few slot_durations ago, so we need to account for that difference
-    // NOTE: this assumes that the slot duration is the same for gateways and nodes
-    uint32_t time_since_beacon      = now_ts - selected_gateway->timestamp;
-    uint64_t asn_count_since_beacon = (time_since_beacon / slot_durations.whole_slot) + 1;  // +1 because we are inside the current slot
-    uint64_t time_into_gateway_slot = time_since_beacon % slot_durations.whole_slot;
+    // the selected gateway may have been scanned a few slots ago, so we need to account for that difference
+    // NOTE: this assumes that the slot durations are the same for gateways and nodes
+    // the slot of the beacon started before its frame, and the cpu keeps running until the timer is set: count both as elapsed
+    uint32_t time_cpu_and_toa       = MARI_SYNC_TIME_CORRECTION + handover_time_correction_us;
+    uint32_t time_since_beacon_slot = now_ts - selected_gateway->timestamp + time_cpu_and_toa;
+
+    // walk the slots since the one of the beacon, which the gateway had already counted in the asn of the beacon
+    uint32_t slotframe_duration     = mr_scheduler_get_duration_us();
+    uint64_t asn                    = selected_gateway->beacon.asn - 1 + (uint64_t)(time_since_beacon_slot / slotframe_duration) * mr_scheduler_get_active_schedule_slot_count();
+    uint32_t time_into_gateway_slot = time_since_beacon_slot % slotframe_duration;
+    while (time_into_gateway_slot >= slot_duration_at(asn)) {
+        time_into_gateway_slot -= slot_duration_at(asn);
+        asn++;
+    }
 
-    uint64_t time_to_skip_one_slot = 0;
-    if (time_into_gateway_slot > slot_durations.whole_slot / 2) {
+    uint32_t time_to_next_slot = slot_duration_at(asn) - time_into_gateway_slot;
+    if (time_to_next_slot < slot_durations.whole_slot / 2) {
         // too close to the next slot, skip this one
-        asn_count_since_beacon++;
-        time_to_skip_one_slot = slot_durations.whole_slot;
+        asn++;
+        time_to_next_slot += slot_duration_at(asn);
     }
 
-    uint64_t time_cpu_and_toa = 541;  // magic number: measured using the logic analyzer
-    time_cpu_and_toa += handover_time_correction_us;
-
-    uint32_t time_dispatch_new_schedule = ((slot_durations.whole_slot - time_into_gateway_slot) + time_to_skip_one_slot) - time_cpu_and_toa;
     mr_timer_hf_set_oneshot_us(
         MARI_TIMER_DEV,
         MARI_TIMER_CHANNEL_1,
-        time_dispatch_new_schedule,
+        time_to_next_slot,
         &activity_scan_dispatch_new_schedule);
 
-    // set the asn to match the gateway's
-    mac_vars.asn = selected_gateway->beacon.asn + asn_count_since_beacon;
+    // set the asn to match the gateway's: the dispatch starts the slot after asn, and the first tick the one after that
+    mac_vars.asn = asn + 2;
 
     return true;
 }
@@ -781,11 +858,26 @@ static void activity_scan_start_frame(uint32_t ts) {
 }
 
 static void activity_scan_end_frame(uint32_t end_frame_ts) {
-    uint8_t packet[MARI_PACKET_MAX_SIZE];
-    uint8_t packet_len;
-    mr_radio_get_rx_packet(packet, &packet_len);
+    uint8_t  packet_len;
+    uint8_t *packet = mr_radio_get_rx_packet_in_place(&packet_len);
 
-    mr_assoc_handle_beacon(packet, packet_len, MARI_FIXED_SCAN_CHANNEL, mac_vars.current_scan_item_ts);
+    mr_assoc_handle_beacon(packet, packet_len, mac_vars.scan_channel, mac_vars.current_scan_item_ts);
+
+    // the radio is disabled at the end of the frame, move to the channel of the next beacon of this gateway
+    scan_next_channel();
+    mr_radio_set_channel(mac_vars.scan_channel);
+
+    if (mac_vars.is_scanning && mr_scan_can_end_early(mac_vars.scan_started_ts, end_frame_ts)) {
+        // a gateway is good enough, end the scan now rather than at scan_expected_end_ts
+        set_slot_state(STATE_SLEEP);
+        mr_timer_hf_set_oneshot_with_ref_us(
+            MARI_TIMER_DEV,
+            MARI_TIMER_INTER_SLOT_CHANNEL,
+            end_frame_ts,
+            20,  // same as below, the radio is still turning off
+            &end_scan);
+        return;
+    }
 
     // if there is still enough time before end of scan, re-enable the radio
     bool still_time_for_rx_scan    = mac_vars.is_scanning && (end_frame_ts + MARI_BEACON_TOA_WITH_PADDING < mac_vars.scan_expected_end_ts);
@@ -806,6 +898,18 @@ static void activity_scan_end_frame(uint32_t end_frame_ts) {
     }
 }
 
+// gateways send each beacon on the next advertising channel (see mr_scheduler_get_channel), so the scan moves the same way
+static void scan_next_channel(void) {
+#ifdef MARI_FIXED_SCAN_CHANNEL
+    mac_vars.scan_channel = MARI_FIXED_SCAN_CHANNEL;
+#else
+    mac_vars.scan_channel++;
+    if (mac_vars.scan_channel < MARI_N_BLE_REGULAR_CHANNELS || mac_vars.scan_channel >= MARI_N_BLE_REGULAR_CHANNELS + MARI_N_BLE_ADVERTISING_CHANNELS) {
+        mac_vars.scan_channel = MARI_N_BLE_REGULAR_CHANNELS;
+    }
+#endif
+}
+
 // --------------------- tx/rx activities ------------
 
 // --------------------- radio ---------------------
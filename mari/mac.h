@@ -38,20 +38,37 @@
 #define MARI_END_GUARD_TIME          (MARI_RX_GUARD_TIME + 100)                          // Added 40 us based on measurements witn nRF52 and nRF53
 #define MARI_PACKET_TOA              (BLE_2M_US_PER_BYTE * MARI_BLE_PAYLOAD_MAX_LENGTH)  // Time on air for the maximum payload.
 #define MARI_PACKET_TOA_WITH_PADDING (MARI_PACKET_TOA + 120)                             // Add padding based on experiments. Also, it takes 28 us until event ADDRESS is triggered (when the packet actually starts traveling over the air)
+#define MARI_TS_FRAME_START_DELAY    (59)                                                // From the start of TX, after MARI_TS_TX_OFFSET, to the start of frame at the receiver. Measured with the logic analyzer
+
+// Synchronization to a scanned gateway: time from the start of a slot to the timestamp of its frame at the receiver, plus
+// the CPU time until the new schedule is dispatched, and more of it in a handover. Measured with the logic analyzer on the
+// nRF52840 and nRF5340; a platform where the CPU takes no time, such as the simulator, sets them from the radio timings alone.
+#ifndef MARI_SYNC_TIME_CORRECTION
+#define MARI_SYNC_TIME_CORRECTION (541)
+#endif
+#ifndef MARI_HANDOVER_TIME_CORRECTION
+#define MARI_HANDOVER_TIME_CORRECTION (206)
+#endif
 
 // Duration of some packets
 #define MARI_BEACON_TOA              (BLE_2M_US_PER_BYTE * sizeof(mr_beacon_packet_header_t))  // Time on air for the beacon packet
 #define MARI_BEACON_TOA_WITH_PADDING (MARI_BEACON_TOA + 60)                                    // Add padding based on experiments.
 
-#define MARI_WHOLE_SLOT_DURATION (MARI_TS_TX_OFFSET + MARI_PACKET_TOA_WITH_PADDING + MARI_END_GUARD_TIME)  // Complete slot duration
+#define MARI_WHOLE_SLOT_DURATION (MARI_TS_TX_OFFSET + MARI_PACKET_TOA_WITH_PADDING + MARI_END_GUARD_TIME)  // Complete slot duration, of the uplink and downlink slots
+
+// Slots that only ever carry a beacon, or a join request, are sized for it
+#define MARI_SLOT_TOA_WITH_PADDING(length)   (BLE_2M_US_PER_BYTE * (length) + (MARI_PACKET_TOA_WITH_PADDING - MARI_PACKET_TOA))  // Same padding as the full packet
+#define MARI_BEACON_SLOT_DURATION_OF(length) (MARI_TS_TX_OFFSET + MARI_SLOT_TOA_WITH_PADDING(length) + MARI_END_GUARD_TIME)  // For beacons of this length
+#define MARI_BEACON_SLOT_DURATION            MARI_BEACON_SLOT_DURATION_OF(sizeof(mr_beacon_packet_header_t))
+#define MARI_SHARED_UPLINK_SLOT_DURATION     (MARI_TS_TX_OFFSET + MARI_SLOT_TOA_WITH_PADDING(sizeof(mr_packet_header_t)) + MARI_END_GUARD_TIME)
 
 #define MARI_MAX_TIME_NO_RX_DESYNC (MARI_WHOLE_SLOT_DURATION * MARI_SCAN_MAX_SLOTS)  // us, arbitrary value for now
 
 // default scan duration in us
-#define MARI_SCAN_MAX_SLOTS    (MARI_N_CELLS_MAX)                                // how many slots to scan for. should probably be the size of the largest schedule
+#define MARI_SCAN_MAX_SLOTS    (mr_scheduler_get_max_slot_count())               // how many slots to scan for: the size of the largest available schedule
 #define MARI_SCAN_MAX_DURATION (MARI_SCAN_MAX_SLOTS * MARI_WHOLE_SLOT_DURATION)  // how many slots to scan for. should probably be the size of the largest schedule
 
-#define MARI_BG_SCAN_DURATION (MARI_WHOLE_SLOT_DURATION - (MARI_END_GUARD_TIME * 2))
+#define MARI_BG_SCAN_DURATION(whole_slot) ((whole_slot) - (MARI_END_GUARD_TIME * 2))  // within a slot of the given duration
 
 #define MARI_MAX_SLOTFRAMES_NO_RX_LEAVE (5)  // how many slotframes to wait before leaving the network if nothing is received
 
@@ -73,7 +90,7 @@ typedef struct {
 
 //=========================== variables ========================================
 
-extern mr_slot_durations_t slot_durations;
+extern mr_slot_durations_t slot_durations;  ///< Uplink and downlink slots, see mr_mac_get_slot_durations for the others
 
 //=========================== prototypes ==========================================
 
@@ -82,7 +99,21 @@ uint64_t mr_mac_get_synced_ts(void);
 uint64_t mr_mac_get_synced_gateway(void);
 uint16_t mr_mac_get_synced_network_id(void);
 uint64_t mr_mac_get_asn(void);
+uint8_t  mr_mac_get_channel(void);
+uint32_t mr_mac_get_rx_ts(void);
 uint32_t mr_mac_get_tiner_value(void);
 bool     mr_mac_node_is_synced(void);
 
+/**
+ * @brief Returns the intra-slot durations of a slot type.
+ *
+ * Beacon and shared uplink slots are shorter than the uplink and downlink slots, as they only carry a beacon or a join request.
+ */
+const mr_slot_durations_t *mr_mac_get_slot_durations(slot_type_t slot_type);
+
+/**
+ * @brief Sizes the beacon slots for the longest beacon of the active schedule, at most a mr_beacon_packet_header_t.
+ */
+void mr_mac_set_beacon_length(size_t length);
+
 #endif  // __MAC_H
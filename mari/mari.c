@@ -15,6 +15,7 @@
 #include <string.h>
 
 #include "mr_device.h"
+#include "mr_radio.h"
 #include "mr_rng.h"
 #include "mr_timer_hf.h"
 #include "models.h"
@@ -41,13 +42,17 @@ static mari_vars_t _mari_vars = { 0 };
 
 static void event_callback(mr_event_t event, mr_event_data_t event_data);
 static void mr_mari_force_gateway_startup_random_delay(void);
+static bool _expand_header(const uint8_t *packet, mr_packet_header_t *header);
+static void _deaggregate(const mr_packet_header_t *header, uint8_t *payload, uint8_t payload_len);
+static void _pick_records(const mr_packet_header_t *header, uint8_t *payload, uint8_t payload_len);
+static void _deliver(const mr_packet_header_t *header, uint64_t dst, uint8_t *payload, uint8_t payload_len);
 
 //=========================== public ===========================================
 // in this library, user-facing functions begin with mari_*, while internal functions begin with mr_*
 
 // -------- common --------
 
-void mari_init(mr_node_type_t node_type, uint16_t net_id, schedule_t *app_schedule, mr_event_cb_t app_event_callback) {
+void mari_init(mr_node_type_t node_type, uint16_t net_id, const schedule_t *app_schedule, mr_event_cb_t app_event_callback) {
     _mari_vars.node_type          = node_type;
     _mari_vars.app_event_callback = app_event_callback;
 
@@ -56,10 +61,13 @@ void mari_init(mr_node_type_t node_type, uint16_t net_id, schedule_t *app_schedu
     mr_rng_init();
 
     // initialize stateful mari modules
+    mr_queue_init(event_callback);
     mr_assoc_init(net_id, event_callback);
     mr_scheduler_init(app_schedule);
     if (node_type == MARI_GATEWAY) {
         mr_bloom_gateway_init();
+    } else {
+        mr_bloom_node_init();
     }
 
     if (node_type == MARI_GATEWAY) {
@@ -70,8 +78,27 @@ void mari_init(mr_node_type_t node_type, uint16_t net_id, schedule_t *app_schedu
     mr_mac_init(event_callback);
 }
 
-void mari_tx(uint8_t *packet, uint8_t length) {
-    mr_queue_add(packet, length);
+// returns false if the transmit queue is full, see MARI_TX_QUEUE_HIGH to throttle before that
+bool mari_tx(uint8_t *packet, uint8_t length) {
+    return mr_queue_add(packet, length);
+}
+
+// where to write the payload of the next packet, NULL if the transmit queue is full
+// the buffer goes as is to the radio, so the payload is not copied again
+// at most MARI_PAYLOAD_MAX_SIZE bytes: the buffer is one of a pool, and writing more overruns the next one
+uint8_t *mari_tx_buffer(void) {
+    uint8_t *buffer = mr_queue_get_buffer();
+    return buffer ? buffer + sizeof(mr_packet_header_t) : NULL;
+}
+
+// sends the payload written in mari_tx_buffer, returns false like mari_tx
+bool mari_tx_commit(uint64_t dst, uint8_t payload_len) {
+    uint8_t *buffer = mr_queue_get_buffer();
+    if (buffer == NULL || payload_len > MARI_PAYLOAD_MAX_SIZE) {
+        return false;
+    }
+    size_t header_len = mr_build_packet_data_header(buffer, dst);
+    return mr_queue_commit(header_len + payload_len);
 }
 
 mr_node_type_t mari_get_node_type(void) {
@@ -94,10 +121,16 @@ size_t mari_gateway_count_nodes(void) {
 
 // -------- node ----------
 
-void mari_node_tx_payload(uint8_t *payload, uint8_t payload_len) {
-    uint8_t packet[MARI_PACKET_MAX_SIZE] = { 0 };
-    uint8_t len                          = mr_build_packet_data(packet, mari_node_gateway_id(), payload, payload_len);
-    mr_queue_add(packet, len);
+bool mari_node_tx_payload(uint8_t *payload, uint8_t payload_len) {
+    if (payload_len > MARI_PAYLOAD_MAX_SIZE) {
+        return false;  // check before the copy, it would not fit in the buffer
+    }
+    uint8_t *buffer = mari_tx_buffer();
+    if (buffer == NULL) {
+        return false;
+    }
+    memcpy(buffer, payload, payload_len);
+    return mari_tx_commit(mari_node_gateway_id(), payload_len);
 }
 
 bool mari_node_is_connected(void) {
@@ -110,6 +143,90 @@ uint64_t mari_node_gateway_id(void) {
 
 //=========================== iternal api =====================================
 
+// rebuilds the full header of a packet that begins with a compact one, from the short address and the gateway,
+// returns false if the packet is not between this device and its gateway or one of its nodes
+static bool _expand_header(const uint8_t *packet, mr_packet_header_t *header) {
+    const mr_packet_header_compact_t *compact      = (const mr_packet_header_compact_t *)packet;
+    bool                              from_gateway = compact->version & MARI_HEADER_FROM_GATEWAY;
+
+    *header = (mr_packet_header_t){
+        .version    = compact->version & MARI_HEADER_VERSION_MASK,
+        .type       = compact->type,
+        .network_id = compact->network_id,
+        .stats      = { .rssi = mr_radio_rssi() },
+    };
+
+    if (mari_get_node_type() == MARI_GATEWAY) {
+        if (from_gateway || compact->gateway != (uint16_t)mr_device_id()) {
+            return false;  // between another gateway and its nodes
+        }
+        header->dst = mr_device_id();
+        header->src = mr_scheduler_gateway_get_uplink_node(compact->short_address);
+        return header->src != 0;
+    }
+
+    uint64_t gateway_id = mr_mac_get_synced_gateway();
+    if (!from_gateway || compact->gateway != (uint16_t)gateway_id) {
+        return false;
+    }
+    header->src = gateway_id;
+    if (compact->short_address == MARI_SHORT_ADDRESS_BROADCAST) {
+        header->dst = MARI_BROADCAST_ADDRESS;
+    } else if (mr_scheduler_node_owns_uplink(compact->short_address)) {
+        header->dst = mr_device_id();
+    } else {
+        return false;  // to another node
+    }
+    return true;
+}
+
+// gateway: every payload of a MARI_PACKET_DATA_AGGREGATED, one after the other
+static void _deaggregate(const mr_packet_header_t *header, uint8_t *payload, uint8_t payload_len) {
+    size_t offset = 0;
+    while (offset < payload_len) {
+        uint8_t subframe_len = payload[offset++];
+        if (offset + subframe_len > payload_len) {
+            break;  // truncated
+        }
+        _deliver(header, header->dst, payload + offset, subframe_len);
+        offset += subframe_len;
+    }
+}
+
+// node: the records of a MARI_PACKET_DATA_MULTI_DST addressed to this node, by its uplink number
+static void _pick_records(const mr_packet_header_t *header, uint8_t *payload, uint8_t payload_len) {
+    size_t offset = 0;
+    while (offset + MARI_RECORD_HEADER_LEN <= payload_len) {
+        uint16_t short_dst;
+        memcpy(&short_dst, payload + offset, sizeof(uint16_t));
+        uint8_t record_len = payload[offset + sizeof(uint16_t)];
+        offset += MARI_RECORD_HEADER_LEN;
+        if (offset + record_len > payload_len) {
+            break;  // truncated
+        }
+        if (mr_scheduler_node_owns_uplink(short_dst)) {
+            _deliver(header, mr_device_id(), payload + offset, record_len);
+        }
+        offset += record_len;
+    }
+}
+
+// gives the application a data packet like any other: only the header is rebuilt, the payload stays in the received frame
+static void _deliver(const mr_packet_header_t *header, uint64_t dst, uint8_t *payload, uint8_t payload_len) {
+    mr_packet_header_t data_header = *header;
+    data_header.type               = MARI_PACKET_DATA;
+    data_header.dst                = dst;
+
+    mr_event_data_t event_data = {
+        .data.new_packet = {
+            .len         = sizeof(mr_packet_header_t) + payload_len,
+            .header      = &data_header,
+            .payload     = payload,
+            .payload_len = payload_len }
+    };
+    _mari_vars.app_event_callback(MARI_NEW_PACKET, event_data);
+}
+
 void mr_mari_force_gateway_startup_random_delay(void) {
     // in the gateway, defer the start of the MAC for a random time (between 0 and slotframe duration)
     // this is to avoid gateway-to-gateway mutual cancellation, in case all gateways start at the same time
@@ -122,7 +239,20 @@ void mr_mari_force_gateway_startup_random_delay(void) {
 }
 
 bool mr_handle_packet(uint8_t *packet, uint8_t length) {
-    mr_packet_header_t *header = (mr_packet_header_t *)packet;
+    mr_packet_header_t *header     = (mr_packet_header_t *)packet;
+    size_t              header_len = sizeof(mr_packet_header_t);
+    mr_packet_header_t  expanded;
+
+    bool compact = packet[0] & MARI_HEADER_COMPACT;
+    if (compact) {
+        if (length < sizeof(mr_packet_header_compact_t) || !_expand_header(packet, &expanded)) {
+            return false;
+        }
+        header     = &expanded;
+        header_len = sizeof(mr_packet_header_compact_t);
+    }
+    uint8_t *payload     = packet + header_len;
+    uint8_t  payload_len = length - header_len;
 
     bool wrong_destination = header->dst != mr_device_id() && header->dst != MARI_BROADCAST_ADDRESS;
     bool not_a_beacon      = header->type != MARI_PACKET_BEACON;
@@ -145,12 +275,16 @@ bool mr_handle_packet(uint8_t *packet, uint8_t length) {
                 // the asn-based keep-alive is also initialized
                 // the hashes h1 and h2 are also set
                 // NOTE: we accept re-joins because of possible collisions on the join response (downlink)
+                if (mr_scheduler_gateway_is_switching(mr_mac_get_asn())) {
+                    // the node will try again after the schedule switch
+                    return false;
+                }
                 int16_t cell_id = mr_scheduler_gateway_assign_next_available_uplink_cell(header->src, mr_mac_get_asn());
                 if (cell_id >= 0) {
-                    // at the packet level, max_nodes is limited to 256 (using uint8_t cell_id)
-                    mr_queue_set_join_response(header->src, (uint8_t)cell_id);
-                    // set the dirty flag that will trigger the event loop to compute the bloom filter
-                    mr_bloom_gateway_set_dirty();
+                    // compact headers from now on, if the node offered them
+                    bool compact_header = MARI_ENABLE_COMPACT_HEADER && (header->version & MARI_HEADER_COMPACT_OK);
+                    mr_scheduler_gateway_set_node_compact_header(header->src, compact_header);
+                    mr_queue_set_join_response(header->src, (uint16_t)cell_id, compact_header);
                     _mari_vars.app_event_callback(MARI_NODE_JOINED, (mr_event_data_t){ .data.node_info.node_id = header->src });
                 } else {
                     _mari_vars.app_event_callback(MARI_ERROR, (mr_event_data_t){ .tag = MARI_GATEWAY_FULL });
@@ -163,15 +297,30 @@ bool mr_handle_packet(uint8_t *packet, uint8_t length) {
                     // ignore packets from nodes that are not joined
                     return false;
                 }
-                // send the packet to the application
-                mr_event_data_t event_data = {
-                    .data.new_packet = {
-                        .len         = length,
-                        .header      = header,
-                        .payload     = packet + sizeof(mr_packet_header_t),
-                        .payload_len = length - sizeof(mr_packet_header_t) }
-                };
-                _mari_vars.app_event_callback(MARI_NEW_PACKET, event_data);
+                // send the packet to the application, which gets the full header right before the payload
+                if (compact) {
+                    _deliver(header, header->dst, payload, payload_len);
+                } else {
+                    mr_event_data_t event_data = {
+                        .data.new_packet = {
+                            .len         = length,
+                            .header      = header,
+                            .payload     = payload,
+                            .payload_len = payload_len }
+                    };
+                    _mari_vars.app_event_callback(MARI_NEW_PACKET, event_data);
+                }
+                mr_assoc_gateway_keep_node_alive(header->src, mr_mac_get_asn());  // keep track of when the last packet was received
+                break;
+            }
+            case MARI_PACKET_DATA_AGGREGATED:
+            {
+                if (!from_joined_node) {
+                    // ignore packets from nodes that are not joined
+                    return false;
+                }
+                // one MARI_NEW_PACKET per payload, as if the node had sent them one by one
+                _deaggregate(header, payload, payload_len);
                 mr_assoc_gateway_keep_node_alive(header->src, mr_mac_get_asn());  // keep track of when the last packet was received
                 break;
             }
@@ -202,7 +351,7 @@ bool mr_handle_packet(uint8_t *packet, uint8_t length) {
 
         switch (header->type) {
             case MARI_PACKET_BEACON:
-                mr_assoc_handle_beacon(packet, length, MARI_FIXED_SCAN_CHANNEL, mr_mac_get_asn());
+                mr_assoc_handle_beacon(packet, length, mr_mac_get_channel(), mr_mac_get_rx_ts());
                 break;
             case MARI_PACKET_JOIN_RESPONSE:
             {
@@ -214,10 +363,12 @@ bool mr_handle_packet(uint8_t *packet, uint8_t length) {
                     // ignore if not for me
                     return false;
                 }
-                // the first byte after the header contains the cell_id
-                uint8_t cell_id = packet[sizeof(mr_packet_header_t)];
+                // the two bytes after the header contain the cell_id
+                uint16_t cell_id;
+                memcpy(&cell_id, payload, sizeof(uint16_t));
                 if (mr_scheduler_node_assign_myself_to_cell(cell_id)) {
-                    mr_assoc_node_handle_joined(header->src);
+                    // compact headers from now on, if the gateway took them too
+                    mr_assoc_node_handle_joined(header->src, MARI_ENABLE_COMPACT_HEADER && (header->version & MARI_HEADER_COMPACT_OK));
                 } else {
                     _mari_vars.app_event_callback(MARI_ERROR, (mr_event_data_t){ 0 });
                 }
@@ -229,15 +380,30 @@ bool mr_handle_packet(uint8_t *packet, uint8_t length) {
                     // ignore data packets from other gateways
                     return false;
                 }
-                // send the packet to the application
-                mr_event_data_t event_data = {
-                    .data.new_packet = {
-                        .len         = length,
-                        .header      = header,
-                        .payload     = packet + sizeof(mr_packet_header_t),
-                        .payload_len = length - sizeof(mr_packet_header_t) }
-                };
-                _mari_vars.app_event_callback(MARI_NEW_PACKET, event_data);
+                // send the packet to the application, which gets the full header right before the payload
+                if (compact) {
+                    _deliver(header, header->dst, payload, payload_len);
+                } else {
+                    mr_event_data_t event_data = {
+                        .data.new_packet = {
+                            .len         = length,
+                            .header      = header,
+                            .payload     = payload,
+                            .payload_len = payload_len }
+                    };
+                    _mari_vars.app_event_callback(MARI_NEW_PACKET, event_data);
+                }
+                mr_assoc_node_keep_gateway_alive(mr_mac_get_asn());
+                break;
+            }
+            case MARI_PACKET_DATA_MULTI_DST:
+            {
+                if (!from_my_joined_gateway) {
+                    // ignore data packets from other gateways
+                    return false;
+                }
+                // the frame is broadcast, only the records to this node are given to the application
+                _pick_records(header, payload, payload_len);
                 mr_assoc_node_keep_gateway_alive(mr_mac_get_asn());
                 break;
             }
@@ -270,15 +436,6 @@ void mari_event_loop(void) {
 //=========================== callbacks ===========================================
 
 static void event_callback(mr_event_t event, mr_event_data_t event_data) {
-    // handle some events internally
-    switch (event) {
-        case MARI_NODE_LEFT:
-            mr_bloom_gateway_set_dirty();
-            break;
-        default:
-            break;
-    }
-
     // forward the event to the application callback
     if (_mari_vars.app_event_callback) {
         _mari_vars.app_event_callback(event, event_data);
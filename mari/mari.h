@@ -18,21 +18,24 @@
 
 //=========================== defines ==========================================
 
-#define MARI_MAX_NODES         101  // FIXME: find a way to sync with the pre-stored schedules
+#define MARI_MAX_NODES         MARI_N_UPLINKS_MAX  // no schedule, pre-stored or built, has more uplink cells
 #define MARI_BROADCAST_ADDRESS 0xFFFFFFFFFFFFFFFF
+#define MARI_PAYLOAD_MAX_SIZE  (MARI_PACKET_MAX_SIZE - sizeof(mr_packet_header_t))  // room left after the header, see mari_tx_buffer
 
 //=========================== prototypes ==========================================
 
-void           mari_init(mr_node_type_t node_type, uint16_t net_id, schedule_t *app_schedule, mr_event_cb_t app_event_callback);
+void           mari_init(mr_node_type_t node_type, uint16_t net_id, const schedule_t *app_schedule, mr_event_cb_t app_event_callback);
 void           mari_event_loop(void);
-void           mari_tx(uint8_t *packet, uint8_t length);
+bool           mari_tx(uint8_t *packet, uint8_t length);
+uint8_t       *mari_tx_buffer(void);  // room for MARI_PAYLOAD_MAX_SIZE bytes, no more
+bool           mari_tx_commit(uint64_t dst, uint8_t payload_len);
 mr_node_type_t mari_get_node_type(void);
 void           mari_set_node_type(mr_node_type_t node_type);
 
 size_t mari_gateway_get_nodes(uint64_t *nodes);
 size_t mari_gateway_count_nodes(void);
 
-void     mari_node_tx_payload(uint8_t *payload, uint8_t payload_len);
+bool     mari_node_tx_payload(uint8_t *payload, uint8_t payload_len);
 bool     mari_node_is_connected(void);
 uint64_t mari_node_gateway_id(void);
 
@@ -26,28 +26,53 @@
 #define MARI_N_BLE_ADVERTISING_CHANNELS 3
 
 // #ifndef MARI_FIXED_CHANNEL
-#define MARI_FIXED_CHANNEL      0   // to hardcode the channel, use a valid value other than 0
-#define MARI_FIXED_SCAN_CHANNEL 37  // to hardcode the channel, use a valid value other than 0
+#define MARI_FIXED_CHANNEL 0  // to hardcode the channel, use a valid value other than 0
+// #define MARI_FIXED_SCAN_CHANNEL 37  // to hardcode the channel of beacons and scans, otherwise they hop over 37, 38 and 39
 // #endif
 
+// The defaults fit the pre-stored schedules, the largest of which has 149 cells.
+// A gateway that builds larger schedules defines MARI_LARGE_SCHEDULES, and so must the nodes that follow them.
+// It costs about 23 KB more RAM in the scheduler, and 7 KB more flash for the pre-stored schedules.
+#ifdef MARI_LARGE_SCHEDULES
+#ifndef MARI_N_CELLS_MAX
+#define MARI_N_CELLS_MAX 1024
+#endif
+#ifndef MARI_N_UPLINKS_MAX
+#define MARI_N_UPLINKS_MAX 512  // uplink cells beyond this number are not used, each one costs about 40 bytes of RAM
+#endif
+#endif
+
+#ifndef MARI_N_CELLS_MAX
 #define MARI_N_CELLS_MAX 149
+#endif
+#ifndef MARI_N_UPLINKS_MAX
+#define MARI_N_UPLINKS_MAX MARI_N_CELLS_MAX
+#endif
 
 #define MARI_ENABLE_BACKGROUND_SCAN 1
 
+#define MARI_ENABLE_ADAPTIVE_SCHEDULE 1  // the gateway switches to a smaller schedule when few nodes are joined
+
+#define MARI_ENABLE_COMPACT_HEADER 1  // once joined, data and keep-alive packets use mr_packet_header_compact_t, if both ends agree at join
+
+#define MARI_ENABLE_OCCUPANCY_BEACON 1  // beacons list the occupied uplink cells instead of a bloom filter, in the schedules where that is shorter
+
 #define MARI_PACKET_MAX_SIZE 255
 
-#define MARI_STATS_SCHED_USAGE_SIZE 4  // supports schedules with up to 256 cells
+#define MARI_STATS_SCHED_USAGE_SIZE ((MARI_N_CELLS_MAX + 63) / 64)  // one bit per cell
 
 //=========================== types ============================================
 
 // -------- types sent over the air --------
 
 typedef enum {
-    MARI_PACKET_BEACON        = 1,
-    MARI_PACKET_JOIN_REQUEST  = 2,
-    MARI_PACKET_JOIN_RESPONSE = 4,
-    MARI_PACKET_KEEPALIVE     = 8,
-    MARI_PACKET_DATA          = 16,
+    MARI_PACKET_BEACON          = 1,
+    MARI_PACKET_JOIN_REQUEST    = 2,
+    MARI_PACKET_JOIN_RESPONSE   = 4,
+    MARI_PACKET_KEEPALIVE       = 8,
+    MARI_PACKET_DATA            = 16,
+    MARI_PACKET_DATA_AGGREGATED = 32,  // payloads of several data packets, each prefixed with its length, see mr_packet_append_subframe
+    MARI_PACKET_DATA_MULTI_DST  = 64,  // broadcast, with the payloads to several nodes, see mr_packet_append_record
 } mr_packet_type_t;
 
 typedef struct __attribute__((packed)) {
@@ -64,6 +89,15 @@ typedef struct __attribute__((packed)) {
     mr_packet_statistics_t stats;
 } mr_packet_header_t;
 
+// compact packet header, between a node and the gateway it joined, flagged with MARI_HEADER_COMPACT in the version
+typedef struct __attribute__((packed)) {
+    uint8_t  version;
+    uint8_t  type;           // mr_packet_type_t, on a single byte
+    uint16_t network_id;
+    uint16_t gateway;        // lower bits of the id of the gateway, to tell the packets of the nearby gateways apart
+    uint16_t short_address;  // uplink number of the node, its source when sent by the node, its destination otherwise
+} mr_packet_header_compact_t;
+
 // beacon packet
 typedef struct __attribute__((packed)) {
     uint8_t          version;
@@ -71,11 +105,15 @@ typedef struct __attribute__((packed)) {
     uint16_t         network_id;
     uint64_t         asn;
     uint64_t         src;
-    uint8_t          remaining_capacity;
+    uint16_t         remaining_capacity;
     uint8_t          active_schedule_id;
-    uint8_t          bloom_filter[MARI_BLOOM_M_BYTES];
+    uint8_t          next_schedule_id;  // schedule that becomes active at switch_asn
+    uint64_t         switch_asn;        // 0 when no schedule switch is pending
+    uint8_t          membership[MARI_BLOOM_M_BYTES];  // bloom filter, or occupancy of the uplink cells with MARI_HEADER_OCCUPANCY, which may be shorter
 } mr_beacon_packet_header_t;
 
+_Static_assert(sizeof(mr_beacon_packet_header_t) <= MARI_PACKET_MAX_SIZE, "the largest membership must fit in a beacon");
+
 // -------- types used internally --------
 
 typedef enum {
@@ -91,6 +129,8 @@ typedef enum {
     MARI_NODE_LEFT,
     MARI_KEEPALIVE,
     MARI_ERROR,
+    MARI_TX_QUEUE_HIGH,  // the transmit queue is filling up, the application should hold its packets
+    MARI_TX_QUEUE_LOW,   // the transmit queue drained after MARI_TX_QUEUE_HIGH, the application can send again
 } mr_event_t;
 
 typedef enum {
@@ -104,8 +144,10 @@ typedef enum {
     MARI_HANDOVER_FAILED   = 7,
 } mr_event_tag_t;
 
+// a received data packet, valid during the MARI_NEW_PACKET event only. The header is not always right before the
+// payload: it is rebuilt for compact headers, aggregated payloads and multi-destination records
 typedef struct {
-    uint8_t             len;
+    uint8_t             len;  ///< Length of the header and the payload
     mr_packet_header_t *header;
     uint8_t            *payload;
     uint8_t             payload_len;
@@ -137,30 +179,46 @@ typedef enum {
     SLOT_TYPE_UPLINK        = 'U',
 } slot_type_t;
 
+// what the radio does in a slot, as returned by mr_scheduler_tick
 typedef struct {
     mr_radio_action_t radio_action;
     uint8_t           channel;
-    slot_type_t       type;
+    slot_type_t       type;  ///< Type of the cell, the mac sizes the slot and picks the queue to transmit from with it
 } mr_slot_info_t;
 
+// read-only part of a cell, shared by all the devices using the schedule
 typedef struct {
-    slot_type_t type;
-    uint8_t     channel_offset;
-    uint64_t    assigned_node_id;
-    uint64_t    last_received_asn;  ///< ASN marking the last time the node was heard from
-    uint64_t    bloom_h1;           ///< H1 hash of the node ID, used to compute the bloom filter
-    uint64_t    bloom_h2;           ///< H2 hash of the node ID, used to compute the bloom filter
+    uint8_t type;  ///< slot_type_t, stored on a single byte
+    uint8_t channel_offset;
 } cell_t;
 
+// mutable state of an uplink cell of the active schedule
+typedef struct {
+    uint64_t assigned_node_id;
+    uint64_t last_received_asn;  ///< ASN marking the last time the node was heard from
+    uint64_t bloom_h1;           ///< H1 hash of the node ID, used to compute the bloom filter
+    uint64_t bloom_h2;           ///< H2 hash of the node ID, used to compute the bloom filter
+    bool     compact_header;     ///< Whether the node agreed to compact headers when it joined
+} uplink_t;
+
 typedef struct {
     uint8_t id;                       // unique identifier for the schedule
-    uint8_t max_nodes;                // maximum number of nodes that can be scheduled, equivalent to the number of uplink slot_durations
-    uint8_t backoff_n_min;            // minimum exponent for the backoff algorithm
-    uint8_t backoff_n_max;            // maximum exponent for the backoff algorithm
-    size_t  n_cells;                  // number of cells in this schedule
-    cell_t  cells[MARI_N_CELLS_MAX];  // cells in this schedule. NOTE(FIXME?): the first 3 cells must be beacons
+    uint16_t max_nodes;                // maximum number of nodes that can be scheduled, equivalent to the number of uplink slot_durations
+    uint8_t  backoff_n_min;            // minimum exponent for the backoff algorithm
+    uint8_t  backoff_n_max;            // maximum exponent for the backoff algorithm
+    size_t   n_cells;                  // number of cells in this schedule
+    cell_t   cells[MARI_N_CELLS_MAX];  // cells in this schedule. NOTE(FIXME?): the first 3 cells must be beacons
 } schedule_t;
 
+// parameters of a schedule built by mr_scheduler_build_schedule
+typedef struct {
+    uint8_t  id;                    // unique identifier for the schedule, must differ from the ones of the built-in schedules
+    uint8_t  n_beacons;             // number of beacon cells, at the beginning of the schedule
+    uint16_t n_uplinks;             // number of dedicated uplink cells, i.e., maximum number of nodes
+    uint8_t  uplinks_per_downlink;  // downlink:uplink ratio, one downlink cell for every uplinks_per_downlink uplink cells
+    uint8_t  uplinks_per_shared;    // shared uplink density, one shared uplink cell for every uplinks_per_shared uplink cells
+} mr_schedule_params_t;
+
 typedef struct {
     uint8_t  channel;
     int8_t   rssi;
@@ -168,7 +226,7 @@ typedef struct {
     uint32_t end_ts;
     uint64_t asn;
     bool     to_me;
-    uint8_t  packet[MARI_PACKET_MAX_SIZE];
+    uint8_t *packet;  ///< In the buffer of the radio, only valid until the radio is enabled again
     uint8_t  packet_len;
 } mr_received_packet_t;
 
@@ -187,6 +245,7 @@ typedef struct __attribute__((packed)) {
     uint64_t device_id;
     uint16_t net_id;
     uint16_t schedule_id;
+    uint16_t n_cells;  // number of valid bits in sched_usage
     uint64_t sched_usage[MARI_STATS_SCHED_USAGE_SIZE];
     uint64_t asn;
     uint32_t timer;
@@ -5,6 +5,7 @@
  *
  * @copyright Inria, 2024
  */
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -13,6 +14,7 @@
 #include "association.h"
 #include "packet.h"
 #include "mac.h"
+#include "mari.h"
 
 //=========================== prototypes =======================================
 
@@ -26,19 +28,58 @@ size_t mr_build_packet_data(uint8_t *buffer, uint64_t dst, uint8_t *data, size_t
     return header_len + data_len;
 }
 
+// for a payload already written right after the header
+size_t mr_build_packet_data_header(uint8_t *buffer, uint64_t dst) {
+    return _set_header(buffer, dst, MARI_PACKET_DATA);
+}
+
+// header only, the payloads are then added with mr_packet_append_subframe
+size_t mr_build_packet_data_aggregated(uint8_t *buffer, uint64_t dst) {
+    return _set_header(buffer, dst, MARI_PACKET_DATA_AGGREGATED);
+}
+
+// appends a payload to an aggregated packet of the given length, prefixed with its length on one byte,
+// and returns the new length of the packet
+size_t mr_packet_append_subframe(uint8_t *buffer, size_t length, const uint8_t *payload, uint8_t payload_len) {
+    buffer[length] = payload_len;
+    memcpy(buffer + length + 1, payload, payload_len);
+    return length + 1 + payload_len;
+}
+
+// header only, the records are then added with mr_packet_append_record
+size_t mr_build_packet_data_multi_dst(uint8_t *buffer) {
+    return _set_header(buffer, MARI_BROADCAST_ADDRESS, MARI_PACKET_DATA_MULTI_DST);
+}
+
+// appends the payload to one node, identified by its short address (its uplink number), and returns the new length
+size_t mr_packet_append_record(uint8_t *buffer, size_t length, uint16_t short_dst, const uint8_t *payload, uint8_t payload_len) {
+    memcpy(buffer + length, &short_dst, sizeof(uint16_t));
+    buffer[length + sizeof(uint16_t)] = payload_len;
+    memcpy(buffer + length + MARI_RECORD_HEADER_LEN, payload, payload_len);
+    return length + MARI_RECORD_HEADER_LEN + payload_len;
+}
+
 size_t mr_build_packet_keepalive(uint8_t *buffer, uint64_t dst) {
     return _set_header(buffer, dst, MARI_PACKET_KEEPALIVE);
 }
 
 size_t mr_build_packet_join_request(uint8_t *buffer, uint64_t dst) {
-    return _set_header(buffer, dst, MARI_PACKET_JOIN_REQUEST);
+    size_t length = _set_header(buffer, dst, MARI_PACKET_JOIN_REQUEST);
+    if (MARI_ENABLE_COMPACT_HEADER) {
+        buffer[0] |= MARI_HEADER_COMPACT_OK;  // offer compact headers to the gateway
+    }
+    return length;
 }
 
-size_t mr_build_packet_join_response(uint8_t *buffer, uint64_t dst) {
-    return _set_header(buffer, dst, MARI_PACKET_JOIN_RESPONSE);
+size_t mr_build_packet_join_response(uint8_t *buffer, uint64_t dst, bool compact_header) {
+    size_t length = _set_header(buffer, dst, MARI_PACKET_JOIN_RESPONSE);
+    if (compact_header) {
+        buffer[0] |= MARI_HEADER_COMPACT_OK;  // the node offered them, and the gateway takes them too
+    }
+    return length;
 }
 
-size_t mr_build_packet_beacon(uint8_t *buffer, uint16_t net_id, uint64_t asn, uint8_t remaining_capacity, uint8_t active_schedule_id) {
+size_t mr_build_packet_beacon(uint8_t *buffer, uint16_t net_id, uint64_t asn, uint16_t remaining_capacity, uint8_t active_schedule_id, uint8_t next_schedule_id, uint64_t switch_asn) {
     mr_beacon_packet_header_t beacon = {
         .version            = MARI_PROTOCOL_VERSION,
         .type               = MARI_PACKET_BEACON,
@@ -47,11 +88,19 @@ size_t mr_build_packet_beacon(uint8_t *buffer, uint16_t net_id, uint64_t asn, ui
         .src                = mr_device_id(),
         .remaining_capacity = remaining_capacity,
         .active_schedule_id = active_schedule_id,
+        .next_schedule_id   = next_schedule_id,
+        .switch_asn         = switch_asn,
     };
-    // add bloom filter
-    mr_bloom_gateway_copy(beacon.bloom_filter);
-    memcpy(buffer, &beacon, sizeof(mr_beacon_packet_header_t));
-    return sizeof(mr_beacon_packet_header_t);
+    // add the nodes that are joined, as exactly as the length of the beacon allows
+    size_t length = offsetof(mr_beacon_packet_header_t, membership);
+    if (mr_scheduler_uses_occupancy_beacon()) {
+        beacon.version |= MARI_HEADER_OCCUPANCY;
+        length += mr_scheduler_gateway_copy_occupancy(beacon.membership);
+    } else if (mr_bloom_gateway_is_available() && !mr_bloom_gateway_is_dirty()) {
+        length += mr_bloom_gateway_copy(beacon.membership);
+    }  // else the filter is being resized, and nodes skip the check until it is sent again
+    memcpy(buffer, &beacon, length);
+    return length;
 }
 
 size_t mr_build_uart_packet_gateway_info(uint8_t *buffer) {
@@ -59,6 +108,7 @@ size_t mr_build_uart_packet_gateway_info(uint8_t *buffer) {
         .device_id   = mr_device_id(),
         .net_id      = mr_assoc_get_network_id(),
         .schedule_id = mr_scheduler_get_active_schedule_id(),
+        .n_cells     = mr_scheduler_get_active_schedule_slot_count(),
         .asn         = mr_mac_get_asn(),
     };
     memcpy(gateway_info.sched_usage, mr_scheduler_get_schedule_usage(), sizeof(uint64_t) * MARI_STATS_SCHED_USAGE_SIZE);
@@ -66,6 +116,30 @@ size_t mr_build_uart_packet_gateway_info(uint8_t *buffer) {
     return sizeof(mr_uart_packet_gateway_info_t);
 }
 
+uint8_t *mr_packet_compact_header(uint8_t *packet, uint8_t *length, uint16_t short_address, uint64_t gateway_id, bool from_gateway) {
+    const mr_packet_header_t  *header  = (const mr_packet_header_t *)packet;
+    mr_packet_header_compact_t compact = {
+        .version       = MARI_PROTOCOL_VERSION | MARI_HEADER_COMPACT | (from_gateway ? MARI_HEADER_FROM_GATEWAY : 0),
+        .type          = header->type,
+        .network_id    = header->network_id,
+        .gateway       = (uint16_t)gateway_id,
+        .short_address = short_address,
+    };
+    uint8_t *start = packet + sizeof(mr_packet_header_t) - sizeof(mr_packet_header_compact_t);
+    memcpy(start, &compact, sizeof(mr_packet_header_compact_t));
+    *length -= start - packet;
+    return start;
+}
+
+// whether a packet, with either header, was sent by the given gateway
+bool mr_packet_is_from_gateway(const uint8_t *packet, uint64_t gateway_id) {
+    if (packet[0] & MARI_HEADER_COMPACT) {
+        const mr_packet_header_compact_t *compact = (const mr_packet_header_compact_t *)packet;
+        return (compact->version & MARI_HEADER_FROM_GATEWAY) && compact->gateway == (uint16_t)gateway_id;
+    }
+    return ((const mr_packet_header_t *)packet)->src == gateway_id;
+}
+
 //=========================== private ==========================================
 
 static size_t _set_header(uint8_t *buffer, uint64_t dst, mr_packet_type_t packet_type) {
@@ -12,6 +12,7 @@
  * @}
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <nrf.h>
@@ -21,23 +22,62 @@
 
 //=========================== defines ==========================================
 
-#define MARI_PROTOCOL_VERSION 2
+#define MARI_PROTOCOL_VERSION 7
+
+// flags in the version byte, above the version number
+#define MARI_HEADER_VERSION_MASK 0x1F
+#define MARI_HEADER_COMPACT_OK   0x20  // join request and response: the sender takes compact headers
+#define MARI_HEADER_FROM_GATEWAY 0x40  // compact header: sent by the gateway, so the short address is the destination
+#define MARI_HEADER_COMPACT      0x80  // the packet begins with a mr_packet_header_compact_t
+#define MARI_HEADER_OCCUPANCY    0x20  // beacon: the membership is an occupancy of the uplink cells, see mr_scheduler_gateway_copy_occupancy
+
+#define MARI_SHORT_ADDRESS_BROADCAST 0xFFFF
 
 #define MARI_NET_ID_PATTERN_ANY 0
 #define MARI_NET_ID_DEFAULT     1
 
+#define MARI_RECORD_HEADER_LEN (sizeof(uint16_t) + 1)  // records of MARI_PACKET_DATA_MULTI_DST: short address of the destination, length, then payload
+
 //=========================== prototypes =======================================
 
 size_t mr_build_packet_data(uint8_t *buffer, uint64_t dst, uint8_t *data, size_t data_len);
 
+size_t mr_build_packet_data_header(uint8_t *buffer, uint64_t dst);
+
+size_t mr_build_packet_data_aggregated(uint8_t *buffer, uint64_t dst);
+
+size_t mr_packet_append_subframe(uint8_t *buffer, size_t length, const uint8_t *payload, uint8_t payload_len);
+
+size_t mr_build_packet_data_multi_dst(uint8_t *buffer);
+
+size_t mr_packet_append_record(uint8_t *buffer, size_t length, uint16_t short_dst, const uint8_t *payload, uint8_t payload_len);
+
 size_t mr_build_packet_join_request(uint8_t *buffer, uint64_t dst);
 
-size_t mr_build_packet_join_response(uint8_t *buffer, uint64_t dst);
+size_t mr_build_packet_join_response(uint8_t *buffer, uint64_t dst, bool compact_header);
 
 size_t mr_build_packet_keepalive(uint8_t *buffer, uint64_t dst);
 
-size_t mr_build_packet_beacon(uint8_t *buffer, uint16_t net_id, uint64_t asn, uint8_t remaining_capacity, uint8_t active_schedule_id);
+size_t mr_build_packet_beacon(uint8_t *buffer, uint16_t net_id, uint64_t asn, uint16_t remaining_capacity, uint8_t active_schedule_id, uint8_t next_schedule_id, uint64_t switch_asn);
 
 size_t mr_build_uart_packet_gateway_info(uint8_t *buffer);
 
+/**
+ * @brief Rewrites the full header of a packet as a compact header, in place.
+ *
+ * The compact header ends where the full header did, so the payload does not move. Only the src and stats of
+ * the full header are overwritten.
+ *
+ * @param[in]       packet          Packet that begins with a mr_packet_header_t
+ * @param[in,out]   length          Length of the packet, shortened by the difference between the headers
+ * @param[in]       short_address   Uplink number of the node that sends the packet, or that it is sent to
+ * @param[in]       gateway_id      Id of the gateway that sends the packet, or that it is sent to
+ * @param[in]       from_gateway    Whether the packet is sent by the gateway
+ *
+ * @return Beginning of the packet with the compact header
+ */
+uint8_t *mr_packet_compact_header(uint8_t *packet, uint8_t *length, uint16_t short_address, uint64_t gateway_id, bool from_gateway);
+
+bool mr_packet_is_from_gateway(const uint8_t *packet, uint64_t gateway_id);
+
 #endif
@@ -12,8 +12,11 @@
 #include <nrf.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "mr_device.h"
+#include "mr_radio.h"
 #include "packet.h"
 #include "mac.h"
 #include "scheduler.h"
@@ -24,21 +27,59 @@
 
 //=========================== defines ==========================================
 
+#define MARI_QUEUE_NONE (-1)
+
 typedef struct {
     uint8_t length;
+    uint8_t in_flight;                       ///< Gateway: entry of queue_vars.in_flight counting the packet, as its header may be rewritten
+    uint8_t headroom[MR_RADIO_TX_HEADROOM];  ///< The radio sends the buffer in place, and writes its PDU header here
     uint8_t buffer[MARI_PACKET_MAX_SIZE];
 } mr_packet_t;
 
+// Single-producer/single-consumer ring of packet indices.
+// Both positions run freely and wrap around, their difference is the number of items.
+typedef struct {
+    uint8_t head;  ///< Position of the next item to add, only written by the producer
+    uint8_t tail;  ///< Position of the next item to remove, only written by the consumer
+    uint8_t items[MARI_PACKET_QUEUE_SIZE];
+} mr_index_ring_t;
+
+// Downlink packets to one destination, in the order the application sent them
 typedef struct {
-    uint8_t     current;  ///< Current position in the queue
-    uint8_t     last;     ///< Position of the last item added in the queue
-    mr_packet_t packets[MARI_PACKET_QUEUE_SIZE];
-} mari_packet_queue_t;
+    uint64_t dst;
+    int8_t   first;    ///< First packet, linked through queue_vars.next, MARI_QUEUE_NONE when the flow is not in use
+    int8_t   last;     ///< Last packet
+    uint8_t  deficit;  ///< Downlink cells the flow may still use in the current round
+} mr_downlink_flow_t;
 
 typedef struct {
-    mari_packet_queue_t packet_queue;
-    bool                queue_locked;  ///< Simple lock to prevent concurrent access
-    mr_packet_t         join_packet;
+    // packet buffers, owned by the application while it fills them, then by the MAC until they are sent
+    mr_packet_t     packets[MARI_PACKET_QUEUE_SIZE];
+    mr_index_ring_t tx_ring;    ///< Application -> MAC: packets to send, in order
+    mr_index_ring_t free_ring;  ///< MAC -> application: packets sent or dropped, whose buffer can be reused
+
+    // application side
+    uint8_t free[MARI_PACKET_QUEUE_SIZE];  ///< Buffers taken back from the free ring
+    uint8_t free_len;
+    struct {
+        uint64_t dst;
+        uint8_t  count;  ///< 0 when the entry is not in use
+    } in_flight[MARI_PACKET_QUEUE_SIZE];  ///< Gateway: number of queued packets to each destination
+
+    // MAC side, gateway only: per-destination queues served in deficit round-robin order
+    mr_downlink_flow_t flows[MARI_PACKET_QUEUE_SIZE];
+    int8_t             next[MARI_PACKET_QUEUE_SIZE];    ///< Next packet of the same flow
+    uint8_t            active[MARI_PACKET_QUEUE_SIZE];  ///< Ring of the flows with packets, the first one is served next
+    uint8_t            active_first;
+    uint8_t            active_len;
+    uint8_t            flows_len;  ///< Number of packets in the flows
+
+    int8_t      on_air;      ///< Packet lent to the radio by mr_queue_next_packet, MARI_QUEUE_NONE if it is not from the pool
+    mr_packet_t mac_packet;  ///< Beacons and keepalives, built by the MAC right before sending them
+
+    bool          above_high_watermark;  ///< Set when MARI_TX_QUEUE_HIGH was sent, cleared with MARI_TX_QUEUE_LOW
+    mr_packet_t   join_packet;
+    mr_event_cb_t mari_event_callback;
 } queue_vars_t;
 
 //=========================== variables ========================================
@@ -47,118 +88,181 @@ static queue_vars_t queue_vars = { 0 };
 
 //=========================== prototypes =======================================
 
+static bool    _ring_push(mr_index_ring_t *ring, uint8_t index);
+static int16_t _ring_pop(mr_index_ring_t *ring);
+static int16_t _ring_peek(mr_index_ring_t *ring);
+static uint8_t _ring_peek_at(mr_index_ring_t *ring, uint8_t position);
+static uint8_t _ring_count(mr_index_ring_t *ring);
+
+static uint64_t _packet_dst(uint8_t index);
+static void     _reclaim(void);
+static int16_t  _in_flight_entry(uint64_t dst);
+
+static void     _downlink_classify(void);
+static uint8_t *_downlink_dequeue(uint8_t *length);
+static int16_t  _downlink_peek(void);
+static uint8_t  _downlink_pop(void);
+static int16_t  _downlink_record_len(int16_t index, int16_t *short_dst);
+static uint8_t *_downlink_aggregate(uint8_t first, uint8_t *length);
+static uint8_t *_uplink_dequeue(uint8_t *length);
+static uint8_t *_uplink_aggregate(uint8_t *length);
+static uint8_t *_compact(uint8_t *packet, uint8_t *length);
+static uint8_t *_lend(uint8_t index, uint8_t *length);
+static void     _release(uint8_t index);
+static void    _check_low_watermark(void);
+
 //=========================== public ===========================================
 
-uint8_t mr_queue_next_packet(slot_type_t slot_type, uint8_t *packet) {
-    uint8_t len = 0;
+void mr_queue_init(mr_event_cb_t event_callback) {
+    // every buffer starts in the free ring
+    memset(&queue_vars, 0, sizeof(queue_vars));
+    for (size_t i = 0; i < MARI_PACKET_QUEUE_SIZE; i++) {
+        queue_vars.free_ring.items[i] = i;
+        queue_vars.flows[i].first     = MARI_QUEUE_NONE;
+    }
+    queue_vars.free_ring.head      = MARI_PACKET_QUEUE_SIZE;
+    queue_vars.on_air              = MARI_QUEUE_NONE;
+    queue_vars.mari_event_callback = event_callback;
+}
+
+uint8_t *mr_queue_next_packet(slot_type_t slot_type, uint8_t *length) {
+    // whatever was sent in the previous slot is over
+    mr_queue_release_packet();
+
+    uint8_t *packet = NULL;
+    *length         = 0;
 
     if (mari_get_node_type() == MARI_GATEWAY) {
         if (slot_type == SLOT_TYPE_BEACON) {
-            // prepare a beacon packet with current asn, remaining capacity and active schedule id
-            len = mr_build_packet_beacon(
+            // prepare a beacon packet with current asn, remaining capacity, active schedule id and pending schedule switch
+            uint8_t  next_schedule_id;
+            uint64_t switch_asn = mr_scheduler_get_pending_switch(&next_schedule_id);
+            packet              = queue_vars.mac_packet.buffer;
+            *length             = mr_build_packet_beacon(
                 packet,
                 mr_assoc_get_network_id(),
                 mr_mac_get_asn(),
-                mr_scheduler_gateway_remaining_capacity(),
-                mr_scheduler_get_active_schedule_id());
+                mr_scheduler_gateway_remaining_capacity(mr_mac_get_asn()),
+                mr_scheduler_get_active_schedule_id(),
+                next_schedule_id,
+                switch_asn);
         } else if (slot_type == SLOT_TYPE_DOWNLINK) {
             if (mr_queue_has_join_packet()) {
-                len = mr_queue_get_join_packet(packet);
+                // join responses have strict priority over the application packets
+                packet = mr_queue_get_join_packet(length);
             } else {
-                // load a packet from the queue, if any is available
-                len = mr_queue_peek(packet);
-                if (len) {
-                    // actually pop the packet from the queue
-                    mr_queue_pop();
-                }
+                // the next packet of the per-destination queues, in deficit round-robin order
+                packet = _downlink_dequeue(length);
             }
         }
     } else if (mari_get_node_type() == MARI_NODE) {
         if (slot_type == SLOT_TYPE_SHARED_UPLINK) {
             if (mr_assoc_node_ready_to_join()) {
                 mr_assoc_node_start_joining();
-                len = mr_queue_get_join_packet(packet);
+                packet = mr_queue_get_join_packet(length);
             }
         } else if (slot_type == SLOT_TYPE_UPLINK) {
-            // load a packet from the queue, if any is available
-            len = mr_queue_peek(packet);
-            if (len) {
-                // actually pop the packet from the queue
-                mr_queue_pop();
-            } else if (MARI_AUTO_UPLINK_KEEPALIVE) {
+            // load a packet from the queue, if any is available, or several small ones at once
+            if (MARI_UPLINK_AGGREGATION) {
+                packet = _uplink_aggregate(length);
+            }
+            if (packet == NULL) {
+                packet = _uplink_dequeue(length);
+            }
+            if (packet == NULL && MARI_AUTO_UPLINK_KEEPALIVE) {
                 // send a keepalive packet
-                len = mr_build_packet_keepalive(packet, mr_mac_get_synced_gateway());
+                packet  = queue_vars.mac_packet.buffer;
+                *length = mr_build_packet_keepalive(packet, mr_mac_get_synced_gateway());
             }
         }
     }
 
-    return len;
+    return _compact(packet, length);
 }
 
-void mr_queue_add(uint8_t *packet, uint8_t length) {
-    // lock is asymetrical: add (called from application) can wait in busy loop
-    while (queue_vars.queue_locked) {
-        // wait for the queue to be unlocked
+void mr_queue_release_packet(void) {
+    if (queue_vars.on_air != MARI_QUEUE_NONE) {
+        _release(queue_vars.on_air);
+        queue_vars.on_air = MARI_QUEUE_NONE;
     }
-    queue_vars.queue_locked = true;
-
-    // enqueue for transmission
-    memcpy(queue_vars.packet_queue.packets[queue_vars.packet_queue.last].buffer, packet, length);
-    queue_vars.packet_queue.packets[queue_vars.packet_queue.last].length = length;
-    // increment the `last` index
-    queue_vars.packet_queue.last = (queue_vars.packet_queue.last + 1) % MARI_PACKET_QUEUE_SIZE;
-
-    queue_vars.queue_locked = false;
 }
 
-uint8_t mr_queue_peek(uint8_t *packet) {
-    // lock is asymetrical: peek (called from MAC) can simply give up if the queue is locked
-    if (queue_vars.queue_locked) {
-        // simply give up if the queue is locked (will try again next slot)
-        return 0;
+bool mr_queue_add(uint8_t *packet, uint8_t length) {
+    uint8_t *buffer = mr_queue_get_buffer();
+    if (buffer == NULL) {
+        return false;
     }
+    memcpy(buffer, packet, length);
+    return mr_queue_commit(length);
+}
 
-    if (queue_vars.packet_queue.current == queue_vars.packet_queue.last) {
-        return 0;
+uint8_t *mr_queue_get_buffer(void) {
+    // called from the application, the producer of the tx ring and the consumer of the free ring
+    _reclaim();
+    if (queue_vars.free_len == 0) {
+        return NULL;  // full, the oldest packets are not overwritten
     }
-
-    memcpy(packet, queue_vars.packet_queue.packets[queue_vars.packet_queue.current].buffer, queue_vars.packet_queue.packets[queue_vars.packet_queue.current].length);
-    // do not increment the `current` index here, as this is just a peek
-    return queue_vars.packet_queue.packets[queue_vars.packet_queue.current].length;
+    // the buffer stays on the free stack until it is committed
+    return queue_vars.packets[queue_vars.free[queue_vars.free_len - 1]].buffer;
 }
 
-bool mr_queue_pop(void) {
-    // lock is asymetrical: just as with peek
-    if (queue_vars.queue_locked) {
-        // simply give up if the queue is locked (will try again next slot)
-        return false;
+bool mr_queue_commit(uint8_t length) {
+    if (queue_vars.free_len == 0 || length == 0) {
+        return false;  // no buffer was handed out by mr_queue_get_buffer
     }
+    uint8_t index = queue_vars.free[queue_vars.free_len - 1];
 
-    if (queue_vars.packet_queue.current == queue_vars.packet_queue.last) {
-        return false;
-    } else {
-        // increment the `current` index
-        queue_vars.packet_queue.current = (queue_vars.packet_queue.current + 1) % MARI_PACKET_QUEUE_SIZE;
-        return true;
+    if (mari_get_node_type() == MARI_GATEWAY) {
+        uint64_t dst   = _packet_dst(index);
+        int16_t  entry = _in_flight_entry(dst);
+        if (entry < 0 || queue_vars.in_flight[entry].count >= MARI_DOWNLINK_QUEUE_DEPTH_MAX) {
+            return false;  // this destination already has its share of the buffers
+        }
+        queue_vars.in_flight[entry].dst = dst;
+        queue_vars.in_flight[entry].count++;
+        queue_vars.packets[index].in_flight = entry;
+    }
+
+    queue_vars.free_len--;
+    queue_vars.packets[index].length = length;
+    // publish the packet: the MAC only sees it after it is written
+    _ring_push(&queue_vars.tx_ring, index);
+
+    uint8_t count = MARI_PACKET_QUEUE_SIZE - queue_vars.free_len - _ring_count(&queue_vars.free_ring);
+    if (count >= MARI_PACKET_QUEUE_HIGH_WATERMARK && !__atomic_exchange_n(&queue_vars.above_high_watermark, true, __ATOMIC_ACQ_REL) && queue_vars.mari_event_callback) {
+        queue_vars.mari_event_callback(MARI_TX_QUEUE_HIGH, (mr_event_data_t){ 0 });
     }
+    return true;
 }
 
+// to be called from the MAC, as the consumer: drops every queued packet
 void mr_queue_reset(void) {
-    queue_vars.packet_queue.current = 0;
-    queue_vars.packet_queue.last    = 0;
-    queue_vars.join_packet.length   = 0;
-    queue_vars.queue_locked         = false;
+    int16_t index;
+    while ((index = _ring_pop(&queue_vars.tx_ring)) >= 0) {
+        _ring_push(&queue_vars.free_ring, index);
+    }
+    for (size_t i = 0; i < MARI_PACKET_QUEUE_SIZE; i++) {
+        for (int8_t j = queue_vars.flows[i].first; j != MARI_QUEUE_NONE; j = queue_vars.next[j]) {
+            _ring_push(&queue_vars.free_ring, j);
+        }
+        queue_vars.flows[i].first = MARI_QUEUE_NONE;
+    }
+    queue_vars.active_len = 0;
+    queue_vars.flows_len  = 0;
+
+    queue_vars.join_packet.length = 0;
     memset(queue_vars.join_packet.buffer, 0, sizeof(queue_vars.join_packet.buffer));
+    _check_low_watermark();
 }
 
 void mr_queue_set_join_request(uint64_t node_id) {
     queue_vars.join_packet.length = mr_build_packet_join_request(queue_vars.join_packet.buffer, node_id);
 }
 
-void mr_queue_set_join_response(uint64_t node_id, uint8_t assigned_cell_id) {
-    uint8_t len                          = mr_build_packet_join_response(queue_vars.join_packet.buffer, node_id);
-    queue_vars.join_packet.buffer[len++] = assigned_cell_id;
-    queue_vars.join_packet.length        = len;
+void mr_queue_set_join_response(uint64_t node_id, uint16_t assigned_cell_id, bool compact_header) {
+    uint8_t len = mr_build_packet_join_response(queue_vars.join_packet.buffer, node_id, compact_header);
+    memcpy(queue_vars.join_packet.buffer + len, &assigned_cell_id, sizeof(uint16_t));
+    queue_vars.join_packet.length = len + sizeof(uint16_t);
 }
 
 bool mr_queue_has_join_packet(void) {
@@ -167,12 +271,320 @@ bool mr_queue_has_join_packet(void) {
 
 // if used by the node, gets it a join request packet
 // if used by the gateway, gets it a join response packet
-uint8_t mr_queue_get_join_packet(uint8_t *packet) {
-    memcpy(packet, queue_vars.join_packet.buffer, queue_vars.join_packet.length);
-    uint8_t len = queue_vars.join_packet.length;
+// the packet is sent in place: a new one is only set at a later slot, once this one is sent
+uint8_t *mr_queue_get_join_packet(uint8_t *length) {
+    *length = queue_vars.join_packet.length;
 
     // clear the join request
     queue_vars.join_packet.length = 0;
 
-    return len;
+    return queue_vars.join_packet.buffer;
+}
+
+//=========================== private ==========================================
+
+static bool _ring_push(mr_index_ring_t *ring, uint8_t index) {
+    // only the producer writes the head, so it can be read without barrier
+    uint8_t head = ring->head;
+    uint8_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if ((uint8_t)(head - tail) == MARI_PACKET_QUEUE_SIZE) {
+        return false;
+    }
+    ring->items[head % MARI_PACKET_QUEUE_SIZE] = index;
+    __atomic_store_n(&ring->head, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+static int16_t _ring_peek(mr_index_ring_t *ring) {
+    uint8_t tail = ring->tail;
+    uint8_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return MARI_QUEUE_NONE;
+    }
+    return ring->items[tail % MARI_PACKET_QUEUE_SIZE];
+}
+
+static int16_t _ring_pop(mr_index_ring_t *ring) {
+    int16_t index = _ring_peek(ring);
+    if (index >= 0) {
+        // the producer may reuse the item only after seeing the new tail
+        __atomic_store_n(&ring->tail, (uint8_t)(ring->tail + 1), __ATOMIC_RELEASE);
+    }
+    return index;
+}
+
+// to be called by the consumer, with a position below the number of items
+static uint8_t _ring_peek_at(mr_index_ring_t *ring, uint8_t position) {
+    return ring->items[(uint8_t)(ring->tail + position) % MARI_PACKET_QUEUE_SIZE];
+}
+
+static uint8_t _ring_count(mr_index_ring_t *ring) {
+    uint8_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint8_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+static uint64_t _packet_dst(uint8_t index) {
+    uint64_t dst;
+    memcpy(&dst, queue_vars.packets[index].buffer + offsetof(mr_packet_header_t, dst), sizeof(uint64_t));
+    return dst;
+}
+
+// application side: takes back the buffers released by the MAC
+static void _reclaim(void) {
+    int16_t index;
+    while ((index = _ring_pop(&queue_vars.free_ring)) >= 0) {
+        queue_vars.free[queue_vars.free_len++] = index;
+        if (mari_get_node_type() == MARI_GATEWAY && queue_vars.packets[index].length > 0) {
+            queue_vars.in_flight[queue_vars.packets[index].in_flight].count--;
+        }
+        queue_vars.packets[index].length = 0;
+    }
+}
+
+// application side: the entry counting the queued packets to dst, or an unused one, -1 if there is none
+static int16_t _in_flight_entry(uint64_t dst) {
+    int16_t unused = MARI_QUEUE_NONE;
+    for (size_t i = 0; i < MARI_PACKET_QUEUE_SIZE; i++) {
+        if (queue_vars.in_flight[i].count == 0) {
+            unused = unused < 0 ? (int16_t)i : unused;
+        } else if (queue_vars.in_flight[i].dst == dst) {
+            return i;
+        }
+    }
+    return unused;
+}
+
+// MAC side: moves the packets sent by the application to the queue of their destination
+static void _downlink_classify(void) {
+    int16_t index;
+    while ((index = _ring_pop(&queue_vars.tx_ring)) >= 0) {
+        uint64_t dst  = _packet_dst(index);
+        int16_t  flow = MARI_QUEUE_NONE;
+        for (size_t i = 0; i < MARI_PACKET_QUEUE_SIZE; i++) {
+            if (queue_vars.flows[i].first == MARI_QUEUE_NONE) {
+                flow = flow < 0 ? (int16_t)i : flow;
+            } else if (queue_vars.flows[i].dst == dst) {
+                flow = i;
+                break;
+            }
+        }
+        // there are as many flows as buffers, so there is always one available
+
+        mr_downlink_flow_t *f = &queue_vars.flows[flow];
+        queue_vars.next[index] = MARI_QUEUE_NONE;
+        if (f->first == MARI_QUEUE_NONE) {
+            f->dst     = dst;
+            f->first   = index;
+            f->deficit = 0;
+            queue_vars.active[(queue_vars.active_first + queue_vars.active_len++) % MARI_PACKET_QUEUE_SIZE] = flow;
+        } else {
+            queue_vars.next[f->last] = index;
+        }
+        f->last = index;
+        queue_vars.flows_len++;
+    }
+}
+
+static uint8_t *_downlink_dequeue(uint8_t *length) {
+    _downlink_classify();
+    if (queue_vars.active_len == 0) {
+        _check_low_watermark();
+        return NULL;
+    }
+
+    uint8_t  first  = _downlink_pop();
+    uint8_t *packet = MARI_DOWNLINK_AGGREGATION ? _downlink_aggregate(first, length) : NULL;
+    return packet ? packet : _lend(first, length);
+}
+
+// MAC side: the packet that _downlink_pop returns next, MARI_QUEUE_NONE if there is none
+static int16_t _downlink_peek(void) {
+    if (queue_vars.active_len == 0) {
+        return MARI_QUEUE_NONE;
+    }
+    return queue_vars.flows[queue_vars.active[queue_vars.active_first]].first;
+}
+
+// MAC side: deficit round-robin over the destinations. The downlink cell is the scarce resource, whatever the
+// length of the packet, so each packet costs one cell, and each flow gets MARI_DOWNLINK_QUANTUM cells per round.
+static uint8_t _downlink_pop(void) {
+    uint8_t             flow = queue_vars.active[queue_vars.active_first];
+    mr_downlink_flow_t *f    = &queue_vars.flows[flow];
+    if (f->deficit == 0) {
+        f->deficit = MARI_DOWNLINK_QUANTUM;  // beginning of the turn of this flow
+    }
+
+    uint8_t index = f->first;
+    f->first      = queue_vars.next[index];
+    f->deficit--;
+    queue_vars.flows_len--;
+
+    if (f->first == MARI_QUEUE_NONE) {
+        // empty flows leave the round, and lose their deficit
+        f->deficit              = 0;
+        queue_vars.active_first = (queue_vars.active_first + 1) % MARI_PACKET_QUEUE_SIZE;
+        queue_vars.active_len--;
+    } else if (f->deficit == 0) {
+        // end of the turn: the flow goes to the back of the round
+        uint8_t back            = (queue_vars.active_first + queue_vars.active_len) % MARI_PACKET_QUEUE_SIZE;
+        queue_vars.active[back] = flow;
+        queue_vars.active_first = (queue_vars.active_first + 1) % MARI_PACKET_QUEUE_SIZE;
+    }
+
+    return index;
+}
+
+// MAC side, gateway: length of the packet as a record of a MARI_PACKET_DATA_MULTI_DST, -1 if it cannot be one:
+// only data packets to a single joined node, which has a short address, are
+static int16_t _downlink_record_len(int16_t index, int16_t *short_dst) {
+    if (index < 0) {
+        return -1;
+    }
+    const mr_packet_t        *slot   = &queue_vars.packets[index];
+    const mr_packet_header_t *header = (const mr_packet_header_t *)slot->buffer;
+    if (header->type != MARI_PACKET_DATA || slot->length < sizeof(mr_packet_header_t)) {
+        return -1;
+    }
+    *short_dst = mr_scheduler_gateway_get_node_uplink(header->dst);
+    if (*short_dst < 0) {
+        return -1;
+    }
+    return MARI_RECORD_HEADER_LEN + slot->length - sizeof(mr_packet_header_t);
+}
+
+// MAC side, gateway: packs the first packet and the ones that come next in deficit round-robin order into one
+// MARI_PACKET_DATA_MULTI_DST, as many as fit, so that small packets to many nodes share the downlink cells.
+// Returns NULL, with nothing else dequeued, if the next packet cannot go along with the first one.
+static uint8_t *_downlink_aggregate(uint8_t first, uint8_t *length) {
+    int16_t short_dst;
+    int16_t record_len = _downlink_record_len(first, &short_dst);
+    size_t  total      = sizeof(mr_packet_header_t) + record_len;
+    int16_t next_short_dst;
+    int16_t next_len = _downlink_record_len(_downlink_peek(), &next_short_dst);
+    if (record_len < 0 || next_len < 0 || total + next_len > MARI_PACKET_MAX_SIZE) {
+        return NULL;
+    }
+
+    // the payloads are copied into the buffer of the MAC, and the packets given back right away
+    uint8_t *packet  = queue_vars.mac_packet.buffer;
+    size_t   len     = mr_build_packet_data_multi_dst(packet);
+    uint8_t  index   = first;
+    bool     compact = MARI_ENABLE_COMPACT_HEADER;
+    while (true) {
+        compact                 = compact && mr_scheduler_gateway_uplink_has_compact_header(short_dst);
+        const mr_packet_t *slot = &queue_vars.packets[index];
+        len                     = mr_packet_append_record(packet, len, short_dst, slot->buffer + sizeof(mr_packet_header_t), slot->length - sizeof(mr_packet_header_t));
+        _release(index);
+
+        record_len = _downlink_record_len(_downlink_peek(), &short_dst);
+        if (record_len < 0 || len + record_len > MARI_PACKET_MAX_SIZE) {
+            break;
+        }
+        index = _downlink_pop();
+    }
+
+    *length = len;
+    if (compact) {
+        // every node the frame carries records to takes compact headers
+        return mr_packet_compact_header(packet, length, MARI_SHORT_ADDRESS_BROADCAST, mr_device_id(), true);
+    }
+    return packet;
+}
+
+// MAC side, node: the packets are sent in the order the application sent them
+static uint8_t *_uplink_dequeue(uint8_t *length) {
+    int16_t index = _ring_pop(&queue_vars.tx_ring);
+    if (index < 0) {
+        _check_low_watermark();
+        return NULL;
+    }
+    return _lend(index, length);
+}
+
+// MAC side, node: packs the data packets at the head of the queue into one frame, as many as fit, for the price of a
+// single header and uplink cell. Returns NULL if fewer than two packets fit, the first one is then sent in place.
+static uint8_t *_uplink_aggregate(uint8_t *length) {
+    const size_t header_len = sizeof(mr_packet_header_t);
+    uint8_t      count      = _ring_count(&queue_vars.tx_ring);
+    uint64_t     dst        = 0;
+    size_t       total      = header_len;
+    uint8_t      n          = 0;
+    for (; n < count; n++) {
+        uint8_t                   index  = _ring_peek_at(&queue_vars.tx_ring, n);
+        const mr_packet_t        *slot   = &queue_vars.packets[index];
+        const mr_packet_header_t *header = (const mr_packet_header_t *)slot->buffer;
+        if (header->type != MARI_PACKET_DATA || slot->length < header_len || (n > 0 && header->dst != dst)) {
+            break;
+        }
+        size_t subframe_len = 1 + slot->length - header_len;  // length prefix and payload
+        if (total + subframe_len > MARI_PACKET_MAX_SIZE) {
+            break;
+        }
+        dst    = header->dst;
+        total += subframe_len;
+    }
+    if (n < 2) {
+        return NULL;
+    }
+
+    // the payloads are copied into the buffer of the MAC, and the packets given back right away
+    uint8_t *packet = queue_vars.mac_packet.buffer;
+    size_t   len    = mr_build_packet_data_aggregated(packet, dst);
+    for (uint8_t i = 0; i < n; i++) {
+        uint8_t            index = _ring_pop(&queue_vars.tx_ring);
+        const mr_packet_t *slot  = &queue_vars.packets[index];
+        len                      = mr_packet_append_subframe(packet, len, slot->buffer + header_len, slot->length - header_len);
+        _release(index);
+    }
+    *length = len;
+    return packet;
+}
+
+// MAC side: data and keep-alive packets between a node and its gateway get a compact header, if both agreed to it at join.
+// The header is rewritten in place, which leaves the dst of the full header untouched for the in-flight accounting.
+static uint8_t *_compact(uint8_t *packet, uint8_t *length) {
+    if (!MARI_ENABLE_COMPACT_HEADER || packet == NULL) {
+        return packet;
+    }
+    const mr_packet_header_t *header = (const mr_packet_header_t *)packet;
+    if (header->type != MARI_PACKET_DATA && header->type != MARI_PACKET_DATA_AGGREGATED && header->type != MARI_PACKET_KEEPALIVE) {
+        return packet;
+    }
+
+    if (mari_get_node_type() == MARI_GATEWAY) {
+        int16_t uplink = mr_scheduler_gateway_get_node_uplink(header->dst);
+        if (uplink < 0 || !mr_scheduler_gateway_uplink_has_compact_header(uplink)) {
+            return packet;
+        }
+        return mr_packet_compact_header(packet, length, uplink, mr_device_id(), true);
+    }
+
+    int16_t uplink = mr_scheduler_node_get_uplink();
+    if (uplink < 0 || !mr_assoc_node_uses_compact_header() || header->dst != mr_mac_get_synced_gateway()) {
+        return packet;
+    }
+    return mr_packet_compact_header(packet, length, uplink, header->dst, false);
+}
+
+// MAC side: the radio sends the packet from its buffer, which is released with mr_queue_release_packet
+static uint8_t *_lend(uint8_t index, uint8_t *length) {
+    queue_vars.on_air = index;
+    *length           = queue_vars.packets[index].length;
+    return queue_vars.packets[index].buffer;
+}
+
+// MAC side: gives the buffer back to the application
+static void _release(uint8_t index) {
+    _ring_push(&queue_vars.free_ring, index);
+    _check_low_watermark();
+}
+
+// called by the consumer, also when the queue is found empty, so that the event is not missed
+// if the application raised the watermark right after the MAC drained the queue
+static void _check_low_watermark(void) {
+    uint8_t count = _ring_count(&queue_vars.tx_ring) + queue_vars.flows_len;
+    if (count <= MARI_PACKET_QUEUE_LOW_WATERMARK && __atomic_exchange_n(&queue_vars.above_high_watermark, false, __ATOMIC_ACQ_REL) && queue_vars.mari_event_callback) {
+        queue_vars.mari_event_callback(MARI_TX_QUEUE_LOW, (mr_event_data_t){ 0 });
+    }
 }
@@ -19,23 +19,80 @@
 
 //=========================== defines =========================================
 
-#define MARI_PACKET_QUEUE_SIZE (32)  // must be a power of 2
+#define MARI_PACKET_QUEUE_SIZE           (32)  // must be a power of 2, at most 128
+#define MARI_PACKET_QUEUE_HIGH_WATERMARK (24)  // MARI_TX_QUEUE_HIGH is sent when this many packets are queued
+#define MARI_PACKET_QUEUE_LOW_WATERMARK  (8)   // then MARI_TX_QUEUE_LOW, once the MAC drained the queue down to this many
+
+#define MARI_DOWNLINK_QUEUE_DEPTH_MAX (8)  // gateway: packets queued to a single destination, so that one node cannot take all the buffers
+#define MARI_DOWNLINK_QUANTUM         (1)  // gateway: downlink cells given to each destination per deficit round-robin round
+#define MARI_DOWNLINK_AGGREGATION     1    // gateway: whether small packets to several nodes share a downlink frame
 
 #define MARI_AUTO_UPLINK_KEEPALIVE 1  // whether to send a keepalive packet when there is nothing to send
+#define MARI_UPLINK_AGGREGATION    1  // node: whether to send the queued data packets together, as many as fit in one uplink frame
 
 //=========================== prototypes ======================================
 
-void    mr_queue_add(uint8_t *packet, uint8_t length);
-uint8_t mr_queue_next_packet(slot_type_t slot_type, uint8_t *packet);
-uint8_t mr_queue_peek(uint8_t *packet);
-bool    mr_queue_pop(void);
-void    mr_queue_reset(void);
+void mr_queue_init(mr_event_cb_t event_callback);
+
+/**
+ * @brief Adds a packet to the transmit queue, to be called by the application only.
+ *
+ * The application and the MAC exchange the packet buffers through two lock-free single-producer/single-consumer
+ * rings, one for the packets to send and one for the buffers to reuse. A full queue does not overwrite the oldest
+ * packets. At the gateway, the MAC sorts the packets per destination, and serves the destinations in deficit
+ * round-robin order, after the join responses.
+ *
+ * This copies the packet into a buffer of the queue, use mr_queue_get_buffer and mr_queue_commit to write it there
+ * directly instead.
+ *
+ * @param[in] packet            Packet to send
+ * @param[in] length            Length of the packet
+ *
+ * @return true if the packet was queued, false if the queue is full, or if the gateway already has
+ *         MARI_DOWNLINK_QUEUE_DEPTH_MAX packets queued to this destination
+ */
+bool mr_queue_add(uint8_t *packet, uint8_t length);
+
+/**
+ * @brief Gets the buffer of the next packet to send, to be called by the application only.
+ *
+ * The same buffer is returned until it is committed. It is followed all the way to the radio, which sends it in
+ * place, so the packet is written only once.
+ *
+ * @return a buffer of MARI_PACKET_MAX_SIZE bytes, NULL if the queue is full
+ */
+uint8_t *mr_queue_get_buffer(void);
+
+/**
+ * @brief Queues the packet written in the buffer given by mr_queue_get_buffer, to be called by the application only.
+ *
+ * @param[in] length            Length of the packet
+ *
+ * @return false if there was no buffer, or if the gateway already has MARI_DOWNLINK_QUEUE_DEPTH_MAX packets queued
+ *         to this destination, in which case the buffer is kept for the next packet
+ */
+bool mr_queue_commit(uint8_t length);
+
+/**
+ * @brief Gets the packet to send in a slot, to be called by the MAC only.
+ *
+ * The packet is lent to the MAC, and sent in place: its buffer has MR_RADIO_TX_HEADROOM bytes of headroom, and is
+ * not reused before mr_queue_release_packet, or the next call to this function.
+ *
+ * @param[in]  slot_type        Type of the slot
+ * @param[out] length           Length of the packet
+ *
+ * @return the packet, NULL if there is nothing to send
+ */
+uint8_t *mr_queue_next_packet(slot_type_t slot_type, uint8_t *length);
+void     mr_queue_release_packet(void);
+void     mr_queue_reset(void);
 
 // void mr_queue_set_join_packet(uint64_t node_id, mr_packet_type_t packet_type);
 void mr_queue_set_join_request(uint64_t node_id);
-void mr_queue_set_join_response(uint64_t node_id, uint8_t assigned_cell_id);
+void mr_queue_set_join_response(uint64_t node_id, uint16_t assigned_cell_id, bool compact_header);
 
-bool    mr_queue_has_join_packet(void);
-uint8_t mr_queue_get_join_packet(uint8_t *packet);
+bool     mr_queue_has_join_packet(void);
+uint8_t *mr_queue_get_join_packet(uint8_t *length);
 
 #endif  // __QUEUE_H
@@ -16,6 +16,8 @@
 #include <stdbool.h>
 
 #include "scan.h"
+#include "mac.h"
+#include "scheduler.h"
 
 //=========================== variables =======================================
 
@@ -28,110 +30,100 @@ scan_vars_t scan_vars = { 0 };
 //=========================== prototypes ======================================
 
 void              _save_rssi(size_t idx, mr_beacon_packet_header_t beacon, int8_t rssi, uint8_t channel, uint32_t ts_scan, uint64_t asn_scan);
+size_t            _get_or_add_gateway(uint64_t gateway_id, uint32_t ts);
+void              _link_add_rssi(mr_link_estimate_t *link, int8_t rssi, uint32_t ts);
+int32_t           _link_quality(const mr_link_estimate_t *link, uint8_t penalty);
 uint32_t          _get_ts_latest(mr_gateway_scan_t scan);
 mr_channel_info_t _get_channel_info_latest(mr_gateway_scan_t scan);
 bool              _scan_is_too_old(mr_gateway_scan_t scan, uint32_t ts_scan);
+uint32_t          _scan_max_age_us(void);
 
 //=========================== public ===========================================
 
-// This function is a bit more complicated than it needed to be, but by inserting the rssi reading
-// in a smart way, later it beacomes very easy and efficient to compute the average rssi.
-// It does a few things:
-// 1. If the gateway_id (beacon.src) is already in the scan list, update the rssi reading.
-// 2. Check for old rssi readings and remove them
-//   - meaning that the loop always goes through the whole list, but it's small, so it's fine.
-//   - and also, in most cases it will have to cycle through the whole list anyway, to find old readings to replace.
-// 3. Look for empty spots, in case the gateway_id is not yet in the list.
-// 4. Save the oldest reading, to be overwritten, in case there are no empty spots.
+// Save the beacon of a gateway on its channel, and add its rssi to the link estimate of the gateway.
+// A gateway that is not in the scan list yet takes an empty spot, or else the spot of the gateway heard from the longest ago.
 void mr_scan_add(mr_beacon_packet_header_t beacon, int8_t rssi, uint8_t channel, uint32_t ts_scan, uint64_t asn_scan) {
-    uint64_t gateway_id        = beacon.src;
-    bool     found             = false;
-    int16_t  empty_spot_idx    = -1;
-    uint32_t ts_oldest_all     = ts_scan;
-    uint32_t ts_oldest_all_idx = 0;
+    size_t idx = _get_or_add_gateway(beacon.src, ts_scan);
+    _save_rssi(idx, beacon, rssi, channel, ts_scan, asn_scan);
+    _link_add_rssi(&scan_vars.scans[idx].link, rssi, ts_scan);
+}
+
+// Select the gateway with the best link estimate among the ones heard during the scan, and report the estimate as its rssi.
+// Gateways with little remaining capacity rank a bit lower, and full ones are not added to the scan list at all.
+bool mr_scan_select(mr_channel_info_t *best_channel_info, uint32_t ts_scan_started, uint32_t ts_scan_ended) {
+    int8_t best_gateway_idx = -1;
+    // make sure best_channel_info is zeroed out
+    memset(best_channel_info, 0, sizeof(mr_channel_info_t));
+    int32_t best_gateway_quality = INT32_MIN;
     for (size_t i = 0; i < MARI_MAX_SCAN_LIST_SIZE; i++) {
-        // if found this gateway_id, update its respective rssi entry and mark as found.
-        if (scan_vars.scans[i].gateway_id == gateway_id) {
-            _save_rssi(i, beacon, rssi, channel, ts_scan, asn_scan);
-            found = true;
+        if (scan_vars.scans[i].gateway_id == 0) {
             continue;
         }
-
-        // try and save the first empty spot we see
-        // if gateway_id == 0, there is an empty spot here, save the index (will only do this once)
-        if (scan_vars.scans[i].gateway_id == 0 && empty_spot_idx < 0) {
-            empty_spot_idx = i;
+        // only consider gateways with a beacon from this scan, recent enough to sync to it
+        mr_channel_info_t latest = _get_channel_info_latest(scan_vars.scans[i]);
+        if (latest.timestamp == 0 || latest.timestamp < ts_scan_started || ts_scan_ended - latest.timestamp > _scan_max_age_us()) {
+            continue;
         }
-
-        uint32_t ts_cmp = _get_ts_latest(scan_vars.scans[i]);
-        if (scan_vars.scans[i].gateway_id != 0 && ts_cmp < ts_oldest_all) {
-            ts_oldest_all     = ts_cmp;
-            ts_oldest_all_idx = i;
+        uint8_t crowded = latest.beacon.remaining_capacity < MARI_SCAN_EARLY_END_CAPACITY ? MARI_LINK_CROWDED_PENALTY : 0;
+        int32_t quality = _link_quality(&scan_vars.scans[i].link, crowded);
+        if (quality > best_gateway_quality) {
+            best_gateway_quality = quality;
+            best_gateway_idx     = i;
         }
     }
-    if (found) {
-        // if found a matching gateway_id, nothing else to do
-        return;
-    } else {
-        // if not, find an optimal spot for saving this new rssi reading
-        //   either save it onto an empty spot, or override the oldest one
-        if (empty_spot_idx >= 0) {  // there is an empty spot
-            scan_vars.scans[empty_spot_idx].gateway_id = gateway_id;
-            _save_rssi(empty_spot_idx, beacon, rssi, channel, ts_scan, asn_scan);
-        } else {
-            // last case: didn't match the gateeway_id, and didn't find an empty slot,
-            // so overwrite the oldest reading
-            memset(&scan_vars.scans[ts_oldest_all_idx], 0, sizeof(mr_gateway_scan_t));
-            scan_vars.scans[ts_oldest_all_idx].gateway_id = gateway_id;
-            _save_rssi(ts_oldest_all_idx, beacon, rssi, channel, ts_scan, asn_scan);
-        }
+    if (best_gateway_idx < 0) {
+        return false;
     }
+    *best_channel_info      = _get_channel_info_latest(scan_vars.scans[best_gateway_idx]);
+    best_channel_info->rssi = best_gateway_quality / MARI_LINK_RSSI_SCALE;
+    return true;
 }
 
-// Compute the average rssi for each gateway, and return the highest one.
-// The documentation says that remaining capacity should also be taken into account,
-// but we will simply not add a gateway to the scan list if its capacity if full.
-bool mr_scan_select(mr_channel_info_t *best_channel_info, uint32_t ts_scan_started, uint32_t ts_scan_ended) {
-    int8_t best_gateway_idx = -1;
-    // make sure best_channel_info is zeroed out
-    memset(best_channel_info, 0, sizeof(mr_channel_info_t));
-    int8_t best_gateway_rssi = INT8_MIN;
+// Whether a gateway heard since the scan started is good enough to stop scanning: strong enough on a few
+// advertising channels, and with room to spare. The scan still lasts at least a slotframe of the schedule the gateway
+// advertises, so that a better gateway in range had the time to send its beacons too; mr_scan_select then picks the best.
+bool mr_scan_can_end_early(uint32_t ts_scan_started, uint32_t ts_now) {
     for (size_t i = 0; i < MARI_MAX_SCAN_LIST_SIZE; i++) {
         if (scan_vars.scans[i].gateway_id == 0) {
             continue;
         }
-        // compute average rssi, only including the rssi readings that are not too old
-        int8_t avg_rssi = 0;
-        int8_t n_rssi   = 0;
+        int16_t sum_rssi = 0;
+        uint8_t n_rssi   = 0;
         for (size_t j = 0; j < MARI_N_BLE_ADVERTISING_CHANNELS; j++) {
-            if (scan_vars.scans[i].channel_info[j].timestamp == 0) {  // no scan info reading here
+            if (scan_vars.scans[i].channel_info[j].timestamp == 0 || scan_vars.scans[i].channel_info[j].timestamp < ts_scan_started) {
                 continue;
             }
-            // check twice for old scans: scans from before this scan started, and scans older than the mari configuration
-            if (scan_vars.scans[i].channel_info[j].timestamp < ts_scan_started) {  // scan info is too old
-                continue;
-            }
-            if (ts_scan_ended - scan_vars.scans[i].channel_info[j].timestamp > MARI_SCAN_OLD_US) {  // scan info is is too old
-                continue;
-            }
-            avg_rssi += scan_vars.scans[i].channel_info[j].rssi;
+            sum_rssi += scan_vars.scans[i].channel_info[j].rssi;
             n_rssi++;
         }
-        if (n_rssi == 0) {
+        if (n_rssi < MARI_SCAN_EARLY_END_READINGS || sum_rssi < MARI_SCAN_EARLY_END_RSSI * n_rssi) {
             continue;
         }
-        avg_rssi /= n_rssi;
-        if (avg_rssi > best_gateway_rssi) {
-            best_gateway_rssi = avg_rssi;
-            best_gateway_idx  = i;
+        mr_channel_info_t latest = _get_channel_info_latest(scan_vars.scans[i]);
+        if (latest.beacon.remaining_capacity < MARI_SCAN_EARLY_END_CAPACITY) {
+            continue;
+        }
+        uint32_t slotframe_us = mr_scheduler_get_schedule_duration_us(latest.beacon.active_schedule_id);
+        if (slotframe_us != 0 && ts_now - ts_scan_started >= slotframe_us) {
+            return true;
         }
     }
-    if (best_gateway_idx < 0) {
-        return false;
+    return false;
+}
+
+// A frame from a gateway. Feeds the link estimate of the synced gateway, whose beacons do not go through mr_scan_add.
+void mr_scan_link_received(uint64_t gateway_id, int8_t rssi, uint32_t ts) {
+    _link_add_rssi(&scan_vars.scans[_get_or_add_gateway(gateway_id, ts)].link, rssi, ts);
+}
+
+// Link estimate of a gateway, in dBm: its average rssi. INT8_MIN if never heard.
+int8_t mr_scan_link_quality(uint64_t gateway_id) {
+    for (size_t i = 0; i < MARI_MAX_SCAN_LIST_SIZE; i++) {
+        if (scan_vars.scans[i].gateway_id == gateway_id && scan_vars.scans[i].link.timestamp != 0) {
+            return _link_quality(&scan_vars.scans[i].link, 0) / MARI_LINK_RSSI_SCALE;
+        }
     }
-    *best_channel_info = _get_channel_info_latest(scan_vars.scans[best_gateway_idx]);
-    // TODO: should probably report the average rssi: best_channel_info->rssi = best_gateway_rssi;
-    return true;
+    return INT8_MIN;
 }
 
 //=========================== private ==========================================
@@ -155,9 +147,57 @@ inline void _save_rssi(size_t idx, mr_beacon_packet_header_t beacon, int8_t rssi
     scan_vars.scans[idx].channel_info[channel_idx].beacon       = scan_beacon;
 }
 
+// index of the gateway in the scan list, added to an empty spot or over the gateway heard from the longest ago if needed,
+// but never over the synced gateway, which is only heard once per slotframe
+inline size_t _get_or_add_gateway(uint64_t gateway_id, uint32_t ts) {
+    int16_t  empty_spot_idx = -1;
+    uint32_t ts_oldest      = ts;
+    size_t   oldest_idx     = 0;
+    for (size_t i = 0; i < MARI_MAX_SCAN_LIST_SIZE; i++) {
+        if (scan_vars.scans[i].gateway_id == gateway_id) {
+            return i;
+        }
+        if (scan_vars.scans[i].gateway_id == 0) {
+            if (empty_spot_idx < 0) {
+                empty_spot_idx = i;
+            }
+            continue;
+        }
+        if (scan_vars.scans[i].link.timestamp < ts_oldest && scan_vars.scans[i].gateway_id != mr_mac_get_synced_gateway()) {
+            ts_oldest  = scan_vars.scans[i].link.timestamp;
+            oldest_idx = i;
+        }
+    }
+    size_t idx = empty_spot_idx >= 0 ? (size_t)empty_spot_idx : oldest_idx;
+    memset(&scan_vars.scans[idx], 0, sizeof(mr_gateway_scan_t));
+    scan_vars.scans[idx].gateway_id = gateway_id;
+    return idx;
+}
+
+inline void _link_add_rssi(mr_link_estimate_t *link, int8_t rssi, uint32_t ts) {
+    if (link->timestamp == 0 || ts - link->timestamp > MARI_LINK_OLD_US) {
+        // nothing recent to average with, start over from this reading
+        link->rssi = rssi * MARI_LINK_RSSI_SCALE;
+    } else {
+        link->rssi += (rssi * MARI_LINK_RSSI_SCALE - link->rssi) / MARI_LINK_RSSI_WEIGHT;
+    }
+    link->timestamp = ts;
+}
+
+// in 1/MARI_LINK_RSSI_SCALE dBm, down to INT8_MIN dBm, with an extra penalty in dB
+inline int32_t _link_quality(const mr_link_estimate_t *link, uint8_t penalty) {
+    int32_t quality = link->rssi - penalty * MARI_LINK_RSSI_SCALE;
+    return quality < INT8_MIN * MARI_LINK_RSSI_SCALE ? INT8_MIN * MARI_LINK_RSSI_SCALE : quality;
+}
+
 inline bool _scan_is_too_old(mr_gateway_scan_t scan, uint32_t ts_scan) {
     uint32_t ts_latest = _get_ts_latest(scan);
-    return (ts_scan - ts_latest) > MARI_SCAN_OLD_US;
+    return (ts_scan - ts_latest) > _scan_max_age_us();
+}
+
+// a gateway only sends beacons once per slotframe, which can last longer than MARI_SCAN_OLD_US with large schedules
+inline uint32_t _scan_max_age_us(void) {
+    return MARI_SCAN_MAX_DURATION > MARI_SCAN_OLD_US ? MARI_SCAN_MAX_DURATION : MARI_SCAN_OLD_US;
 }
 
 inline uint32_t _get_ts_latest(mr_gateway_scan_t scan) {
@@ -21,10 +21,27 @@
 
 //=========================== defines =========================================
 
-#define MARI_MAX_SCAN_LIST_SIZE       (5)
-#define MARI_SCAN_OLD_US              (1000 * 500)       // rssi reading considered old after 500 ms
-#define MARI_HANDOVER_RSSI_HYSTERESIS (24)               // hysteresis (in dBm) for handover
-#define MARI_HANDOVER_MIN_INTERVAL    (1000 * 1000 * 5)  // minimum interval between handovers (in us)
+#define MARI_MAX_SCAN_LIST_SIZE    (5)
+#define MARI_SCAN_OLD_US           (1000 * 500)       // rssi reading considered old after 500 ms
+#define MARI_HANDOVER_HYSTERESIS   (8)                // how much better (in dB) the link with another gateway must be to hand over to it
+#define MARI_HANDOVER_MIN_INTERVAL (1000 * 1000 * 5)  // minimum interval between handovers (in us)
+
+// link estimator, per gateway: moving average of the rssi. Beacon losses are left out, they can only be counted with the
+// synced gateway, and would not compare with the other gateways, only heard now and then during background scans.
+#define MARI_LINK_RSSI_SCALE      (16)               // the average rssi is kept in 1/16 dBm
+#define MARI_LINK_RSSI_WEIGHT     (8)                // each reading counts for 1/8 of the average rssi
+#define MARI_LINK_OLD_US          (1000 * 1000 * 2)  // an estimate not updated for 2 s starts over from the next reading
+#define MARI_LINK_CROWDED_PENALTY (3)                // dB taken off a gateway with less than MARI_SCAN_EARLY_END_CAPACITY remaining
+
+// a scan ends as soon as a gateway is good enough, and was scanned for a whole slotframe of its schedule, during which
+// the other gateways in range sent their beacons too; the background scan finds a better one later if there is
+#define MARI_SCAN_EARLY_END_RSSI     (-70)  // minimum average rssi (in dBm)
+#define MARI_SCAN_EARLY_END_CAPACITY (2)    // minimum remaining capacity, room for another node joining at the same time
+#ifdef MARI_FIXED_SCAN_CHANNEL
+#define MARI_SCAN_EARLY_END_READINGS (1)
+#else
+#define MARI_SCAN_EARLY_END_READINGS (2)  // on two channels, so that a single faded channel does not decide
+#endif
 
 //=========================== variables =======================================
 
@@ -35,7 +52,7 @@ typedef struct __attribute__((packed)) {
     uint16_t         network_id;
     uint64_t         asn;
     uint64_t         src;
-    uint8_t          remaining_capacity;
+    uint16_t         remaining_capacity;
     uint8_t          active_schedule_id;
 } mr_beacon_scan_header_t;
 
@@ -47,8 +64,15 @@ typedef struct {
 } mr_channel_info_t;
 
 typedef struct {
-    uint64_t          gateway_id;
-    mr_channel_info_t channel_info[MARI_N_BLE_ADVERTISING_CHANNELS];  // channels 37, 38, 39
+    int16_t  rssi;       ///< Average rssi, in 1/MARI_LINK_RSSI_SCALE dBm
+    uint32_t timestamp;  ///< Last reading
+} mr_link_estimate_t;
+
+// the scan list keeps the gateways heard, with the last beacon on each channel to sync to them
+typedef struct {
+    uint64_t           gateway_id;
+    mr_link_estimate_t link;
+    mr_channel_info_t  channel_info[MARI_N_BLE_ADVERTISING_CHANNELS];  // channels 37, 38, 39
 } mr_gateway_scan_t;
 
 //=========================== prototypes ======================================
@@ -57,4 +81,9 @@ void mr_scan_add(mr_beacon_packet_header_t beacon, int8_t rssi, uint8_t channel,
 
 bool mr_scan_select(mr_channel_info_t *best_channel_info, uint32_t ts_scan_started, uint32_t ts_scan_ended);
 
+bool mr_scan_can_end_early(uint32_t ts_scan_started, uint32_t ts_now);
+
+void   mr_scan_link_received(uint64_t gateway_id, int8_t rssi, uint32_t ts);
+int8_t mr_scan_link_quality(uint64_t gateway_id);
+
 #endif  // __SCAN_H
@@ -9,6 +9,7 @@
  * @copyright Inria, 2025
  */
 #include <nrf.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -24,20 +25,92 @@
 
 //=========================== defines ==========================================
 
+#if MARI_N_UPLINKS_MAX <= 153
+#define MARI_NODE_INDEX_BITS 8  // the size is a power of two, which keeps the load factor of the node index below 0.6
+#else
+#define MARI_NODE_INDEX_BITS 10
+#endif
+#define MARI_NODE_INDEX_SIZE (1 << MARI_NODE_INDEX_BITS)
+#define MARI_NODE_INDEX_EMPTY (-1)
+
+#define MARI_FREE_UPLINKS_WORDS ((MARI_N_UPLINKS_MAX + 31) / 32)  // at most 32, so that the summary fits a single word: MARI_N_UPLINKS_MAX <= 1024
+
+// occupancy beacons: number of bytes of the bitmap, the bitmap of the uplinks, then the tag of each node of an occupied uplink
+#define MARI_OCCUPANCY_LENGTH(n_uplinks, n_occupied) (1 + ((n_uplinks) + 7) / 8 + (n_occupied))
+#define MARI_OCCUPANCY_TAG(bloom_h2)                 ((uint8_t)(bloom_h2))  // tells apart a node from the one that took its uplink after it left
+
+#define MARI_EXPIRY_WHEEL_SIZE 256  // power of two, nodes expiring further away than this stay in their bucket for more turns
+
+#define MARI_SCHEDULE_BACKOFF_N_MIN  5   // same as the built-in schedules
+#define MARI_SCHEDULE_BACKOFF_N_MAX  9   // same as the built-in schedules
+#define MARI_SCHEDULE_CHANNEL_STRIDE 16  // channels between consecutive cells of a built schedule, about 32 MHz
+
+#define MARI_SCHEDULE_SWITCH_SLOTFRAMES 3   // slotframes between the decision to switch schedules and the switch, for the nodes to hear it in a beacon
+#define MARI_SCHEDULE_GROW_PERCENT      75  // grow the schedule when more than this share of its nodes are assigned
+#define MARI_SCHEDULE_TARGET_PERCENT    50  // switch to the smallest schedule where at most this share of the nodes are assigned
+
+#define MARI_ROLE_GATEWAY 0  // index of the gateway slot actions
+#define MARI_ROLE_NODE    1  // index of the node slot actions
+#define MARI_N_ROLES      2
+
 //=========================== variables ========================================
 
+// what a device does in a cell, computed once per role when a schedule is activated
 typedef struct {
-    // counters and indexes
-    schedule_t *active_schedule_ptr;  // pointer to the currently active schedule
-    uint32_t    slotframe_counter;    // used to cycle beacon channels through slotframes (when listening for beacons at uplink slot_durations)
-
-    uint8_t num_assigned_uplink_nodes;  // number of nodes with assigned uplink slots
+    uint8_t radio_action;  // mr_radio_action_t, stored on a single byte
+    uint8_t channel;       // channel offset modulo MARI_N_BLE_REGULAR_CHANNELS, or a fixed advertising channel when above it
+} slot_action_t;
 
-    size_t current_cell_index;  // index of the current cell
+typedef struct {
+    // counters and indexes
+    const schedule_t *active_schedule_ptr;  // pointer to the currently active schedule
+    uint32_t          slotframe_counter;    // used to cycle beacon channels through slotframes (when listening for beacons at uplink slot_durations)
+
+    uint16_t num_assigned_uplink_nodes;  // number of nodes with assigned uplink slots
+
+    size_t   current_cell_index;           // index of the current cell
+    uint64_t current_asn;                  // asn of the last tick
+    uint8_t  current_channel_base;         // current_asn modulo MARI_N_BLE_REGULAR_CHANNELS
+    uint8_t  current_advertising_channel;  // current_asn modulo MARI_N_BLE_ADVERTISING_CHANNELS
+    bool     counters_valid;               // false until the first tick on the active schedule
+
+    // radio action and channel of each cell of the active schedule, for each role
+    slot_action_t slot_actions[MARI_N_ROLES][MARI_N_CELLS_MAX];
+
+    // layout of the active schedule, computed when it is activated
+    int16_t  cell_to_uplink[MARI_N_CELLS_MAX];    // uplink number of each cell, -1 if the cell is not an uplink
+    int16_t  uplink_to_cell[MARI_N_UPLINKS_MAX];  // cell index of each uplink number
+    size_t   n_uplinks;
+    uint32_t duration_us;                         // duration of the slotframe, each slot lasting as long as its type
+    bool     occupancy_beacon;                    // whether the beacons carry the occupancy of the uplinks, rather than a bloom filter
+
+    // node: uplink number assigned at join, valid while the node owns it
+    uint16_t node_uplink;
+
+    // mutable state of the uplink cells of the active schedule, indexed by uplink number
+    uplink_t uplinks[MARI_N_UPLINKS_MAX];
+
+    // gateway: open-addressing (linear probing) hash index, node_id -> uplink number
+    int16_t node_index[MARI_NODE_INDEX_SIZE];
+    // gateway: one bit per uplink, set when the uplink is not assigned to any node
+    uint32_t free_uplinks[MARI_FREE_UPLINKS_WORDS];
+    uint32_t free_uplinks_summary;  // one bit per word of free_uplinks, set when it has at least one free uplink
+    // gateway: one bit per uplink, set when its node expired, as the uplink may be jammed (e.g. by a node of another gateway)
+    uint32_t silent_uplinks[MARI_FREE_UPLINKS_WORDS];
+    // gateway: hashed timing wheel of the assigned uplinks, bucketed by the ASN at which their node expires
+    int16_t expiry_wheel[MARI_EXPIRY_WHEEL_SIZE];  // first uplink of each bucket
+    int16_t expiry_next[MARI_N_UPLINKS_MAX];
+    int16_t expiry_prev[MARI_N_UPLINKS_MAX];
+
+    // pending switch to another schedule, which keeps the nodes on the same uplink numbers
+    const schedule_t *next_schedule_ptr;  // NULL when no switch is pending
+    uint64_t          switch_asn;         // asn of the first slot of the next schedule
+    size_t            next_n_uplinks;     // number of uplinks of the next schedule
 
     // static data
-    schedule_t *available_schedules[MARI_N_SCHEDULES];
-    size_t      available_schedules_len;
+    const schedule_t *available_schedules[MARI_N_SCHEDULES];
+    size_t            available_schedules_len;
+    const schedule_t *configured_schedule_ptr;  // schedule passed at init, the largest one the gateway switches to
 } schedule_vars_t;
 
 typedef struct {
@@ -51,20 +124,44 @@ static schedule_stats_t _schedule_stats = { 0 };
 //========================== prototypes ========================================
 
 // compute the radio action when the node is a gateway
-void _compute_gateway_action(cell_t cell, mr_slot_info_t *slot_info);
+mr_radio_action_t _compute_gateway_action(const cell_t *cell);
 
 // compute the radio action when the node is an end device
-void _compute_node_action(cell_t cell, mr_slot_info_t *slot_info);
+mr_radio_action_t _compute_node_action(const cell_t *cell, size_t cell_index);
 
 // encode the schedule usage stats
 void _encode_schedule_usage_stats(uint8_t cell_index, uint8_t radio_action);
 
+// activate a schedule: compute its layout, and start with all its uplinks free
+static void              _activate(const schedule_t *schedule);
+static void              _remap(const schedule_t *schedule, uint64_t asn);
+static const schedule_t *_find_schedule(uint8_t schedule_id);
+static size_t            _count_uplinks(const schedule_t *schedule);
+static bool              _uses_occupancy_beacon(size_t n_uplinks);
+static size_t            _beacon_length(size_t n_uplinks);
+static void              _build_slot_actions(void);
+static bool              _is_my_cell(size_t cell_index);
+
+// maintain the free uplinks, the node_id -> uplink hash index and the expiry wheel at the gateway
+static void     _release_uplink(int16_t uplink);
+static void     _free_uplinks_set(int16_t uplink);
+static void     _free_uplinks_clear(int16_t uplink);
+static int16_t  _first_free_uplink(void);
+static int16_t  _node_index_find(uint64_t node_id);
+static void     _node_index_insert(int16_t uplink);
+static void     _node_index_remove(uint64_t node_id);
+static size_t   _node_index_home(uint64_t node_id);
+static uint64_t _expiry_asn(int16_t uplink);
+static void     _expiry_insert(int16_t uplink);
+static void     _expiry_remove(int16_t uplink);
+
 //=========================== public ===========================================
 
-void mr_scheduler_init(schedule_t *application_schedule) {
+void mr_scheduler_init(const schedule_t *application_schedule) {
 
-    if (_schedule_vars.available_schedules_len == MARI_N_SCHEDULES)
-        return;  // FIXME: this is just to simplify debugging (allows calling init multiple times)
+    // init may be called multiple times (debugging, benchmarks): the list of schedules is rebuilt,
+    // and the application schedule of the last call replaces the previous one
+    _schedule_vars.available_schedules_len = 0;
 
     // FIXME: schedules only used for debugging
     //_schedule_vars.available_schedules[_schedule_vars.available_schedules_len++] = schedule_test;
@@ -76,44 +173,156 @@ void mr_scheduler_init(schedule_t *application_schedule) {
 
     if (application_schedule != NULL) {
         _schedule_vars.available_schedules[_schedule_vars.available_schedules_len++] = application_schedule;
-        _schedule_vars.active_schedule_ptr                                           = application_schedule;
+        _schedule_vars.configured_schedule_ptr                                        = application_schedule;
+        _activate(application_schedule);
     }
 }
 
 bool mr_scheduler_set_schedule(uint8_t schedule_id) {
-    for (size_t i = 0; i < MARI_N_SCHEDULES; i++) {
-        if (_schedule_vars.available_schedules[i]->id == schedule_id) {
-            _schedule_vars.active_schedule_ptr = _schedule_vars.available_schedules[i];
-            return true;
+    const schedule_t *schedule = _find_schedule(schedule_id);
+    if (schedule == NULL) {
+        return false;
+    }
+    _schedule_vars.next_schedule_ptr = NULL;  // a switch announced by the previous gateway
+    if (schedule != _schedule_vars.active_schedule_ptr) {
+        _activate(schedule);
+    }
+    return true;
+}
+
+bool mr_scheduler_switch_schedule(uint8_t schedule_id, uint64_t switch_asn) {
+    const schedule_t *schedule = _find_schedule(schedule_id);
+    if (schedule == NULL) {
+        return false;
+    }
+    if (switch_asn == 0) {
+        // right away, e.g. the announcement was missed
+        if (schedule != _schedule_vars.active_schedule_ptr) {
+            _remap(schedule, _schedule_vars.current_asn);
         }
+        _schedule_vars.next_schedule_ptr = NULL;
+        return true;
     }
-    return false;
+    _schedule_vars.next_schedule_ptr = schedule;
+    _schedule_vars.switch_asn        = switch_asn;
+    _schedule_vars.next_n_uplinks    = _count_uplinks(schedule);
+    return true;
+}
+
+uint64_t mr_scheduler_get_pending_switch(uint8_t *next_schedule_id) {
+    if (_schedule_vars.next_schedule_ptr == NULL) {
+        *next_schedule_id = 0;
+        return 0;
+    }
+    *next_schedule_id = _schedule_vars.next_schedule_ptr->id;
+    return _schedule_vars.switch_asn;
 }
 
 uint32_t mr_scheduler_get_duration_us(void) {
-    return MARI_WHOLE_SLOT_DURATION * _schedule_vars.active_schedule_ptr->n_cells;
+    return _schedule_vars.duration_us;
+}
+
+uint32_t mr_scheduler_get_schedule_duration_us(uint8_t schedule_id) {
+    const schedule_t *schedule = _find_schedule(schedule_id);
+    if (schedule == NULL) {
+        return 0;
+    }
+    // the beacon slots of the active schedule are sized for its beacons, compute those of this one the same way
+    uint32_t beacon_slot_us = MARI_BEACON_SLOT_DURATION_OF(_beacon_length(_count_uplinks(schedule)));
+    uint32_t duration_us    = 0;
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        if (schedule->cells[i].type == SLOT_TYPE_BEACON) {
+            duration_us += beacon_slot_us;
+        } else {
+            duration_us += mr_mac_get_slot_durations(schedule->cells[i].type)->whole_slot;
+        }
+    }
+    return duration_us;
+}
+
+bool mr_scheduler_build_schedule(schedule_t *schedule, const mr_schedule_params_t *params) {
+    if (params->n_beacons == 0 || params->n_uplinks == 0 || params->uplinks_per_downlink == 0 || params->uplinks_per_shared == 0) {
+        return false;
+    }
+    int32_t n_downlinks = (params->n_uplinks + params->uplinks_per_downlink - 1) / params->uplinks_per_downlink;
+    int32_t n_shared    = (params->n_uplinks + params->uplinks_per_shared - 1) / params->uplinks_per_shared;
+    if (n_downlinks < n_shared) {
+        n_downlinks = n_shared;  // every shared uplink cell is followed by a downlink cell, for the join response
+    }
+    int32_t n_regular = params->n_uplinks + n_downlinks + n_shared;
+    if (params->n_uplinks > MARI_N_UPLINKS_MAX || params->n_beacons + n_regular > MARI_N_CELLS_MAX) {
+        return false;
+    }
+
+    memset(schedule, 0, sizeof(schedule_t));
+    schedule->id            = params->id;
+    schedule->max_nodes     = params->n_uplinks;
+    schedule->backoff_n_min = MARI_SCHEDULE_BACKOFF_N_MIN;
+    schedule->backoff_n_max = MARI_SCHEDULE_BACKOFF_N_MAX;
+    schedule->n_cells       = params->n_beacons + n_regular;
+
+    // begin with beacon cells, they use their own channel offsets and frequencies
+    size_t cell_index = 0;
+    for (; cell_index < params->n_beacons; cell_index++) {
+        schedule->cells[cell_index] = (cell_t){ .type = SLOT_TYPE_BEACON, .channel_offset = cell_index };
+    }
+
+    // continue with regular cells: uplinks, shared uplink + downlink pairs and the remaining downlinks,
+    // picked by smooth weighted round robin so that each of them is spread evenly
+    const int32_t weights[]  = { params->n_uplinks, n_shared, n_downlinks - n_shared };
+    int32_t       credits[3] = { 0 };
+    int32_t       n_picks    = weights[0] + weights[1] + weights[2];
+    for (int32_t i = 0; i < n_picks; i++) {
+        size_t pick = 0;
+        for (size_t t = 0; t < 3; t++) {
+            credits[t] += weights[t];
+            if (credits[t] > credits[pick]) {
+                pick = t;
+            }
+        }
+        credits[pick] -= n_picks;
+        if (pick == 0) {
+            schedule->cells[cell_index++].type = SLOT_TYPE_UPLINK;
+        } else if (pick == 1) {
+            // the join response is sent in the slot right after the join request
+            schedule->cells[cell_index++].type = SLOT_TYPE_SHARED_UPLINK;
+            schedule->cells[cell_index++].type = SLOT_TYPE_DOWNLINK;
+        } else {
+            schedule->cells[cell_index++].type = SLOT_TYPE_DOWNLINK;
+        }
+    }
+
+    // the channel of the next slot is always MARI_SCHEDULE_CHANNEL_STRIDE channels away, since the asn also advances by one
+    for (size_t i = params->n_beacons; i < schedule->n_cells; i++) {
+        schedule->cells[i].channel_offset = ((i - params->n_beacons) * (MARI_SCHEDULE_CHANNEL_STRIDE - 1)) % MARI_N_BLE_REGULAR_CHANNELS;
+    }
+    return true;
 }
 
 // ------------ node functions ------------
 
 // to be called at the NODE when processing a JOIN_RESPONSE
 bool mr_scheduler_node_assign_myself_to_cell(uint16_t cell_index) {
-    for (size_t i = 0; i < _schedule_vars.active_schedule_ptr->n_cells; i++) {
-        cell_t *cell = &_schedule_vars.active_schedule_ptr->cells[i];
-        if (cell->type == SLOT_TYPE_UPLINK && i == cell_index) {
-            cell->assigned_node_id = mr_device_id();
-            return true;
-        }
+    if (cell_index >= _schedule_vars.active_schedule_ptr->n_cells || _schedule_vars.cell_to_uplink[cell_index] < 0) {
+        return false;
     }
-    return false;
+    _schedule_vars.node_uplink                                                         = _schedule_vars.cell_to_uplink[cell_index];
+    _schedule_vars.uplinks[_schedule_vars.cell_to_uplink[cell_index]].assigned_node_id = mr_device_id();
+    _schedule_vars.slot_actions[MARI_ROLE_NODE][cell_index].radio_action                = MARI_RADIO_ACTION_TX;
+    return true;
+}
+
+int16_t mr_scheduler_node_get_uplink(void) {
+    return mr_scheduler_node_owns_uplink(_schedule_vars.node_uplink) ? (int16_t)_schedule_vars.node_uplink : -1;
 }
 
 void mr_scheduler_node_deassign_myself_from_schedule(void) {
-    for (size_t i = 0; i < _schedule_vars.active_schedule_ptr->n_cells; i++) {
-        cell_t *cell = &_schedule_vars.active_schedule_ptr->cells[i];
-        if (cell->type == SLOT_TYPE_UPLINK && cell->assigned_node_id == mr_device_id()) {
-            cell->assigned_node_id  = NULL;
-            cell->last_received_asn = 0;
+    for (size_t i = 0; i < _schedule_vars.n_uplinks; i++) {
+        uplink_t *uplink = &_schedule_vars.uplinks[i];
+        if (uplink->assigned_node_id == mr_device_id()) {
+            uplink->assigned_node_id  = 0;
+            uplink->last_received_asn = 0;
+            _schedule_vars.slot_actions[MARI_ROLE_NODE][_schedule_vars.uplink_to_cell[i]].radio_action = MARI_RADIO_ACTION_SLEEP;
         }
     }
 }
@@ -122,74 +331,287 @@ void mr_scheduler_node_deassign_myself_from_schedule(void) {
 
 // to be called at the GATEWAY when processing a JOIN_REQUEST
 int16_t mr_scheduler_gateway_assign_next_available_uplink_cell(uint64_t node_id, uint64_t asn) {
-    for (size_t i = 0; i < _schedule_vars.active_schedule_ptr->n_cells; i++) {
-        cell_t *cell = &_schedule_vars.active_schedule_ptr->cells[i];
-        if (cell->type == SLOT_TYPE_UPLINK && cell->assigned_node_id == 0) {
-            // the cell is available, so we can assign it to the node
-            cell->assigned_node_id  = node_id;
-            cell->last_received_asn = asn;
-            // pre-compute the bloom filter hashes
-            cell->bloom_h1 = mr_bloom_hash_fnv1a64(node_id);
-            cell->bloom_h2 = mr_bloom_hash_fnv1a64(node_id ^ MARI_BLOOM_FNV1A_H2_SALT);
-            _schedule_vars.num_assigned_uplink_nodes++;
-            return i;
-        } else if (cell->type == SLOT_TYPE_UPLINK && cell->assigned_node_id == node_id) {
-            // the node re-connected before the gateway could detect it was gone,
-            // probably because of a collision on the join response (donwlink)
-            // so we can just keep the same cell_id, but we still need to update the last_received_asn
-            cell->last_received_asn = asn;
-            return i;
-        }
+    int16_t cell_index = mr_scheduler_gateway_get_node_cell(node_id);
+    if (cell_index >= 0) {
+        // the node re-connected before the gateway could detect it was gone,
+        // probably because of a collision on the join response (donwlink)
+        // so we can just keep the same cell_id, but we still need to update the last_received_asn
+        mr_scheduler_gateway_keep_cell_alive(cell_index, asn);
+        return cell_index;
     }
-    return -1;
+
+    if (_schedule_vars.free_uplinks_summary == 0) {
+        return -1;  // no free uplink cell
+    }
+
+    // first fit: the free uplink with the lowest number, which is also the one with the lowest cell index
+    // a silent uplink only when no other is free, so that the node that expired there does not get it back
+    int16_t i = _first_free_uplink();
+    if (_schedule_vars.next_schedule_ptr != NULL && (size_t)i >= _schedule_vars.next_n_uplinks) {
+        return -1;  // the uplink does not exist in the schedule the gateway is about to switch to
+    }
+    uplink_t *uplink = &_schedule_vars.uplinks[i];
+    // the cell is available, so we can assign it to the node
+    uplink->assigned_node_id  = node_id;
+    uplink->last_received_asn = asn;
+    // pre-compute the bloom filter hashes
+    uplink->bloom_h1 = mr_bloom_hash_fnv1a64(node_id);
+    uplink->bloom_h2 = mr_bloom_hash_fnv1a64(node_id ^ MARI_BLOOM_FNV1A_H2_SALT);
+    mr_bloom_gateway_add(uplink->bloom_h1, uplink->bloom_h2);
+    _free_uplinks_clear(i);
+    _schedule_vars.silent_uplinks[i / 32] &= ~((uint32_t)1 << (i % 32));
+    _node_index_insert(i);
+    _expiry_insert(i);
+    _schedule_vars.num_assigned_uplink_nodes++;
+    return _schedule_vars.uplink_to_cell[i];
 }
 
 // to be called at the GATEWAY when a node leaves
-inline void mr_scheduler_gateway_decrease_nodes_counter(void) {
-    _schedule_vars.num_assigned_uplink_nodes--;
+void mr_scheduler_gateway_deassign_cell(int16_t cell_index) {
+    _release_uplink(_schedule_vars.cell_to_uplink[cell_index]);
+}
+
+// to be called at the GATEWAY for every received packet, returns -1 if the node has no cell
+int16_t mr_scheduler_gateway_get_node_cell(uint64_t node_id) {
+    int16_t uplink = _node_index_find(node_id);
+    return uplink >= 0 ? _schedule_vars.uplink_to_cell[uplink] : -1;
+}
+
+int16_t mr_scheduler_gateway_get_node_uplink(uint64_t node_id) {
+    return _node_index_find(node_id);
+}
+
+// returns the id of the node assigned to an uplink, 0 if there is none
+uint64_t mr_scheduler_gateway_get_uplink_node(uint16_t uplink) {
+    return uplink < _schedule_vars.n_uplinks ? _schedule_vars.uplinks[uplink].assigned_node_id : 0;
+}
+
+// to be called at the GATEWAY when processing a JOIN_REQUEST, after assigning a cell to the node
+void mr_scheduler_gateway_set_node_compact_header(uint64_t node_id, bool compact_header) {
+    int16_t uplink = _node_index_find(node_id);
+    if (uplink >= 0) {
+        _schedule_vars.uplinks[uplink].compact_header = compact_header;
+    }
+}
+
+bool mr_scheduler_gateway_uplink_has_compact_header(uint16_t uplink) {
+    return uplink < _schedule_vars.n_uplinks && _schedule_vars.uplinks[uplink].compact_header;
+}
+
+bool mr_scheduler_uses_occupancy_beacon(void) {
+    return _schedule_vars.occupancy_beacon;
+}
+
+size_t mr_scheduler_gateway_copy_occupancy(uint8_t *output) {
+    size_t   n_uplinks  = _schedule_vars.n_uplinks;
+    size_t   bitmap_len = (n_uplinks + 7) / 8;
+    uint8_t *tags       = output + 1 + bitmap_len;
+
+    output[0] = bitmap_len;
+    for (size_t i = 0; i < bitmap_len; i++) {
+        // the occupied uplinks are the ones that are not free, 8 at a time
+        uint8_t occupied = ~(_schedule_vars.free_uplinks[i / 4] >> (8 * (i % 4)));
+        if (i == bitmap_len - 1 && n_uplinks % 8 != 0) {
+            occupied &= (1 << (n_uplinks % 8)) - 1;
+        }
+        output[1 + i] = occupied;
+        for (; occupied != 0; occupied &= occupied - 1) {
+            *tags++ = MARI_OCCUPANCY_TAG(_schedule_vars.uplinks[i * 8 + __builtin_ctz(occupied)].bloom_h2);
+        }
+    }
+    return tags - output;
+}
+
+bool mr_scheduler_node_in_occupancy(const uint8_t *occupancy, size_t length) {
+    int16_t uplink = mr_scheduler_node_get_uplink();
+    if (uplink < 0 || length == 0) {
+        return false;
+    }
+    size_t bitmap_len = occupancy[0];
+    if ((size_t)uplink >= bitmap_len * 8 || 1 + bitmap_len > length) {
+        return false;
+    }
+
+    const uint8_t *bitmap = occupancy + 1;
+    uint8_t        mask   = 1 << (uplink % 8);
+    if ((bitmap[uplink / 8] & mask) == 0) {
+        return false;
+    }
+
+    // the tags follow the bitmap, in the order of the occupied uplinks
+    size_t rank = __builtin_popcount(bitmap[uplink / 8] & (mask - 1));
+    for (size_t i = 0; i < (size_t)uplink / 8; i++) {
+        rank += __builtin_popcount(bitmap[i]);
+    }
+    size_t tag_index = 1 + bitmap_len + rank;
+    return tag_index < length && occupancy[tag_index] == MARI_OCCUPANCY_TAG(mr_bloom_node_get_h2());
+}
+
+// to be called at the GATEWAY when a packet is received from the node assigned to the cell
+void mr_scheduler_gateway_keep_cell_alive(int16_t cell_index, uint64_t asn) {
+    int16_t uplink = _schedule_vars.cell_to_uplink[cell_index];
+    _expiry_remove(uplink);
+    _schedule_vars.uplinks[uplink].last_received_asn = asn;
+    _expiry_insert(uplink);
+}
+
+// to be called at the GATEWAY on every slot, frees the cell of a node expiring at this asn and returns its id, or 0 if there is none
+uint64_t mr_scheduler_gateway_pop_expired_node(uint64_t asn) {
+    // only the bucket of this asn can hold expired nodes, the others are checked at their own asn
+    int16_t uplink = _schedule_vars.expiry_wheel[asn & (MARI_EXPIRY_WHEEL_SIZE - 1)];
+    while (uplink != MARI_NODE_INDEX_EMPTY) {
+        if (_expiry_asn(uplink) <= asn) {
+            uint64_t node_id = _schedule_vars.uplinks[uplink].assigned_node_id;
+            _release_uplink(uplink);
+            _schedule_vars.silent_uplinks[uplink / 32] |= (uint32_t)1 << (uplink % 32);
+            return node_id;
+        }
+        uplink = _schedule_vars.expiry_next[uplink];  // expires on a later turn of the wheel
+    }
+    return 0;
 }
 
 // to be called at the GATEWAY to build a beacon
-uint8_t mr_scheduler_gateway_remaining_capacity(void) {
-    return _schedule_vars.active_schedule_ptr->max_nodes - _schedule_vars.num_assigned_uplink_nodes;
+uint16_t mr_scheduler_gateway_remaining_capacity(uint64_t asn) {
+    if (mr_scheduler_gateway_is_switching(asn)) {
+        return 0;  // join requests are dropped until the switch
+    }
+    // only what can be assigned now, even if an adaptive schedule would grow later
+    uint16_t max_nodes = _schedule_vars.active_schedule_ptr->max_nodes;
+    if (_schedule_vars.next_schedule_ptr != NULL && _schedule_vars.next_schedule_ptr->max_nodes < max_nodes) {
+        max_nodes = _schedule_vars.next_schedule_ptr->max_nodes;  // uplinks past the next schedule are not assigned
+    }
+    if (_schedule_vars.num_assigned_uplink_nodes >= max_nodes) {
+        return 0;
+    }
+    return max_nodes - _schedule_vars.num_assigned_uplink_nodes;
+}
+
+// to be called at the GATEWAY on every slot, before the tick
+void mr_scheduler_gateway_adapt_schedule(uint64_t asn) {
+#if MARI_ENABLE_ADAPTIVE_SCHEDULE
+    const schedule_t *active = _schedule_vars.active_schedule_ptr;
+    if (_schedule_vars.configured_schedule_ptr == NULL || _schedule_vars.next_schedule_ptr != NULL) {
+        return;
+    }
+    if (!_schedule_vars.counters_valid || _schedule_vars.current_asn + 1 != asn || _schedule_vars.current_cell_index + 1 != active->n_cells) {
+        return;  // only decide at the beginning of a slotframe
+    }
+
+    // the smallest schedule that is at most half full, or the configured one
+    uint32_t          n_nodes = _schedule_vars.num_assigned_uplink_nodes;
+    const schedule_t *target  = _schedule_vars.configured_schedule_ptr;
+    for (size_t i = 0; i < _schedule_vars.available_schedules_len; i++) {
+        const schedule_t *candidate = _schedule_vars.available_schedules[i];
+        if (candidate->max_nodes < target->max_nodes && n_nodes * 100 <= candidate->max_nodes * MARI_SCHEDULE_TARGET_PERCENT) {
+            target = candidate;
+        }
+    }
+    if (target == active) {
+        return;
+    }
+    if (target->max_nodes > active->max_nodes) {
+        if (n_nodes * 100 <= active->max_nodes * MARI_SCHEDULE_GROW_PERCENT) {
+            return;  // not loaded enough to grow yet, keeps the schedule from flapping
+        }
+    } else {
+        // nodes keep their uplink number, so all of them must fit in the smaller schedule
+        size_t target_n_uplinks = _count_uplinks(target);
+        for (size_t i = target_n_uplinks; i < _schedule_vars.n_uplinks; i++) {
+            if (_schedule_vars.uplinks[i].assigned_node_id != 0) {
+                return;
+            }
+        }
+    }
+
+    // switch at the beginning of a slotframe of the target schedule, after the nodes had time to hear about it
+    uint64_t switch_asn = asn + MARI_SCHEDULE_SWITCH_SLOTFRAMES * active->n_cells;
+    switch_asn += (target->n_cells - switch_asn % target->n_cells) % target->n_cells;
+    mr_scheduler_switch_schedule(target->id, switch_asn);
+#else
+    (void)asn;
+#endif
+}
+
+// to be called at the GATEWAY when a join request is received
+bool mr_scheduler_gateway_is_switching(uint64_t asn) {
+    // the join response might only be sent after the switch, when the cell it carries means something else
+    return _schedule_vars.next_schedule_ptr != NULL && asn + _schedule_vars.active_schedule_ptr->n_cells >= _schedule_vars.switch_asn;
 }
 
 // to be called at the GATEWAY to build a beacon
-uint8_t mr_scheduler_gateway_get_nodes_count(void) {
+uint16_t mr_scheduler_gateway_get_nodes_count(void) {
     return _schedule_vars.num_assigned_uplink_nodes;
 }
 
-uint8_t mr_scheduler_gateway_get_nodes(uint64_t *nodes) {
-    uint8_t count = 0;
-    for (size_t i = 0; i < _schedule_vars.active_schedule_ptr->n_cells; i++) {
-        cell_t *cell = &_schedule_vars.active_schedule_ptr->cells[i];
-        if (cell->type == SLOT_TYPE_UPLINK && cell->assigned_node_id != NULL) {
-            nodes[count++] = cell->assigned_node_id;
+uint16_t mr_scheduler_gateway_get_nodes(uint64_t *nodes) {
+    uint16_t count = 0;
+    for (size_t i = 0; i < _schedule_vars.n_uplinks; i++) {
+        if (_schedule_vars.uplinks[i].assigned_node_id != 0) {
+            nodes[count++] = _schedule_vars.uplinks[i].assigned_node_id;
         }
     }
     return count;
 }
 
+const uplink_t *mr_scheduler_get_uplinks(size_t *n_uplinks) {
+    *n_uplinks = _schedule_vars.n_uplinks;
+    return _schedule_vars.uplinks;
+}
+
 // ------------ general functions ---------
 
 mr_slot_info_t mr_scheduler_tick(uint64_t asn) {
-    // get the current cell
-    _schedule_vars.current_cell_index = asn % (_schedule_vars.active_schedule_ptr)->n_cells;
-    cell_t cell                       = (_schedule_vars.active_schedule_ptr)->cells[_schedule_vars.current_cell_index];
+    if (_schedule_vars.next_schedule_ptr != NULL && asn >= _schedule_vars.switch_asn) {
+        _remap(_schedule_vars.next_schedule_ptr, asn);
+    }
+
+    // get the current cell: slots are ticked one after the other, so the
+    // modulos of the asn are only computed again after a re-synchronization
+    if (_schedule_vars.counters_valid && asn == _schedule_vars.current_asn + 1) {
+        if (++_schedule_vars.current_cell_index == (_schedule_vars.active_schedule_ptr)->n_cells) {
+            _schedule_vars.current_cell_index = 0;
+        }
+        if (++_schedule_vars.current_channel_base == MARI_N_BLE_REGULAR_CHANNELS) {
+            _schedule_vars.current_channel_base = 0;
+        }
+        if (++_schedule_vars.current_advertising_channel == MARI_N_BLE_ADVERTISING_CHANNELS) {
+            _schedule_vars.current_advertising_channel = 0;
+        }
+    } else {
+        _schedule_vars.current_cell_index          = asn % (_schedule_vars.active_schedule_ptr)->n_cells;
+        _schedule_vars.current_channel_base        = asn % MARI_N_BLE_REGULAR_CHANNELS;
+        _schedule_vars.current_advertising_channel = asn % MARI_N_BLE_ADVERTISING_CHANNELS;
+        _schedule_vars.counters_valid              = true;
+    }
+    _schedule_vars.current_asn = asn;
+
+    bool                 is_gateway = mari_get_node_type() == MARI_GATEWAY;
+    const slot_action_t *action     = &_schedule_vars.slot_actions[is_gateway ? MARI_ROLE_GATEWAY : MARI_ROLE_NODE][_schedule_vars.current_cell_index];
+    uint8_t              type       = (_schedule_vars.active_schedule_ptr)->cells[_schedule_vars.current_cell_index].type;
 
     mr_slot_info_t slot_info = {
-        .radio_action = MARI_RADIO_ACTION_SLEEP,
-        .channel      = mr_scheduler_get_channel(cell.type, asn, cell.channel_offset),
-        .type         = cell.type,  // FIXME: only for debugging, remove before merge
+        .radio_action = action->radio_action,
+        .channel      = action->channel,
+        .type         = type,
     };
-    if (mari_get_node_type() == MARI_GATEWAY) {
-        _compute_gateway_action(cell, &slot_info);
-    } else {
-        _compute_node_action(cell, &slot_info);
-        if (cell.type == SLOT_TYPE_SHARED_UPLINK) {
-            mr_assoc_node_tick_backoff();
+    if (action->channel < MARI_N_BLE_REGULAR_CHANNELS) {
+        // As per RFC 7554, (ASN + channelOffset) mod nFreq, with both terms already reduced modulo nFreq
+        slot_info.channel += _schedule_vars.current_channel_base;
+        if (slot_info.channel >= MARI_N_BLE_REGULAR_CHANNELS) {
+            slot_info.channel -= MARI_N_BLE_REGULAR_CHANNELS;
         }
     }
+#if (MARI_FIXED_CHANNEL != 0)
+    slot_info.channel = MARI_FIXED_CHANNEL;
+#elif !defined(MARI_FIXED_SCAN_CHANNEL)
+    if (type == SLOT_TYPE_BEACON) {
+        slot_info.channel = MARI_N_BLE_REGULAR_CHANNELS + _schedule_vars.current_advertising_channel;  // beacons hop over the advertising channels
+    }
+#endif
+    if (!is_gateway && type == SLOT_TYPE_SHARED_UPLINK) {
+        mr_assoc_node_tick_backoff();
+    }
 
     // if the slotframe wrapped, keep track of how many slotframes have passed (used to cycle beacon channels)
     if (asn != 0 && _schedule_vars.current_cell_index == 0) {
@@ -220,7 +642,7 @@ uint8_t mr_scheduler_get_channel(slot_type_t slot_type, uint64_t asn, uint8_t ch
     }
 }
 
-schedule_t *mr_scheduler_get_active_schedule_ptr(void) {
+const schedule_t *mr_scheduler_get_active_schedule_ptr(void) {
     return _schedule_vars.active_schedule_ptr;
 }
 
@@ -228,15 +650,41 @@ uint8_t mr_scheduler_get_active_schedule_id(void) {
     return _schedule_vars.active_schedule_ptr->id;
 }
 
-uint8_t mr_scheduler_get_active_schedule_slot_count(void) {
+uint16_t mr_scheduler_get_active_schedule_slot_count(void) {
     return _schedule_vars.active_schedule_ptr->n_cells;
 }
 
+uint16_t mr_scheduler_get_max_nodes(void) {
+    uint16_t max_nodes = 0;
+    for (size_t i = 0; i < _schedule_vars.available_schedules_len; i++) {
+        if (_schedule_vars.available_schedules[i]->max_nodes > max_nodes) {
+            max_nodes = _schedule_vars.available_schedules[i]->max_nodes;
+        }
+    }
+    return max_nodes;
+}
+
+uint16_t mr_scheduler_get_max_slot_count(void) {
+    uint16_t max_slot_count = 0;
+    for (size_t i = 0; i < _schedule_vars.available_schedules_len; i++) {
+        if (_schedule_vars.available_schedules[i]->n_cells > max_slot_count) {
+            max_slot_count = _schedule_vars.available_schedules[i]->n_cells;
+        }
+    }
+    return max_slot_count;
+}
+
 cell_t mr_scheduler_node_peek_slot(uint64_t asn) {
     size_t cell_index = (asn) % (_schedule_vars.active_schedule_ptr)->n_cells;
-    cell_t cell       = (_schedule_vars.active_schedule_ptr)->cells[cell_index];
+    return (_schedule_vars.active_schedule_ptr)->cells[cell_index];
+}
+
+bool mr_scheduler_node_owns_slot(uint64_t asn) {
+    return _is_my_cell((asn) % (_schedule_vars.active_schedule_ptr)->n_cells);
+}
 
-    return cell;
+bool mr_scheduler_node_owns_uplink(uint16_t uplink) {
+    return uplink < _schedule_vars.n_uplinks && _schedule_vars.uplinks[uplink].assigned_node_id == mr_device_id();
 }
 
 void mr_scheduler_stats_register_used_slot(bool used) {
@@ -244,9 +692,9 @@ void mr_scheduler_stats_register_used_slot(bool used) {
     if (used) {
         encoded_action = 1;
     }
-    uint8_t cell_index   = _schedule_vars.current_cell_index;
-    uint8_t array_index  = cell_index / 64;
-    uint8_t bit_position = cell_index % 64;
+    uint16_t cell_index   = _schedule_vars.current_cell_index;
+    uint16_t array_index  = cell_index / 64;
+    uint8_t  bit_position = cell_index % 64;
 
     if (array_index < MARI_STATS_SCHED_USAGE_SIZE) {
         // First clear the bit at the position
@@ -262,36 +710,268 @@ uint64_t *mr_scheduler_get_schedule_usage(void) {
 
 //=========================== private ==========================================
 
-void _compute_gateway_action(cell_t cell, mr_slot_info_t *slot_info) {
-    switch (cell.type) {
+static void _activate(const schedule_t *schedule) {
+    _schedule_vars.num_assigned_uplink_nodes = 0;
+    memset(_schedule_vars.uplinks, 0, sizeof(_schedule_vars.uplinks));
+    memset(_schedule_vars.node_index, MARI_NODE_INDEX_EMPTY, sizeof(_schedule_vars.node_index));  // all bytes 0xFF is -1
+    mr_bloom_gateway_set_dirty();  // every node is gone at once, recompute rather than remove them one by one
+    _remap(schedule, _schedule_vars.current_asn);
+}
+
+// switch to a schedule at the slot of this asn, keeping every node on the same uplink number
+static void _remap(const schedule_t *schedule, uint64_t asn) {
+    _schedule_vars.active_schedule_ptr = schedule;
+    _schedule_vars.next_schedule_ptr   = NULL;
+    _schedule_vars.n_uplinks           = 0;
+    _schedule_vars.duration_us         = 0;
+    memset(_schedule_vars.free_uplinks, 0, sizeof(_schedule_vars.free_uplinks));
+    memset(_schedule_vars.silent_uplinks, 0, sizeof(_schedule_vars.silent_uplinks));
+    _schedule_vars.free_uplinks_summary = 0;
+
+    // beacon slots are sized for the longest beacon of the schedule, with every uplink occupied
+    size_t n_uplinks = _count_uplinks(schedule);
+    mr_bloom_set_size(n_uplinks);
+    _schedule_vars.occupancy_beacon = _uses_occupancy_beacon(n_uplinks);
+    mr_mac_set_beacon_length(_beacon_length(n_uplinks));
+
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        _schedule_vars.duration_us += mr_mac_get_slot_durations(schedule->cells[i].type)->whole_slot;
+        if (schedule->cells[i].type != SLOT_TYPE_UPLINK || _schedule_vars.n_uplinks == MARI_N_UPLINKS_MAX) {
+            _schedule_vars.cell_to_uplink[i] = -1;
+            continue;
+        }
+        int16_t uplink                        = _schedule_vars.n_uplinks++;
+        _schedule_vars.cell_to_uplink[i]      = uplink;
+        _schedule_vars.uplink_to_cell[uplink] = i;
+        if (_schedule_vars.uplinks[uplink].assigned_node_id == 0) {
+            _free_uplinks_set(uplink);
+        }
+    }
+
+    // the gateway never switches to a schedule without room for its nodes, but a node may be told to
+    for (size_t i = _schedule_vars.n_uplinks; i < MARI_N_UPLINKS_MAX; i++) {
+        uint64_t node_id = _schedule_vars.uplinks[i].assigned_node_id;
+        if (node_id != 0 && node_id != mr_device_id()) {
+            _node_index_remove(node_id);
+            _schedule_vars.num_assigned_uplink_nodes--;
+        }
+        _schedule_vars.uplinks[i] = (uplink_t){ 0 };
+    }
+
+    // expiry depends on the length of the slotframe
+    // with a shorter one, some nodes are already overdue: they expire at the next slot, not a whole turn of the wheel later
+    memset(_schedule_vars.expiry_wheel, MARI_NODE_INDEX_EMPTY, sizeof(_schedule_vars.expiry_wheel));
+    uint64_t max_asn_old = schedule->n_cells * MARI_MAX_SLOTFRAMES_NO_RX_LEAVE;
+    for (size_t i = 0; i < _schedule_vars.n_uplinks; i++) {
+        if (_schedule_vars.uplinks[i].assigned_node_id == 0) {
+            continue;
+        }
+        if (_expiry_asn(i) <= asn) {
+            _schedule_vars.uplinks[i].last_received_asn = asn - max_asn_old;  // so that _expiry_asn is asn + 1
+        }
+        _expiry_insert(i);
+    }
+
+    _build_slot_actions();
+    _schedule_vars.counters_valid = false;
+}
+
+static const schedule_t *_find_schedule(uint8_t schedule_id) {
+    for (size_t i = 0; i < _schedule_vars.available_schedules_len; i++) {
+        if (_schedule_vars.available_schedules[i]->id == schedule_id) {
+            return _schedule_vars.available_schedules[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t _count_uplinks(const schedule_t *schedule) {
+    size_t n_uplinks = 0;
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        if (schedule->cells[i].type == SLOT_TYPE_UPLINK && n_uplinks < MARI_N_UPLINKS_MAX) {
+            n_uplinks++;
+        }
+    }
+    return n_uplinks;
+}
+
+static bool _uses_occupancy_beacon(size_t n_uplinks) {
+    return MARI_ENABLE_OCCUPANCY_BEACON && MARI_OCCUPANCY_LENGTH(n_uplinks, n_uplinks) <= MARI_BLOOM_M_BYTES;
+}
+
+// the longest beacon of a schedule with this many uplinks, all of them occupied
+static size_t _beacon_length(size_t n_uplinks) {
+    size_t membership_len = _uses_occupancy_beacon(n_uplinks) ? MARI_OCCUPANCY_LENGTH(n_uplinks, n_uplinks) : mr_bloom_m_bits_for(n_uplinks) / 8;
+    return offsetof(mr_beacon_packet_header_t, membership) + membership_len;
+}
+
+static void _build_slot_actions(void) {
+    const schedule_t *schedule = _schedule_vars.active_schedule_ptr;
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        const cell_t *cell = &schedule->cells[i];
+        uint8_t       channel;
+        if (cell->type == SLOT_TYPE_BEACON) {
+            channel = mr_scheduler_get_channel(cell->type, 0, cell->channel_offset);  // does not depend on the asn, unless overridden in the tick
+        } else {
+            channel = cell->channel_offset % MARI_N_BLE_REGULAR_CHANNELS;
+        }
+        _schedule_vars.slot_actions[MARI_ROLE_GATEWAY][i] = (slot_action_t){ .radio_action = _compute_gateway_action(cell), .channel = channel };
+        _schedule_vars.slot_actions[MARI_ROLE_NODE][i]    = (slot_action_t){ .radio_action = _compute_node_action(cell, i), .channel = channel };
+    }
+}
+
+static bool _is_my_cell(size_t cell_index) {
+    int16_t uplink = _schedule_vars.cell_to_uplink[cell_index];
+    return uplink >= 0 && _schedule_vars.uplinks[uplink].assigned_node_id == mr_device_id();
+}
+
+static void _release_uplink(int16_t uplink) {
+    mr_bloom_gateway_remove(_schedule_vars.uplinks[uplink].bloom_h1, _schedule_vars.uplinks[uplink].bloom_h2);
+    _expiry_remove(uplink);
+    _node_index_remove(_schedule_vars.uplinks[uplink].assigned_node_id);
+    _schedule_vars.uplinks[uplink].assigned_node_id  = 0;
+    _schedule_vars.uplinks[uplink].last_received_asn = 0;
+    _schedule_vars.uplinks[uplink].compact_header    = false;
+    _free_uplinks_set(uplink);
+    _schedule_vars.num_assigned_uplink_nodes--;
+}
+
+static void _free_uplinks_set(int16_t uplink) {
+    _schedule_vars.free_uplinks[uplink / 32] |= (uint32_t)1 << (uplink % 32);
+    _schedule_vars.free_uplinks_summary |= (uint32_t)1 << (uplink / 32);
+}
+
+static void _free_uplinks_clear(int16_t uplink) {
+    _schedule_vars.free_uplinks[uplink / 32] &= ~((uint32_t)1 << (uplink % 32));
+    if (_schedule_vars.free_uplinks[uplink / 32] == 0) {
+        _schedule_vars.free_uplinks_summary &= ~((uint32_t)1 << (uplink / 32));
+    }
+}
+
+// the summary must not be empty
+static int16_t _first_free_uplink(void) {
+    for (uint32_t summary = _schedule_vars.free_uplinks_summary; summary != 0; summary &= summary - 1) {
+        size_t   word  = __builtin_ctz(summary);
+        uint32_t heard = _schedule_vars.free_uplinks[word] & ~_schedule_vars.silent_uplinks[word];
+        if (heard != 0) {
+            return word * 32 + __builtin_ctz(heard);
+        }
+    }
+    size_t word = __builtin_ctz(_schedule_vars.free_uplinks_summary);
+    return word * 32 + __builtin_ctz(_schedule_vars.free_uplinks[word]);
+}
+
+static int16_t _node_index_find(uint64_t node_id) {
+    size_t slot = _node_index_home(node_id);
+    while (_schedule_vars.node_index[slot] != MARI_NODE_INDEX_EMPTY) {
+        int16_t uplink = _schedule_vars.node_index[slot];
+        if (_schedule_vars.uplinks[uplink].assigned_node_id == node_id) {
+            return uplink;
+        }
+        slot = (slot + 1) & (MARI_NODE_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+// the uplink must already be assigned
+static void _node_index_insert(int16_t uplink) {
+    size_t slot = _node_index_home(_schedule_vars.uplinks[uplink].assigned_node_id);
+    while (_schedule_vars.node_index[slot] != MARI_NODE_INDEX_EMPTY) {
+        slot = (slot + 1) & (MARI_NODE_INDEX_SIZE - 1);
+    }
+    _schedule_vars.node_index[slot] = uplink;
+}
+
+// backward-shift deletion, so that lookups never need tombstones
+static void _node_index_remove(uint64_t node_id) {
+    size_t hole = _node_index_home(node_id);
+    while (_schedule_vars.node_index[hole] != MARI_NODE_INDEX_EMPTY && _schedule_vars.uplinks[_schedule_vars.node_index[hole]].assigned_node_id != node_id) {
+        hole = (hole + 1) & (MARI_NODE_INDEX_SIZE - 1);
+    }
+    if (_schedule_vars.node_index[hole] == MARI_NODE_INDEX_EMPTY) {
+        return;  // not in the index
+    }
+
+    size_t slot = hole;
+    while (true) {
+        slot = (slot + 1) & (MARI_NODE_INDEX_SIZE - 1);
+        if (_schedule_vars.node_index[slot] == MARI_NODE_INDEX_EMPTY) {
+            break;
+        }
+        // move the entry back to the hole, unless its home slot lies cyclically in (hole, slot]
+        size_t home = _node_index_home(_schedule_vars.uplinks[_schedule_vars.node_index[slot]].assigned_node_id);
+        if (((slot - home) & (MARI_NODE_INDEX_SIZE - 1)) >= ((slot - hole) & (MARI_NODE_INDEX_SIZE - 1))) {
+            _schedule_vars.node_index[hole] = _schedule_vars.node_index[slot];
+            hole                            = slot;
+        }
+    }
+    _schedule_vars.node_index[hole] = MARI_NODE_INDEX_EMPTY;
+}
+
+// Fibonacci hashing of the id folded to 32 bits: a single 32-bit multiply, where the FNV-1a of the bloom filter
+// takes eight 64-bit ones. Good enough to spread ids, which do not need to be hashed the same way as in the beacons.
+static size_t _node_index_home(uint64_t node_id) {
+    uint32_t folded = (uint32_t)node_id ^ (uint32_t)(node_id >> 32);
+    return (folded * 2654435769u) >> (32 - MARI_NODE_INDEX_BITS);
+}
+
+// a node expires when nothing was received from it for MARI_MAX_SLOTFRAMES_NO_RX_LEAVE slotframes
+static uint64_t _expiry_asn(int16_t uplink) {
+    uint64_t max_asn_old = _schedule_vars.active_schedule_ptr->n_cells * MARI_MAX_SLOTFRAMES_NO_RX_LEAVE;
+    return _schedule_vars.uplinks[uplink].last_received_asn + max_asn_old + 1;
+}
+
+static void _expiry_insert(int16_t uplink) {
+    size_t bucket                      = _expiry_asn(uplink) & (MARI_EXPIRY_WHEEL_SIZE - 1);
+    _schedule_vars.expiry_prev[uplink] = MARI_NODE_INDEX_EMPTY;
+    _schedule_vars.expiry_next[uplink] = _schedule_vars.expiry_wheel[bucket];
+    if (_schedule_vars.expiry_wheel[bucket] != MARI_NODE_INDEX_EMPTY) {
+        _schedule_vars.expiry_prev[_schedule_vars.expiry_wheel[bucket]] = uplink;
+    }
+    _schedule_vars.expiry_wheel[bucket] = uplink;
+}
+
+// the uplink must be in the wheel, with the same last_received_asn it was inserted with
+static void _expiry_remove(int16_t uplink) {
+    int16_t prev = _schedule_vars.expiry_prev[uplink];
+    int16_t next = _schedule_vars.expiry_next[uplink];
+    if (prev != MARI_NODE_INDEX_EMPTY) {
+        _schedule_vars.expiry_next[prev] = next;
+    } else {
+        _schedule_vars.expiry_wheel[_expiry_asn(uplink) & (MARI_EXPIRY_WHEEL_SIZE - 1)] = next;
+    }
+    if (next != MARI_NODE_INDEX_EMPTY) {
+        _schedule_vars.expiry_prev[next] = prev;
+    }
+}
+
+mr_radio_action_t _compute_gateway_action(const cell_t *cell) {
+    switch (cell->type) {
         case SLOT_TYPE_BEACON:
         case SLOT_TYPE_DOWNLINK:
-            slot_info->radio_action = MARI_RADIO_ACTION_TX;
-            break;
+            return MARI_RADIO_ACTION_TX;
         case SLOT_TYPE_SHARED_UPLINK:
         case SLOT_TYPE_UPLINK:
-            slot_info->radio_action = MARI_RADIO_ACTION_RX;
-            break;
+            return MARI_RADIO_ACTION_RX;
+        default:
+            return MARI_RADIO_ACTION_SLEEP;
     }
 }
 
-void _compute_node_action(cell_t cell, mr_slot_info_t *slot_info) {
-    switch (cell.type) {
+mr_radio_action_t _compute_node_action(const cell_t *cell, size_t cell_index) {
+    switch (cell->type) {
         case SLOT_TYPE_BEACON:
         case SLOT_TYPE_DOWNLINK:
-            slot_info->radio_action = MARI_RADIO_ACTION_RX;
-            break;
+            return MARI_RADIO_ACTION_RX;
         case SLOT_TYPE_SHARED_UPLINK:
-            slot_info->radio_action = MARI_RADIO_ACTION_TX;
-            break;
+            return MARI_RADIO_ACTION_TX;
         case SLOT_TYPE_UPLINK:
-            if (cell.assigned_node_id == mr_device_id()) {
-                slot_info->radio_action = MARI_RADIO_ACTION_TX;
+            if (_is_my_cell(cell_index)) {
+                return MARI_RADIO_ACTION_TX;
             } else {
-                slot_info->radio_action = MARI_RADIO_ACTION_SLEEP;
+                return MARI_RADIO_ACTION_SLEEP;
             }
-            break;
         default:
-            break;
+            return MARI_RADIO_ACTION_SLEEP;
     }
 }
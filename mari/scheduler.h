@@ -30,7 +30,7 @@
  *
  * @param[in] schedule         Schedule to be used.
  */
-void mr_scheduler_init(schedule_t *application_schedule);
+void mr_scheduler_init(const schedule_t *application_schedule);
 
 /**
  * @brief Advances the schedule by one cell/slot.
@@ -50,28 +50,171 @@ mr_slot_info_t mr_scheduler_tick(uint64_t asn);
  */
 bool mr_scheduler_set_schedule(uint8_t schedule_id);
 
+/**
+ * @brief Switches to another schedule at a given ASN, keeping the uplink cell assignments.
+ *
+ * Nodes keep their uplink number: the node assigned to the n-th uplink cell of the active schedule
+ * is assigned to the n-th uplink cell of the next one, so they do not need to join again.
+ * The gateway announces the switch in its beacons, and nodes call this when they receive it.
+ *
+ * @param[in] schedule_id       Schedule ID
+ * @param[in] switch_asn        ASN of the first slot of the next schedule, or 0 to switch right away
+ *
+ * @return true if the switch was scheduled, false if the schedule is unknown
+ */
+bool mr_scheduler_switch_schedule(uint8_t schedule_id, uint64_t switch_asn);
+
+/**
+ * @brief Returns the pending schedule switch, if any.
+ *
+ * @param[out] next_schedule_id Schedule that becomes active at the returned ASN, 0 if none
+ *
+ * @return ASN of the switch, or 0 if no switch is pending
+ */
+uint64_t mr_scheduler_get_pending_switch(uint8_t *next_schedule_id);
+
 uint32_t mr_scheduler_get_duration_us(void);
 
+/**
+ * @brief Returns the duration of a slotframe of any available schedule, not only the active one.
+ *
+ * @param[in] schedule_id       Schedule ID
+ *
+ * @return duration in us, or 0 if the schedule is unknown
+ */
+uint32_t mr_scheduler_get_schedule_duration_us(uint8_t schedule_id);
+
+/**
+ * @brief Builds a schedule sized for a deployment.
+ *
+ * The schedule starts with the beacon cells, followed by the uplink, downlink and shared uplink cells,
+ * with the downlink and shared uplink cells spread evenly among the uplink cells. Each shared uplink cell
+ * is followed by a downlink cell, where the gateway answers join requests, so there are at least as many
+ * downlink cells as shared uplink cells.
+ * Channel offsets are chosen so that consecutive cells use channels far apart from each other.
+ *
+ * Gateway and nodes must build the schedule with the same parameters, and pass it to mari_init.
+ *
+ * @param[out] schedule         Schedule to fill
+ * @param[in] params            Parameters of the schedule
+ *
+ * @return true if the schedule was built, false if the parameters are invalid, or it would not fit in MARI_N_CELLS_MAX cells
+ *         or MARI_N_UPLINKS_MAX uplink cells
+ */
+bool mr_scheduler_build_schedule(schedule_t *schedule, const mr_schedule_params_t *params);
+
 int16_t mr_scheduler_gateway_assign_next_available_uplink_cell(uint64_t node_id, uint64_t asn);
 
 bool mr_scheduler_node_assign_myself_to_cell(uint16_t cell_index);
 
 void mr_scheduler_node_deassign_myself_from_schedule(void);
 
-void mr_scheduler_gateway_decrease_nodes_counter(void);
+void mr_scheduler_gateway_deassign_cell(int16_t cell_index);
+
+int16_t mr_scheduler_gateway_get_node_cell(uint64_t node_id);
+
+/**
+ * @brief Returns the uplink number of a node, -1 if it has none.
+ *
+ * Uplink numbers do not change when the gateway switches schedules, so they are also short addresses of the nodes.
+ */
+int16_t mr_scheduler_gateway_get_node_uplink(uint64_t node_id);
+
+uint64_t mr_scheduler_gateway_get_uplink_node(uint16_t uplink);
+
+void mr_scheduler_gateway_set_node_compact_header(uint64_t node_id, bool compact_header);
+
+bool mr_scheduler_gateway_uplink_has_compact_header(uint16_t uplink);
+
+/**
+ * @brief Returns whether the beacons of the active schedule carry the occupancy of its uplinks, rather than a bloom filter.
+ *
+ * The occupancy is exact, and shorter than the bloom filter in the schedules with up to about 110 uplinks.
+ */
+bool mr_scheduler_uses_occupancy_beacon(void);
+
+/**
+ * @brief Writes the occupancy of the uplinks of the active schedule, for a beacon.
+ *
+ * Number of bytes of the bitmap, bitmap with one bit per uplink, set when it is assigned to a node,
+ * then the tag of each of these nodes, in the order of their uplinks.
+ *
+ * @param[out] output   Buffer of at least MARI_BLOOM_M_BYTES bytes, when mr_scheduler_uses_occupancy_beacon
+ *
+ * @return Number of bytes written
+ */
+size_t mr_scheduler_gateway_copy_occupancy(uint8_t *output);
+
+/**
+ * @brief Returns whether the node is in the occupancy of a beacon, on its own uplink.
+ */
+bool mr_scheduler_node_in_occupancy(const uint8_t *occupancy, size_t length);
+
+bool mr_scheduler_node_owns_uplink(uint16_t uplink);
+
+/**
+ * @brief Returns the uplink number of the node, its short address, -1 if it is not assigned to any.
+ */
+int16_t mr_scheduler_node_get_uplink(void);
+
+void mr_scheduler_gateway_keep_cell_alive(int16_t cell_index, uint64_t asn);
+
+uint64_t mr_scheduler_gateway_pop_expired_node(uint64_t asn);
+
+/**
+ * @brief Number of nodes the gateway can accept now, in the active schedule, 0 while it is about to switch.
+ *
+ * @param[in] asn               ASN of the slot that advertises it
+ */
+uint16_t mr_scheduler_gateway_remaining_capacity(uint64_t asn);
 
-uint8_t mr_scheduler_gateway_remaining_capacity(void);
+/**
+ * @brief Switches the gateway to the schedule that fits the number of joined nodes.
+ *
+ * At the beginning of each slotframe, picks the smallest available schedule not larger than the
+ * one passed at init, and where at most half of the uplink cells would be assigned. Grows only when
+ * the active schedule is more than 3/4 full, and shrinks only when every node keeps its uplink number.
+ * The switch happens a few slotframes later, so that the nodes hear about it in the beacons.
+ *
+ * @param[in] asn               ASN of the slot about to start
+ */
+void mr_scheduler_gateway_adapt_schedule(uint64_t asn);
+
+bool mr_scheduler_gateway_is_switching(uint64_t asn);
+
+uint16_t mr_scheduler_gateway_get_nodes_count(void);
+
+uint16_t mr_scheduler_gateway_get_nodes(uint64_t *nodes);
+
+/**
+ * @brief Returns the state of the uplink cells of the active schedule.
+ *
+ * Entries with an assigned_node_id of 0 are free.
+ *
+ * @param[out] n_uplinks        Number of uplink cells in the active schedule
+ *
+ * @return Pointer to the first uplink cell
+ */
+const uplink_t *mr_scheduler_get_uplinks(size_t *n_uplinks);
 
-uint8_t mr_scheduler_gateway_get_nodes_count(void);
+const schedule_t *mr_scheduler_get_active_schedule_ptr(void);
 
-uint8_t mr_scheduler_gateway_get_nodes(uint64_t *nodes);
+uint16_t mr_scheduler_get_active_schedule_slot_count(void);
 
-schedule_t *mr_scheduler_get_active_schedule_ptr(void);
+/**
+ * @brief Returns the maximum number of nodes of the largest available schedule, i.e., how many nodes may contend to join.
+ */
+uint16_t mr_scheduler_get_max_nodes(void);
 
-uint8_t mr_scheduler_get_active_schedule_slot_count(void);
+/**
+ * @brief Returns the number of cells of the largest available schedule, i.e., how long to scan for beacons.
+ */
+uint16_t mr_scheduler_get_max_slot_count(void);
 
 cell_t mr_scheduler_node_peek_slot(uint64_t asn);
 
+bool mr_scheduler_node_owns_slot(uint64_t asn);
+
 void mr_scheduler_stats_register_used_slot(bool used);
 
 uint64_t *mr_scheduler_get_schedule_usage(void);
@@ -0,0 +1,237 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Application running on every simulated device
+ *
+ * Gateways behave like app/03app_gateway_net and nodes like app/03app_node:
+ * a node sends one uplink packet per period while it is connected, and a
+ * gateway can optionally send downlink packets to its nodes, one node after
+ * the other. Packets carry a probe that lets the receiving side measure the
+ * end-to-end latency, from the call to the mari api to the delivery event.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mr_timer_hf.h"
+#include "mari.h"
+#include "packet.h"
+#include "models.h"
+#include "sim.h"
+#include "instance.h"
+
+//=========================== defines ==========================================
+
+#define SIM_APP_TIMER_DEV              1
+#define SIM_APP_TIMER_CHANNEL_UPLINK   1
+#define SIM_APP_TIMER_CHANNEL_DOWNLINK 2
+
+#define SIM_APP_PROBE_TYPE 0xA5  ///< First payload byte of the probes, other application payloads are ignored
+
+#define SIM_APP_HANDBACK_NS (30 * MR_SIM_NS_PER_S)  ///< Handing over back to the previous gateway within this time counts as a handback
+
+typedef struct __attribute__((packed)) {
+    uint8_t  type;
+    uint32_t node_index;  ///< Index of the device that sent the probe
+    uint32_t seq;
+    uint64_t tx_ns;  ///< Global time at which the probe was handed to mari
+} sim_app_probe_t;
+
+typedef struct {
+    bool     send_uplink_ready;
+    bool     send_downlink_ready;
+    uint32_t seq;
+    uint64_t gateway_id;     ///< Node only: gateway it is connected to
+    uint64_t left_gateway;   ///< Node only: gateway it left at the last handover
+    uint64_t left_ns;        ///< Node only: when it left it
+    size_t   downlink_next;  ///< Gateway only: round-robin position in the list of nodes
+    bool     tx_queue_high;  ///< Between MARI_TX_QUEUE_HIGH and MARI_TX_QUEUE_LOW: hold the packets
+} sim_app_vars_t;
+
+//=========================== prototypes =======================================
+
+static void _mari_event_callback(mr_event_t event, mr_event_data_t event_data);
+static void _send_uplink_callback(void);
+static void _send_downlink_callback(void);
+static void _handle_probe(mr_sim_node_t *node, const mari_packet_t *packet);
+static bool _counts(uint64_t tx_ns);
+static void _build_probe(mr_sim_node_t *node, uint8_t *payload, uint8_t len);
+
+//=========================== public ===========================================
+
+void mr_sim_app_boot(mr_sim_node_t *node) {
+    const mr_sim_config_t *config = mr_sim_config();
+
+    node->app = calloc(1, sizeof(sim_app_vars_t));
+
+    mr_timer_hf_init(SIM_APP_TIMER_DEV);
+
+    const schedule_t *schedule = mr_sim_instance_schedule(node->mari, config->schedule_name, config->n_nodes);
+    node->mari->init(node->role, MARI_NET_ID_DEFAULT, schedule, &_mari_event_callback);
+
+    if (node->role == MARI_NODE && config->uplink_period_ns) {
+        mr_timer_hf_set_periodic_us(SIM_APP_TIMER_DEV, SIM_APP_TIMER_CHANNEL_UPLINK, config->uplink_period_ns / MR_SIM_NS_PER_US, &_send_uplink_callback);
+    }
+    if (node->role == MARI_GATEWAY && config->downlink_period_ns) {
+        mr_timer_hf_set_periodic_us(SIM_APP_TIMER_DEV, SIM_APP_TIMER_CHANNEL_DOWNLINK, config->downlink_period_ns / MR_SIM_NS_PER_US, &_send_downlink_callback);
+    }
+}
+
+void mr_sim_app_loop(mr_sim_node_t *node) {
+    const mr_sim_config_t *config = mr_sim_config();
+    sim_app_vars_t        *vars   = node->app;
+    if (vars == NULL) {
+        return;  // not booted yet
+    }
+
+    if (vars->send_uplink_ready) {
+        vars->send_uplink_ready = false;
+        if (vars->tx_queue_high) {
+            node->stats.tx_held++;
+        } else if (node->mari->node_is_connected()) {
+            uint8_t payload[MARI_PACKET_MAX_SIZE] = { 0 };
+            _build_probe(node, payload, config->uplink_payload_len);
+            if (!node->mari->node_tx_payload(payload, config->uplink_payload_len)) {
+                node->stats.tx_refused++;
+            } else if (_counts(node->cpu_ns)) {
+                node->stats.uplink_sent++;
+            }
+        }
+    }
+
+    if (vars->send_downlink_ready) {
+        vars->send_downlink_ready = false;
+        uint64_t nodes[MARI_MAX_NODES];
+        size_t   n_nodes = node->mari->gateway_get_nodes(nodes);
+        if (vars->tx_queue_high) {
+            node->stats.tx_held++;
+        } else if (n_nodes > 0) {
+            // the probe is written straight into the buffer that goes to the radio
+            uint64_t dst     = nodes[vars->downlink_next++ % n_nodes];
+            uint8_t *payload = node->mari->tx_buffer();
+            if (payload != NULL) {
+                _build_probe(node, payload, config->downlink_payload_len);
+            }
+            if (payload == NULL || !node->mari->tx_commit(dst, config->downlink_payload_len)) {
+                node->stats.tx_refused++;
+            } else if (_counts(node->cpu_ns)) {
+                node->stats.downlink_sent++;
+            }
+        }
+    }
+
+    // best to keep this at the end of the main loop
+    node->mari->event_loop();
+}
+
+//=========================== private ==========================================
+
+// Events are handled right away instead of being copied for the main loop:
+// the simulator must not miss any of them, and the packet is only valid now
+static void _mari_event_callback(mr_event_t event, mr_event_data_t event_data) {
+    mr_sim_node_t  *node = mr_sim_current();
+    sim_app_vars_t *vars = node->app;
+
+    switch (event) {
+        case MARI_NEW_PACKET:
+            _handle_probe(node, &event_data.data.new_packet);
+            break;
+        case MARI_CONNECTED:
+            node->stats.connects++;
+            if (node->stats.first_connected_ns == 0) {
+                node->stats.first_connected_ns = node->cpu_ns;
+            }
+            if (node->stats.handover_ns != 0) {
+                mr_sim_series_add(&node->stats.handover_time, (node->cpu_ns - node->stats.handover_ns) / MR_SIM_NS_PER_US);
+                node->stats.handover_ns = 0;
+            }
+            vars->gateway_id = event_data.data.gateway_info.gateway_id;
+            if (vars->gateway_id == vars->left_gateway && node->cpu_ns - vars->left_ns < SIM_APP_HANDBACK_NS) {
+                node->stats.handbacks++;  // ping-pong between two gateways
+            }
+            if (mr_sim_config()->verbose) {
+                printf("%10.6f %016llX connected to %016llX\n", node->cpu_ns * 1e-9, (unsigned long long)node->device_id, (unsigned long long)vars->gateway_id);
+            }
+            break;
+        case MARI_DISCONNECTED:
+            if (event_data.tag == MARI_HANDOVER) {
+                node->stats.handovers++;
+                node->stats.handover_ns = node->cpu_ns;
+                vars->left_gateway      = vars->gateway_id;
+                vars->left_ns           = node->cpu_ns;
+            } else {
+                node->stats.disconnects++;
+                node->stats.handover_ns = 0;  // back to scanning, not a handover anymore
+            }
+            if (mr_sim_config()->verbose) {
+                printf("%10.6f %016llX disconnected, reason: %u\n", node->cpu_ns * 1e-9, (unsigned long long)node->device_id, event_data.tag);
+            }
+            break;
+        case MARI_NODE_JOINED:
+            node->stats.nodes_joined++;
+            break;
+        case MARI_NODE_LEFT:
+            node->stats.nodes_left++;
+            break;
+        case MARI_TX_QUEUE_HIGH:
+            vars->tx_queue_high = true;
+            break;
+        case MARI_TX_QUEUE_LOW:
+            vars->tx_queue_high = false;
+            break;
+        default:
+            break;
+    }
+}
+
+static void _send_uplink_callback(void) {
+    ((sim_app_vars_t *)mr_sim_current()->app)->send_uplink_ready = true;
+}
+
+static void _send_downlink_callback(void) {
+    ((sim_app_vars_t *)mr_sim_current()->app)->send_downlink_ready = true;
+}
+
+static void _build_probe(mr_sim_node_t *node, uint8_t *payload, uint8_t len) {
+    sim_app_vars_t *vars  = node->app;
+    sim_app_probe_t probe = {
+        .type       = SIM_APP_PROBE_TYPE,
+        .node_index = node->index,
+        .seq        = vars->seq++,
+        .tx_ns      = node->cpu_ns,
+    };
+    memcpy(payload, &probe, len < sizeof(probe) ? len : sizeof(probe));
+}
+
+static void _handle_probe(mr_sim_node_t *node, const mari_packet_t *packet) {
+    if (packet->payload_len < sizeof(sim_app_probe_t) || packet->payload[0] != SIM_APP_PROBE_TYPE) {
+        return;
+    }
+    sim_app_probe_t probe;
+    memcpy(&probe, packet->payload, sizeof(probe));
+    if (!_counts(probe.tx_ns)) {
+        return;
+    }
+
+    uint32_t latency_us = (node->cpu_ns - probe.tx_ns) / MR_SIM_NS_PER_US;
+    if (node->role == MARI_GATEWAY) {
+        node->stats.uplink_received++;
+        mr_sim_series_add(&node->stats.uplink_latency, latency_us);
+    } else {
+        node->stats.downlink_received++;
+        mr_sim_series_add(&node->stats.downlink_latency, latency_us);
+    }
+}
+
+// Packets sent too close to the end of the simulation may not have had a chance to be delivered
+static bool _counts(uint64_t tx_ns) {
+    const mr_sim_config_t *config = mr_sim_config();
+    return tx_ns + MR_SIM_DRAIN_NS < config->duration_ns;
+}
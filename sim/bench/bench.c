@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Helpers shared by the benchmarks in sim/bench
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+
+#include "mari.h"
+#include "packet.h"
+#include "sim.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_DEVICE_ID 0x0123456789ABCDEF
+
+//=========================== variables ========================================
+
+static mr_sim_node_t _device = { 0 };
+
+//=========================== prototypes =======================================
+
+static void _event_callback(mr_event_t event, mr_event_data_t event_data);
+
+//=========================== public ===========================================
+
+void bench_init_device(mr_node_type_t node_type, const schedule_t *schedule, mr_event_cb_t event_callback) {
+    _device.device_id = BENCH_DEVICE_ID;
+    _device.role      = node_type;
+    mr_sim_set_current(&_device);
+    // timers and radio only queue events in the simulated device, which are never run
+    mari_init(node_type, MARI_NET_ID_DEFAULT, schedule, event_callback ? event_callback : &_event_callback);
+}
+
+//=========================== private ==========================================
+
+static void _event_callback(mr_event_t event, mr_event_data_t event_data) {
+    (void)event;
+    (void)event_data;
+}
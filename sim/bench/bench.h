@@ -0,0 +1,67 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/**
+ * @defgroup    sim_bench   Host benchmarks of the mari core
+ * @ingroup     sim
+ * @brief       Helpers shared by the benchmarks in sim/bench
+ *
+ * The benchmarks link the mari core statically with the simulated drivers,
+ * and call its functions directly, on a single simulated device.
+ *
+ * @{
+ * @file
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ * @}
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "models.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//=========================== defines ==========================================
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_UNIT "cycles"  ///< Time stamp counter ticks
+#else
+#define BENCH_UNIT "ns"
+#endif
+
+//=========================== variables ========================================
+
+extern const schedule_t schedule_tiny;
+extern const schedule_t schedule_medium;
+extern const schedule_t schedule_big;
+extern const schedule_t schedule_huge;
+
+//=========================== prototypes =======================================
+
+/**
+ * @brief Reads a fine grained timestamp, in BENCH_UNIT
+ */
+static inline uint64_t bench_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Sets up the current thread as a single simulated device, and initializes mari on it
+ *
+ * @param[in] node_type         MARI_GATEWAY or MARI_NODE
+ * @param[in] schedule          Schedule to activate
+ * @param[in] event_callback    Application callback of mari, may be NULL
+ */
+void bench_init_device(mr_node_type_t node_type, const schedule_t *schedule, mr_event_cb_t event_callback);
+
+#endif  // __BENCH_H
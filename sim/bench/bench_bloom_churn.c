@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Cost of a join or a leave on the bloom filter of the gateway
+ *
+ * Nodes keep leaving the gateway and new ones joining it, as robots moving
+ * between gateways would. Every join or leave now patches the K bits of the
+ * node in the bloom filter, through per-bit counters, while the uplink cell
+ * is assigned or released. Before, it made the filter dirty, and the event
+ * loop recomputed it from every assigned cell. Both are timed per event, and
+ * the patched filter is checked against a recomputed one.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "bloom.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_EVENTS       100000  ///< Leaves, each followed by a join
+#define BENCH_NODE_ID_BASE 0x1000
+#define BENCH_SEED         0x5EED
+
+//=========================== variables ========================================
+
+static const uint32_t _n_nodes[] = { 10, 50, 100, 250, 500 };
+
+static const mr_schedule_params_t _params = { .id = 0x10, .n_beacons = 3, .n_uplinks = 512, .uplinks_per_downlink = 5, .uplinks_per_shared = 5 };
+
+static struct {
+    schedule_t schedule;                        ///< Built from _params
+    int16_t    cells[MARI_MAX_NODES];           ///< Cell of each node, as known by the bench
+    uint8_t    patched[MARI_BLOOM_M_BYTES];     ///< Filter after the patches, to compare with a recomputed one
+    uint8_t    recomputed[MARI_BLOOM_M_BYTES];  ///< Filter recomputed from every assigned cell
+    uint64_t   rng;
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static bool     _run(uint32_t n_nodes, uint64_t *patch, uint64_t *recompute);
+static bool     _recompute_and_check(uint64_t *recompute);
+static uint64_t _random(void);
+
+//=========================== main =============================================
+
+int main(void) {
+    if (!mr_scheduler_build_schedule(&_bench_vars.schedule, &_params)) {
+        fprintf(stderr, "cannot build a schedule with %u uplink cells\n", _params.n_uplinks);
+        return EXIT_FAILURE;
+    }
+
+    bench_init_device(MARI_GATEWAY, &_bench_vars.schedule, NULL);  // sizes the bloom filter for the schedule
+    printf("bloom filter of the gateway, %d leaves and as many joins, m = %d bits, k = %d\n\n", BENCH_EVENTS, mr_bloom_get_m_bits(), mr_bloom_get_k_hashes());
+    printf("%6s %24s %24s\n", "nodes", "patched (join/leave)", "recomputed (before)");
+    for (size_t i = 0; i < sizeof(_n_nodes) / sizeof(_n_nodes[0]); i++) {
+        uint64_t patch, recompute;
+        if (!_run(_n_nodes[i], &patch, &recompute)) {
+            fprintf(stderr, "mismatch: the patched bloom filter differs from the recomputed one, with %u nodes\n", _n_nodes[i]);
+            return EXIT_FAILURE;
+        }
+        printf("%6u %17.1f %-6s %17.1f %-6s\n", _n_nodes[i],
+               (double)patch / (2 * BENCH_EVENTS), BENCH_UNIT, (double)recompute / (2 * BENCH_EVENTS), BENCH_UNIT);
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+// Both times are totals over all the events, of the assignment or release of the cell, and of the recomputation on top of it
+static bool _run(uint32_t n_nodes, uint64_t *patch, uint64_t *recompute) {
+    bench_init_device(MARI_GATEWAY, &_bench_vars.schedule, NULL);
+    _bench_vars.rng = BENCH_SEED;
+    *patch          = 0;
+    *recompute      = 0;
+
+    uint64_t next_node_id = BENCH_NODE_ID_BASE;
+    for (uint32_t i = 0; i < n_nodes; i++) {
+        _bench_vars.cells[i] = mr_scheduler_gateway_assign_next_available_uplink_cell(next_node_id++, 0);
+    }
+
+    for (uint32_t event = 0; event < BENCH_EVENTS; event++) {
+        // a random node leaves, and a new one takes its place
+        uint32_t i     = _random() % n_nodes;
+        uint64_t start = bench_now();
+        mr_scheduler_gateway_deassign_cell(_bench_vars.cells[i]);
+        *patch += bench_now() - start;
+        if (!_recompute_and_check(recompute)) {
+            return false;
+        }
+
+        start                = bench_now();
+        _bench_vars.cells[i] = mr_scheduler_gateway_assign_next_available_uplink_cell(next_node_id++, event);
+        *patch += bench_now() - start;
+        if (!_recompute_and_check(recompute)) {
+            return false;
+        }
+    }
+    *recompute += *patch;  // the cell was assigned or released before the recomputation too
+    return true;
+}
+
+static bool _recompute_and_check(uint64_t *recompute) {
+    mr_bloom_gateway_copy(_bench_vars.patched);
+    uint64_t start = bench_now();
+    mr_bloom_gateway_compute();
+    *recompute += bench_now() - start;
+    mr_bloom_gateway_copy(_bench_vars.recomputed);
+    return memcmp(_bench_vars.patched, _bench_vars.recomputed, MARI_BLOOM_M_BYTES) == 0;
+}
+
+// splitmix64
+static uint64_t _random(void) {
+    uint64_t z = (_bench_vars.rng += 0x9E3779B97F4A7C15ULL);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
@@ -0,0 +1,179 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       False positives and cost of the bloom filter of the beacons, per hash function, size and number of hashes
+ *
+ * Host version of the experiments of app/01mari_bloom, which were tuned by
+ * hand on the device. A filter of M bits is built from n random node ids,
+ * with K bit positions per node derived from two 64-bit hashes, as in
+ * mari/bloom.c. False positives are counted over ids that are not in the
+ * filter, for FNV-1a and for a mix64 finalizer, and compared with the
+ * theoretical rate. The parameters that mari picks for the uplinks of each
+ * schedule are checked the same way.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "bloom.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_TRIALS  20     ///< Filters built for each point, from different node ids
+#define BENCH_PROBES  20000  ///< Ids that are not in the filter, tested against each of them
+#define BENCH_K_MAX   8
+#define BENCH_SEED    0x5EED
+#define BENCH_REPEATS 100    ///< Times each filter is built, for the cost
+
+typedef uint64_t (*bench_hash_t)(uint64_t input);
+
+//=========================== variables ========================================
+
+static const uint32_t _n_nodes[] = { 10, 44, 102, 250, 512 };
+static const uint32_t _m_bits[]  = { 256, 512, 1024, 1760 };  // up to the largest filter of a beacon
+
+static const mr_schedule_params_t _params = { .id = 0x10, .n_beacons = 3, .n_uplinks = 512, .uplinks_per_downlink = 5, .uplinks_per_shared = 5 };
+
+static struct {
+    schedule_t schedule;  ///< Built from _params
+    uint64_t   nodes[MARI_MAX_NODES];
+    uint8_t    bloom[MARI_BLOOM_M_BYTES];
+    uint64_t   rng;
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static double   _false_positives(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k);
+static double   _cost(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k);
+static void     _build(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k);
+static bool     _contains(bench_hash_t hash, uint64_t node_id, uint32_t m_bits, uint8_t k);
+static double   _theory(uint32_t n_nodes, uint32_t m_bits, uint8_t k);
+static uint64_t _mix64(uint64_t input);
+static uint64_t _random(void);
+
+//=========================== main =============================================
+
+int main(void) {
+    printf("bloom filter false positives, %d filters of random node ids, %d probes each\n\n", BENCH_TRIALS, BENCH_PROBES);
+
+    printf("%6s %6s %3s %10s %10s %10s\n", "nodes", "m", "k", "theory", "fnv1a", "mix64");
+    for (size_t i = 0; i < sizeof(_n_nodes) / sizeof(_n_nodes[0]); i++) {
+        for (size_t j = 0; j < sizeof(_m_bits) / sizeof(_m_bits[0]); j++) {
+            for (uint8_t k = 1; k <= BENCH_K_MAX; k *= 2) {
+                printf("%6u %6u %3u %9.2f%% %9.2f%% %9.2f%%\n", _n_nodes[i], _m_bits[j], k, 100 * _theory(_n_nodes[i], _m_bits[j], k),
+                       100 * _false_positives(&mr_bloom_hash_fnv1a64, _n_nodes[i], _m_bits[j], k),
+                       100 * _false_positives(&_mix64, _n_nodes[i], _m_bits[j], k));
+            }
+        }
+    }
+
+    printf("\ncost to build a filter of m = %d bits, with k = %d, per node\n\n", MARI_BLOOM_M_BITS, MARI_BLOOM_K_MAX);
+    printf("%6s %16s %16s\n", "nodes", "fnv1a", "mix64");
+    for (size_t i = 0; i < sizeof(_n_nodes) / sizeof(_n_nodes[0]); i++) {
+        printf("%6u %9.1f %-6s %9.1f %-6s\n", _n_nodes[i],
+               _cost(&mr_bloom_hash_fnv1a64, _n_nodes[i], MARI_BLOOM_M_BITS, MARI_BLOOM_K_MAX), BENCH_UNIT,
+               _cost(&_mix64, _n_nodes[i], MARI_BLOOM_M_BITS, MARI_BLOOM_K_MAX), BENCH_UNIT);
+    }
+
+    if (!mr_scheduler_build_schedule(&_bench_vars.schedule, &_params)) {
+        fprintf(stderr, "cannot build a schedule with %u uplink cells\n", _params.n_uplinks);
+        return EXIT_FAILURE;
+    }
+    const schedule_t *schedules[] = { &schedule_tiny, &schedule_medium, &schedule_big, &schedule_huge, &_bench_vars.schedule };
+
+    printf("\nparameters picked for the uplinks of each schedule, %d bits per node, all of them assigned\n\n", MARI_BLOOM_BITS_PER_NODE);
+    printf("%-8s %6s %6s %3s %10s %10s\n", "schedule", "nodes", "m", "k", "theory", "fnv1a");
+    for (size_t i = 0; i < sizeof(schedules) / sizeof(schedules[0]); i++) {
+        bench_init_device(MARI_GATEWAY, schedules[i], NULL);
+        uint32_t n_nodes = schedules[i]->max_nodes;
+        uint32_t m_bits  = mr_bloom_get_m_bits();
+        uint8_t  k       = mr_bloom_get_k_hashes();
+        printf("%-8u %6u %6u %3u %9.2f%% %9.2f%%\n", schedules[i]->id, n_nodes, m_bits, k,
+               100 * _theory(n_nodes, m_bits, k), 100 * _false_positives(&mr_bloom_hash_fnv1a64, n_nodes, m_bits, k));
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+// Share of the ids that are not in the filter, but are found in it
+static double _false_positives(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k) {
+    uint32_t found  = 0;
+    _bench_vars.rng = BENCH_SEED;
+    for (uint32_t trial = 0; trial < BENCH_TRIALS; trial++) {
+        _build(hash, n_nodes, m_bits, k);
+        for (uint32_t probe = 0; probe < BENCH_PROBES; probe++) {
+            found += _contains(hash, _random(), m_bits, k);  // 64-bit random ids are not in the filter
+        }
+    }
+    return (double)found / (BENCH_TRIALS * BENCH_PROBES);
+}
+
+// Per node, hashes included, as the gateway would do for a node that joins
+static double _cost(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k) {
+    _bench_vars.rng = BENCH_SEED;
+    uint64_t start  = bench_now();
+    for (uint32_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        _build(hash, n_nodes, m_bits, k);
+    }
+    return (double)(bench_now() - start) / (BENCH_REPEATS * n_nodes);
+}
+
+static void _build(bench_hash_t hash, uint32_t n_nodes, uint32_t m_bits, uint8_t k) {
+    memset(_bench_vars.bloom, 0, m_bits / 8);
+    for (uint32_t i = 0; i < n_nodes; i++) {
+        _bench_vars.nodes[i] = _random();
+        uint64_t h1          = hash(_bench_vars.nodes[i]);
+        uint64_t h2          = hash(_bench_vars.nodes[i] ^ MARI_BLOOM_FNV1A_H2_SALT);
+        for (uint8_t j = 0; j < k; j++) {
+            uint16_t idx = MARI_BLOOM_BIT_INDEX(h1, h2, j, m_bits);
+            _bench_vars.bloom[idx / 8] |= 1 << (idx % 8);
+        }
+    }
+}
+
+static bool _contains(bench_hash_t hash, uint64_t node_id, uint32_t m_bits, uint8_t k) {
+    uint64_t h1 = hash(node_id);
+    uint64_t h2 = hash(node_id ^ MARI_BLOOM_FNV1A_H2_SALT);
+    for (uint8_t j = 0; j < k; j++) {
+        uint16_t idx = MARI_BLOOM_BIT_INDEX(h1, h2, j, m_bits);
+        if ((_bench_vars.bloom[idx / 8] & (1 << (idx % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// (1 - e^(-k n / m))^k
+static double _theory(uint32_t n_nodes, uint32_t m_bits, uint8_t k) {
+    return pow(1 - exp(-(double)k * n_nodes / m_bits), k);
+}
+
+// Thomas Wang's 64-bit mix hash, as in app/01mari_bloom
+static uint64_t _mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// splitmix64
+static uint64_t _random(void) {
+    uint64_t z = (_bench_vars.rng += 0x9E3779B97F4A7C15ULL);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
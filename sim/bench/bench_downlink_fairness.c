@@ -0,0 +1,205 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Downlink latency at the gateway, with one destination flooding the queue
+ *
+ * One chatty destination is sent a packet every slot, far more than the
+ * downlink cells can carry, while a few other destinations are sent a packet
+ * now and then, for half of the remaining capacity. Compares the queue of the
+ * gateway, with per-destination queues served in deficit round-robin order,
+ * with the previous single FIFO shared by all the destinations. Latency is
+ * counted from the call to mr_queue_add to the downlink cell that carries the
+ * packet.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "mac.h"
+#include "packet.h"
+#include "queue.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_SLOTS       200000
+#define BENCH_N_LIGHT     20      ///< Destinations that are sent a packet now and then
+#define BENCH_LIGHT_LOAD  0.5     ///< Share of the downlink cells used by the light destinations, together
+#define BENCH_CHATTY_DST  0x1000  ///< Destination flooded with packets
+#define BENCH_LIGHT_DST   0x2000  ///< First light destination
+#define BENCH_SEED        0x5EED
+
+typedef struct {
+    uint32_t latencies[BENCH_SLOTS];  ///< In slots
+    uint32_t len;
+    uint32_t refused;
+} bench_class_t;
+
+typedef struct {
+    bench_class_t chatty;
+    bench_class_t light;
+} bench_result_t;
+
+// Previous implementation: a single FIFO, which refuses packets when it is full
+typedef struct {
+    uint64_t dst[MARI_PACKET_QUEUE_SIZE];
+    uint64_t asn[MARI_PACKET_QUEUE_SIZE];
+    uint8_t  head;
+    uint8_t  tail;
+} bench_fifo_t;
+
+//=========================== variables ========================================
+
+static struct {
+    bench_result_t fifo;
+    bench_result_t drr;
+    bench_fifo_t   queue;
+    uint64_t       rng;
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static bool     _fifo_add(uint64_t dst, uint64_t asn);
+static bool     _fifo_next(uint64_t *dst, uint64_t *asn);
+static bool     _drr_add(uint64_t dst, uint64_t asn);
+static bool     _drr_next(uint64_t *dst, uint64_t *asn);
+static void     _run(bench_result_t *result, bool (*add)(uint64_t, uint64_t), bool (*next)(uint64_t *, uint64_t *));
+static void     _print(const char *queue, const char *dst, bench_class_t *class);
+static uint32_t _percentile(bench_class_t *class, uint32_t permille);
+static int      _compare(const void *a, const void *b);
+static double   _random(void);
+
+//=========================== main =============================================
+
+int main(void) {
+    bench_init_device(MARI_GATEWAY, &schedule_huge, NULL);
+
+    size_t n_downlinks = 0;
+    for (size_t i = 0; i < schedule_huge.n_cells; i++) {
+        n_downlinks += schedule_huge.cells[i].type == SLOT_TYPE_DOWNLINK;
+    }
+    printf("downlink latency with one chatty destination, schedule %u, %zu downlink cells out of %zu\n", schedule_huge.id, n_downlinks, schedule_huge.n_cells);
+    printf("%d light destinations use %.0f %% of the downlink cells, %d slots of %d us\n\n", BENCH_N_LIGHT, 100 * BENCH_LIGHT_LOAD, BENCH_SLOTS, MARI_WHOLE_SLOT_DURATION);
+
+    _run(&_bench_vars.fifo, &_fifo_add, &_fifo_next);
+    _run(&_bench_vars.drr, &_drr_add, &_drr_next);
+
+    printf("%-6s %-7s %8s %8s %10s %10s %10s\n", "queue", "dst", "sent", "refused", "p50 (ms)", "p99 (ms)", "max (ms)");
+    _print("fifo", "chatty", &_bench_vars.fifo.chatty);
+    _print("fifo", "light", &_bench_vars.fifo.light);
+    _print("drr", "chatty", &_bench_vars.drr.chatty);
+    _print("drr", "light", &_bench_vars.drr.light);
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static bool _fifo_add(uint64_t dst, uint64_t asn) {
+    bench_fifo_t *queue = &_bench_vars.queue;
+    if ((uint8_t)(queue->head - queue->tail) == MARI_PACKET_QUEUE_SIZE) {
+        return false;
+    }
+    queue->dst[queue->head % MARI_PACKET_QUEUE_SIZE] = dst;
+    queue->asn[queue->head % MARI_PACKET_QUEUE_SIZE] = asn;
+    queue->head++;
+    return true;
+}
+
+static bool _fifo_next(uint64_t *dst, uint64_t *asn) {
+    bench_fifo_t *queue = &_bench_vars.queue;
+    if (queue->head == queue->tail) {
+        return false;
+    }
+    *dst = queue->dst[queue->tail % MARI_PACKET_QUEUE_SIZE];
+    *asn = queue->asn[queue->tail % MARI_PACKET_QUEUE_SIZE];
+    queue->tail++;
+    return true;
+}
+
+static bool _drr_add(uint64_t dst, uint64_t asn) {
+    uint8_t *packet = mr_queue_get_buffer();
+    if (packet == NULL) {
+        return false;
+    }
+    size_t len = mr_build_packet_data(packet, dst, (uint8_t *)&asn, sizeof(asn));
+    return mr_queue_commit(len);
+}
+
+static bool _drr_next(uint64_t *dst, uint64_t *asn) {
+    uint8_t  len;
+    uint8_t *packet = mr_queue_next_packet(SLOT_TYPE_DOWNLINK, &len);
+    if (packet == NULL) {
+        return false;
+    }
+    const mr_packet_header_t *header = (const mr_packet_header_t *)packet;
+    *dst                             = header->dst;
+    memcpy(asn, packet + sizeof(mr_packet_header_t), sizeof(*asn));
+    return true;
+}
+
+static void _run(bench_result_t *result, bool (*add)(uint64_t, uint64_t), bool (*next)(uint64_t *, uint64_t *)) {
+    const schedule_t *schedule = &schedule_huge;
+    _bench_vars.rng            = BENCH_SEED;
+
+    size_t n_downlinks = 0;
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        n_downlinks += schedule->cells[i].type == SLOT_TYPE_DOWNLINK;
+    }
+    // probability that a given light destination is sent a packet during a slot
+    double light_probability = BENCH_LIGHT_LOAD * n_downlinks / schedule->n_cells / BENCH_N_LIGHT;
+
+    for (uint64_t asn = 0; asn < BENCH_SLOTS; asn++) {
+        if (!add(BENCH_CHATTY_DST, asn)) {
+            result->chatty.refused++;
+        }
+        for (uint64_t i = 0; i < BENCH_N_LIGHT; i++) {
+            if (_random() < light_probability && !add(BENCH_LIGHT_DST + i, asn)) {
+                result->light.refused++;
+            }
+        }
+
+        uint64_t dst, enqueued_asn;
+        if (schedule->cells[asn % schedule->n_cells].type == SLOT_TYPE_DOWNLINK && next(&dst, &enqueued_asn)) {
+            bench_class_t *class           = dst == BENCH_CHATTY_DST ? &result->chatty : &result->light;
+            class->latencies[class->len++] = asn - enqueued_asn;
+        }
+    }
+}
+
+static void _print(const char *queue, const char *dst, bench_class_t *class) {
+    double ms_per_slot = MARI_WHOLE_SLOT_DURATION / 1000.0;
+    printf("%-6s %-7s %8u %8u %10.1f %10.1f %10.1f\n", queue, dst,
+           class->len, class->refused, _percentile(class, 500) * ms_per_slot, _percentile(class, 990) * ms_per_slot, _percentile(class, 1000) * ms_per_slot);
+}
+
+// Sorts the latencies in place
+static uint32_t _percentile(bench_class_t *class, uint32_t permille) {
+    if (class->len == 0) {
+        return 0;
+    }
+    qsort(class->latencies, class->len, sizeof(class->latencies[0]), &_compare);
+    return class->latencies[(uint64_t)(class->len - 1) * permille / 1000];
+}
+
+static int _compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Uniform in [0, 1), from splitmix64
+static double _random(void) {
+    uint64_t z = (_bench_vars.rng += 0x9E3779B97F4A7C15ULL);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z          = z ^ (z >> 31);
+    return (z >> 11) * (1.0 / (1ULL << 53));
+}
@@ -0,0 +1,181 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Downlink latency as a function of the number of nodes, with and without shared downlink frames
+ *
+ * Every few seconds, the application of the gateway sends a small command to
+ * each of its nodes, all at once, and holds the ones that do not fit in the
+ * transmit queue until there is room. Latency is counted from the moment the
+ * command is due to the downlink cell that carries it. Small commands to
+ * several nodes share a MARI_PACKET_DATA_MULTI_DST frame. Commands too large
+ * to share a frame take a downlink cell each, like any command did before.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "mac.h"
+#include "packet.h"
+#include "queue.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_NODE_ID_BASE  0x1000
+#define BENCH_ROUNDS        10
+#define BENCH_ROUND_SLOTS   5618  ///< A command to every node every 10 s
+#define BENCH_SMALL_PAYLOAD 8     ///< Shares a frame with other commands
+#define BENCH_LARGE_PAYLOAD 120   ///< Two of them do not fit in a frame
+#define BENCH_MAX_COMMANDS  (MARI_MAX_NODES * BENCH_ROUNDS)
+
+typedef struct {
+    uint64_t dst;
+    uint64_t asn;  ///< When the command is due
+} bench_command_t;
+
+typedef struct {
+    uint32_t latencies[BENCH_MAX_COMMANDS];  ///< In slots
+    uint32_t len;
+} bench_result_t;
+
+//=========================== variables ========================================
+
+static const uint32_t _n_nodes[] = { 10, 25, 50, 100, 200, 500 };
+
+static const mr_schedule_params_t _params = { .id = 0x10, .n_beacons = 3, .n_uplinks = 512, .uplinks_per_downlink = 5, .uplinks_per_shared = 5 };
+
+static struct {
+    schedule_t      schedule;                         ///< Built from _params, for the deployments that do not fit in huge
+    bench_command_t backlog[BENCH_MAX_COMMANDS];      ///< Commands held by the application
+    size_t          backlog_first;
+    size_t          backlog_len;
+    bench_result_t  result;
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static void     _run(const schedule_t *schedule, uint32_t n_nodes, uint8_t payload_len);
+static void     _receive(const uint8_t *packet, uint8_t length, uint64_t asn);
+static uint32_t _percentile(uint32_t permille);
+static int      _compare(const void *a, const void *b);
+
+//=========================== main =============================================
+
+int main(void) {
+    if (!mr_scheduler_build_schedule(&_bench_vars.schedule, &_params)) {
+        fprintf(stderr, "cannot build a schedule with %u uplink cells\n", _params.n_uplinks);
+        return EXIT_FAILURE;
+    }
+
+    printf("downlink latency, one command to every node every %.0f s, %d rounds\n", BENCH_ROUND_SLOTS * MARI_WHOLE_SLOT_DURATION / 1e6, BENCH_ROUNDS);
+    printf("%d-byte commands share downlink frames, %d-byte commands take a downlink cell each\n\n", BENCH_SMALL_PAYLOAD, BENCH_LARGE_PAYLOAD);
+    printf("%6s %8s %10s %30s %30s\n", "nodes", "schedule", "downlinks", "one per cell (p50/p99/max)", "shared (p50/p99/max)");
+
+    for (size_t i = 0; i < sizeof(_n_nodes) / sizeof(_n_nodes[0]); i++) {
+        const schedule_t *schedule = _n_nodes[i] <= schedule_huge.max_nodes ? &schedule_huge : &_bench_vars.schedule;
+
+        size_t n_downlinks = 0;
+        for (size_t j = 0; j < schedule->n_cells; j++) {
+            n_downlinks += schedule->cells[j].type == SLOT_TYPE_DOWNLINK;
+        }
+        printf("%6u %8u %4zu / %-4zu", _n_nodes[i], schedule->id, n_downlinks, schedule->n_cells);
+
+        double ms_per_slot = MARI_WHOLE_SLOT_DURATION / 1000.0;
+        _run(schedule, _n_nodes[i], BENCH_LARGE_PAYLOAD);
+        printf(" %8.1f / %7.1f / %7.1f ms", _percentile(500) * ms_per_slot, _percentile(990) * ms_per_slot, _percentile(1000) * ms_per_slot);
+        _run(schedule, _n_nodes[i], BENCH_SMALL_PAYLOAD);
+        printf(" %8.1f / %7.1f / %7.1f ms\n", _percentile(500) * ms_per_slot, _percentile(990) * ms_per_slot, _percentile(1000) * ms_per_slot);
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static void _run(const schedule_t *schedule, uint32_t n_nodes, uint8_t payload_len) {
+    bench_init_device(MARI_GATEWAY, schedule, NULL);
+    for (uint64_t node_id = BENCH_NODE_ID_BASE; node_id < BENCH_NODE_ID_BASE + n_nodes; node_id++) {
+        mr_scheduler_gateway_assign_next_available_uplink_cell(node_id, 0);
+    }
+    _bench_vars.backlog_first = 0;
+    _bench_vars.backlog_len   = 0;
+    _bench_vars.result.len    = 0;
+
+    for (uint64_t asn = 0; asn < (uint64_t)BENCH_ROUNDS * BENCH_ROUND_SLOTS; asn++) {
+        if (asn % BENCH_ROUND_SLOTS == 0) {
+            for (uint64_t i = 0; i < n_nodes; i++) {
+                size_t position                = (_bench_vars.backlog_first + _bench_vars.backlog_len++) % BENCH_MAX_COMMANDS;
+                _bench_vars.backlog[position] = (bench_command_t){ .dst = BENCH_NODE_ID_BASE + i, .asn = asn };
+            }
+        }
+
+        // the application sends what the queue takes, and holds the rest
+        while (_bench_vars.backlog_len > 0) {
+            const bench_command_t *command = &_bench_vars.backlog[_bench_vars.backlog_first];
+            uint8_t               *payload = mari_tx_buffer();
+            if (payload == NULL) {
+                break;
+            }
+            memset(payload, 0, payload_len);
+            memcpy(payload, &command->asn, sizeof(uint64_t));
+            if (!mari_tx_commit(command->dst, payload_len)) {
+                break;
+            }
+            _bench_vars.backlog_first = (_bench_vars.backlog_first + 1) % BENCH_MAX_COMMANDS;
+            _bench_vars.backlog_len--;
+        }
+
+        if (schedule->cells[asn % schedule->n_cells].type == SLOT_TYPE_DOWNLINK) {
+            uint8_t  length;
+            uint8_t *packet = mr_queue_next_packet(SLOT_TYPE_DOWNLINK, &length);
+            if (packet != NULL) {
+                _receive(packet, length, asn);
+            }
+        }
+    }
+}
+
+// what all the nodes would get out of the frame
+static void _receive(const uint8_t *packet, uint8_t length, uint64_t asn) {
+    const mr_packet_header_t *header = (const mr_packet_header_t *)packet;
+    bench_result_t           *result = &_bench_vars.result;
+    uint64_t                  due_asn;
+
+    if (header->type == MARI_PACKET_DATA) {
+        memcpy(&due_asn, packet + sizeof(mr_packet_header_t), sizeof(uint64_t));
+        result->latencies[result->len++] = asn - due_asn;
+        return;
+    }
+
+    size_t offset = sizeof(mr_packet_header_t);
+    while (offset + MARI_RECORD_HEADER_LEN <= length) {
+        uint8_t payload_len = packet[offset + sizeof(uint16_t)];
+        memcpy(&due_asn, packet + offset + MARI_RECORD_HEADER_LEN, sizeof(uint64_t));
+        result->latencies[result->len++] = asn - due_asn;
+        offset += MARI_RECORD_HEADER_LEN + payload_len;
+    }
+}
+
+// Sorts the latencies in place
+static uint32_t _percentile(uint32_t permille) {
+    bench_result_t *result = &_bench_vars.result;
+    if (result->len == 0) {
+        return 0;
+    }
+    qsort(result->latencies, result->len, sizeof(result->latencies[0]), &_compare);
+    return result->latencies[(uint64_t)(result->len - 1) * permille / 1000];
+}
+
+static int _compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,153 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Cost of the per-slot node expiry check at the gateway
+ *
+ * Compares mr_assoc_gateway_clear_old_nodes, which only visits the nodes
+ * expiring at the current ASN, with the previous implementation, which
+ * checked the last_received_asn of every cell on every slot. The gateway is
+ * full, every node sends a keep-alive in its own uplink slot, and one node
+ * out of ten is silent: it expires, and joins again right away.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "mac.h"
+#include "association.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_SLOTS        1000000
+#define BENCH_NODE_ID_BASE 0x1000
+#define BENCH_SILENT_EVERY 10  ///< One node out of this many never sends anything
+
+typedef void (*clear_old_nodes_t)(uint64_t asn);
+
+//=========================== variables ========================================
+
+static const schedule_t *_schedules[] = { &schedule_tiny, &schedule_medium, &schedule_big, &schedule_huge };
+
+static struct {
+    uint64_t left[MARI_N_CELLS_MAX];          ///< Nodes that expired during the last slot
+    size_t   left_len;
+    uint64_t node_of_cell[MARI_N_CELLS_MAX];  ///< Node assigned to each cell, as known by the bench
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static void     _event_callback(mr_event_t event, mr_event_data_t event_data);
+static void     _clear_old_nodes_full_scan(uint64_t asn);
+static void     _assign(uint64_t node_id, uint64_t asn);
+static uint64_t _run(const schedule_t *schedule, clear_old_nodes_t clear_old_nodes, uint32_t *n_left);
+static void     _fill(const schedule_t *schedule);
+static void     _empty(void);
+
+//=========================== main =============================================
+
+int main(void) {
+    bench_init_device(MARI_GATEWAY, &schedule_huge, &_event_callback);
+
+    printf("node expiry check at the gateway, %d slots, 1 node in %d silent\n\n", BENCH_SLOTS, BENCH_SILENT_EVERY);
+    printf("%-8s %6s %6s %10s %16s %16s\n", "schedule", "cells", "nodes", "expired", "full scan", "timing wheel");
+    for (size_t i = 0; i < sizeof(_schedules) / sizeof(_schedules[0]); i++) {
+        const schedule_t *schedule = _schedules[i];
+        mr_scheduler_set_schedule(schedule->id);
+
+        uint32_t left_scan, left_wheel;
+        uint64_t scan  = _run(schedule, &_clear_old_nodes_full_scan, &left_scan);
+        uint64_t wheel = _run(schedule, &mr_assoc_gateway_clear_old_nodes, &left_wheel);
+        if (left_scan != left_wheel) {
+            fprintf(stderr, "mismatch: %u nodes expired with the full scan, %u with the timing wheel\n", left_scan, left_wheel);
+            return EXIT_FAILURE;
+        }
+        printf("%-8u %6zu %6u %10u %9.1f %-6s %9.1f %-6s\n", schedule->id, schedule->n_cells, schedule->max_nodes, left_wheel,
+               (double)scan / BENCH_SLOTS, BENCH_UNIT, (double)wheel / BENCH_SLOTS, BENCH_UNIT);
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static void _event_callback(mr_event_t event, mr_event_data_t event_data) {
+    if (event == MARI_NODE_LEFT) {
+        _bench_vars.left[_bench_vars.left_len++] = event_data.data.node_info.node_id;
+    }
+}
+
+// Previous implementation of mr_assoc_gateway_clear_old_nodes
+static void _clear_old_nodes_full_scan(uint64_t asn) {
+    uint64_t max_asn_old = mr_scheduler_get_active_schedule_slot_count() * MARI_MAX_SLOTFRAMES_NO_RX_LEAVE;
+
+    size_t          n_uplinks;
+    const uplink_t *uplinks = mr_scheduler_get_uplinks(&n_uplinks);
+    for (size_t i = 0; i < n_uplinks; i++) {
+        const uplink_t *uplink = &uplinks[i];
+        if (uplink->assigned_node_id != 0 && asn - uplink->last_received_asn > max_asn_old) {
+            mr_event_data_t event_data = (mr_event_data_t){ .data.node_info.node_id = uplink->assigned_node_id, .tag = MARI_PEER_LOST_TIMEOUT };
+            mr_scheduler_gateway_deassign_cell(mr_scheduler_gateway_get_node_cell(uplink->assigned_node_id));
+            _event_callback(MARI_NODE_LEFT, event_data);
+        }
+    }
+}
+
+// Returns the time spent in clear_old_nodes
+static void _assign(uint64_t node_id, uint64_t asn) {
+    int16_t cell_index = mr_scheduler_gateway_assign_next_available_uplink_cell(node_id, asn);
+    if (cell_index >= 0) {
+        _bench_vars.node_of_cell[cell_index] = node_id;
+    }
+}
+
+static uint64_t _run(const schedule_t *schedule, clear_old_nodes_t clear_old_nodes, uint32_t *n_left) {
+    uint64_t total = 0;
+    *n_left        = 0;
+    _fill(schedule);
+
+    for (uint64_t asn = 1; asn <= BENCH_SLOTS; asn++) {
+        // silent nodes join again as soon as they are gone
+        for (size_t i = 0; i < _bench_vars.left_len; i++) {
+            _assign(_bench_vars.left[i], asn);
+        }
+        *n_left += _bench_vars.left_len;
+        _bench_vars.left_len = 0;
+
+        uint64_t start = bench_now();
+        clear_old_nodes(asn);
+        total += bench_now() - start;
+
+        uint64_t node_id = _bench_vars.node_of_cell[asn % schedule->n_cells];
+        if (node_id != 0 && node_id % BENCH_SILENT_EVERY != 0) {
+            mr_assoc_gateway_keep_node_alive(node_id, asn);
+        }
+    }
+
+    _empty();
+    return total;
+}
+
+static void _fill(const schedule_t *schedule) {
+    for (uint64_t node_id = BENCH_NODE_ID_BASE; node_id < BENCH_NODE_ID_BASE + (uint64_t)schedule->max_nodes; node_id++) {
+        _assign(node_id, 0);
+    }
+}
+
+static void _empty(void) {
+    uint64_t nodes[MARI_N_CELLS_MAX];
+    uint16_t n_nodes = mr_scheduler_gateway_get_nodes(nodes);
+    for (size_t i = 0; i < n_nodes; i++) {
+        mr_scheduler_gateway_deassign_cell(mr_scheduler_gateway_get_node_cell(nodes[i]));
+    }
+    memset(_bench_vars.node_of_cell, 0, sizeof(_bench_vars.node_of_cell));
+    _bench_vars.left_len = 0;
+}
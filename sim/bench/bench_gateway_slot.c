@@ -0,0 +1,161 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Per-slot work of a full gateway, with schedules of up to 1024 cells and 512 nodes
+ *
+ * Runs what the gateway does at the beginning of every slot, before the radio
+ * has to start: expiry check, schedule adaptation, tick, and the packet of the
+ * slot, including the beacon. Every node sends a keep-alive in its own uplink
+ * slot, and one node out of ten is silent: it expires, and joins again right
+ * away, which also patches the bloom filter of the beacons (see
+ * bench_bloom_churn).
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mari.h"
+#include "mac.h"
+#include "association.h"
+#include "queue.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_SLOTS        1000000
+#define BENCH_NODE_ID_BASE 0x1000
+#define BENCH_SILENT_EVERY 10    ///< One node out of this many never sends anything
+#define BENCH_CPU_MHZ      64    ///< nRF52840 core clock, to express the slot budget in cycles
+#define BENCH_PERMILLE     999   ///< Reported percentile, instead of the maximum, which is mostly preemption by the host OS
+
+typedef struct {
+    uint32_t samples[BENCH_SLOTS];
+    uint32_t count;
+    uint64_t total;
+} bench_time_t;
+
+//=========================== variables ========================================
+
+static const mr_schedule_params_t _params[] = {
+    { .id = 0x10, .n_beacons = 3, .n_uplinks = 512, .uplinks_per_downlink = 5, .uplinks_per_shared = 5 },  ///< 721 cells
+    { .id = 0x11, .n_beacons = 4, .n_uplinks = 510, .uplinks_per_downlink = 2, .uplinks_per_shared = 2 },  ///< 1024 cells
+};
+
+static struct {
+    schedule_t   schedule;                        ///< Built from _params
+    uint64_t     left[MARI_MAX_NODES];            ///< Nodes that expired during the last slot
+    size_t       left_len;
+    uint64_t     node_of_cell[MARI_N_CELLS_MAX];  ///< Node assigned to each cell, as known by the bench
+    uint8_t      packet_len;
+    bench_time_t slot;                            ///< Beginning of every slot
+} _bench_vars = { 0 };
+
+//=========================== prototypes =======================================
+
+static void _event_callback(mr_event_t event, mr_event_data_t event_data);
+static void _assign(uint64_t node_id, uint64_t asn);
+static void _run(const schedule_t *schedule);
+static void     _add(bench_time_t *time, uint64_t elapsed);
+static uint32_t _percentile(bench_time_t *time);
+static int      _compare(const void *a, const void *b);
+
+//=========================== main =============================================
+
+int main(void) {
+    printf("per-slot work of a full gateway, %d slots, 1 node in %d silent\n", BENCH_SLOTS, BENCH_SILENT_EVERY);
+    printf("budget: the radio starts %d us into the slot, %d cycles at %d MHz\n\n", MARI_TS_TX_OFFSET, MARI_TS_TX_OFFSET * BENCH_CPU_MHZ, BENCH_CPU_MHZ);
+    printf("%-8s %6s %6s %10s %24s\n", "schedule", "cells", "nodes", "expired", "slot (avg/p99.9)");
+
+    _run(&schedule_huge);
+    for (size_t i = 0; i < sizeof(_params) / sizeof(_params[0]); i++) {
+        if (!mr_scheduler_build_schedule(&_bench_vars.schedule, &_params[i])) {
+            fprintf(stderr, "cannot build a schedule with %u uplink cells\n", _params[i].n_uplinks);
+            return EXIT_FAILURE;
+        }
+        _run(&_bench_vars.schedule);
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static void _event_callback(mr_event_t event, mr_event_data_t event_data) {
+    if (event == MARI_NODE_LEFT) {
+        _bench_vars.left[_bench_vars.left_len++] = event_data.data.node_info.node_id;
+    }
+}
+
+static void _assign(uint64_t node_id, uint64_t asn) {
+    int16_t cell_index = mr_scheduler_gateway_assign_next_available_uplink_cell(node_id, asn);
+    if (cell_index >= 0) {
+        _bench_vars.node_of_cell[cell_index] = node_id;
+    }
+}
+
+static void _run(const schedule_t *schedule) {
+    bench_time_t *slot   = &_bench_vars.slot;
+    uint32_t      n_left = 0;
+    slot->count          = 0;
+    slot->total          = 0;
+    bench_init_device(MARI_GATEWAY, schedule, &_event_callback);
+    memset(_bench_vars.node_of_cell, 0, sizeof(_bench_vars.node_of_cell));
+
+    for (uint64_t node_id = BENCH_NODE_ID_BASE; node_id < BENCH_NODE_ID_BASE + (uint64_t)schedule->max_nodes; node_id++) {
+        _assign(node_id, 0);
+    }
+
+    for (uint64_t asn = 1; asn <= BENCH_SLOTS; asn++) {
+        // silent nodes join again as soon as they are gone
+        for (size_t i = 0; i < _bench_vars.left_len; i++) {
+            _assign(_bench_vars.left[i], asn);
+        }
+        n_left += _bench_vars.left_len;
+        _bench_vars.left_len = 0;
+
+        // same sequence as the beginning of a slot in the mac
+        uint64_t start = bench_now();
+        mr_assoc_gateway_clear_old_nodes(asn);
+        mr_scheduler_gateway_adapt_schedule(asn);
+        mr_slot_info_t slot_info = mr_scheduler_tick(asn);
+        if (slot_info.radio_action == MARI_RADIO_ACTION_TX) {
+            mr_queue_next_packet(slot_info.type, &_bench_vars.packet_len);
+        }
+        _add(slot, bench_now() - start);
+
+        uint64_t node_id = _bench_vars.node_of_cell[asn % schedule->n_cells];
+        if (node_id != 0 && node_id % BENCH_SILENT_EVERY != 0) {
+            mr_assoc_gateway_keep_node_alive(node_id, asn);
+        }
+    }
+
+    printf("%-8u %6zu %6u %10u %7.1f / %-7u %-6s\n", schedule->id, schedule->n_cells, schedule->max_nodes, n_left,
+           (double)slot->total / slot->count, _percentile(slot), BENCH_UNIT);
+}
+
+static void _add(bench_time_t *time, uint64_t elapsed) {
+    time->total += elapsed;
+    time->samples[time->count++] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+}
+
+// Sorts the samples in place
+static uint32_t _percentile(bench_time_t *time) {
+    if (time->count == 0) {
+        return 0;
+    }
+    qsort(time->samples, time->count, sizeof(time->samples[0]), &_compare);
+    return time->samples[(uint64_t)(time->count - 1) * BENCH_PERMILLE / 1000];
+}
+
+static int _compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,160 @@
+/**
+ * @file
+ * @ingroup     sim_bench
+ *
+ * @brief       Cost of mr_scheduler_tick
+ *
+ * Compares mr_scheduler_tick, which loads the radio action of the cell from a
+ * table built when the schedule is activated and keeps the cell index and the
+ * channel as counters, with the previous implementation, which switched on
+ * the cell type and computed two 64-bit modulos of the ASN on every slot.
+ * Both are run for consecutive ASNs, as the MAC does, on each role.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mari.h"
+#include "mr_device.h"
+#include "association.h"
+#include "scheduler.h"
+#include "bench.h"
+
+//=========================== defines ==========================================
+
+#define BENCH_SLOTS     1000000
+#define BENCH_FIRST_ASN ((1ULL << 40) + 12345)  ///< Large enough for the modulos to need the full 64-bit division
+
+typedef mr_slot_info_t (*tick_t)(uint64_t asn);
+
+//=========================== variables ========================================
+
+static const schedule_t *_schedules[] = { &schedule_tiny, &schedule_medium, &schedule_big, &schedule_huge };
+
+static const mr_node_type_t _roles[] = { MARI_GATEWAY, MARI_NODE };
+
+static struct {
+    bool owned[MARI_N_CELLS_MAX];  ///< Uplink cells assigned to this device, as the previous cell_t stored it
+} _bench_vars = { 0 };
+
+static volatile uint8_t _sink;
+
+//=========================== prototypes =======================================
+
+static mr_slot_info_t _tick_switch(uint64_t asn);
+static bool           _check(void);
+static uint64_t       _run(tick_t tick);
+
+//=========================== main =============================================
+
+int main(void) {
+    bench_init_device(MARI_NODE, &schedule_huge, NULL);
+
+    printf("scheduler tick, %d consecutive slots from asn %llu\n\n", BENCH_SLOTS, (unsigned long long)BENCH_FIRST_ASN);
+    printf("%-8s %6s %-8s %16s %16s\n", "schedule", "cells", "role", "switch", "table");
+    for (size_t i = 0; i < sizeof(_schedules) / sizeof(_schedules[0]); i++) {
+        const schedule_t *schedule = _schedules[i];
+        mr_scheduler_set_schedule(schedule->id);
+
+        // as a node, own the first uplink cell of the schedule
+        mr_scheduler_node_deassign_myself_from_schedule();
+        for (size_t j = 0; j < schedule->n_cells; j++) {
+            _bench_vars.owned[j] = false;
+        }
+        for (size_t j = 0; j < schedule->n_cells; j++) {
+            if (schedule->cells[j].type == SLOT_TYPE_UPLINK) {
+                mr_scheduler_node_assign_myself_to_cell(j);
+                _bench_vars.owned[j] = true;
+                break;
+            }
+        }
+
+        for (size_t j = 0; j < sizeof(_roles) / sizeof(_roles[0]); j++) {
+            mari_set_node_type(_roles[j]);
+            if (!_check()) {
+                fprintf(stderr, "mismatch between the two implementations, schedule %u, role %c\n", schedule->id, _roles[j]);
+                return EXIT_FAILURE;
+            }
+
+            uint64_t with_switch = _run(&_tick_switch);
+            uint64_t with_table  = _run(&mr_scheduler_tick);
+            printf("%-8u %6zu %-8s %9.1f %-6s %9.1f %-6s\n", schedule->id, schedule->n_cells, _roles[j] == MARI_GATEWAY ? "gateway" : "node",
+                   (double)with_switch / BENCH_SLOTS, BENCH_UNIT, (double)with_table / BENCH_SLOTS, BENCH_UNIT);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+// Previous implementation of mr_scheduler_tick
+static mr_slot_info_t _tick_switch(uint64_t asn) {
+    const schedule_t *schedule   = mr_scheduler_get_active_schedule_ptr();
+    size_t            cell_index = asn % schedule->n_cells;
+    const cell_t     *cell       = &schedule->cells[cell_index];
+
+    mr_slot_info_t slot_info = {
+        .radio_action = MARI_RADIO_ACTION_SLEEP,
+        .channel      = mr_scheduler_get_channel(cell->type, asn, cell->channel_offset),
+        .type         = cell->type,
+    };
+    if (mari_get_node_type() == MARI_GATEWAY) {
+        switch (cell->type) {
+            case SLOT_TYPE_BEACON:
+            case SLOT_TYPE_DOWNLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_TX;
+                break;
+            case SLOT_TYPE_SHARED_UPLINK:
+            case SLOT_TYPE_UPLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_RX;
+                break;
+        }
+    } else {
+        switch (cell->type) {
+            case SLOT_TYPE_BEACON:
+            case SLOT_TYPE_DOWNLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_RX;
+                break;
+            case SLOT_TYPE_SHARED_UPLINK:
+                slot_info.radio_action = MARI_RADIO_ACTION_TX;
+                break;
+            case SLOT_TYPE_UPLINK:
+                slot_info.radio_action = _bench_vars.owned[cell_index] ? MARI_RADIO_ACTION_TX : MARI_RADIO_ACTION_SLEEP;
+                break;
+        }
+        if (cell->type == SLOT_TYPE_SHARED_UPLINK) {
+            mr_assoc_node_tick_backoff();
+        }
+    }
+    return slot_info;
+}
+
+// Both implementations return the same slot info, including after a jump in the asn
+static bool _check(void) {
+    const uint64_t starts[] = { 0, BENCH_FIRST_ASN, BENCH_FIRST_ASN + 1000 };
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+        for (uint64_t asn = starts[i]; asn < starts[i] + 3 * MARI_N_CELLS_MAX; asn++) {
+            mr_slot_info_t expected = _tick_switch(asn);
+            mr_slot_info_t actual   = mr_scheduler_tick(asn);
+            if (expected.radio_action != actual.radio_action || expected.channel != actual.channel || expected.type != actual.type) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Returns the time spent ticking all the slots
+static uint64_t _run(tick_t tick) {
+    uint64_t start = bench_now();
+    for (uint64_t asn = BENCH_FIRST_ASN; asn < BENCH_FIRST_ASN + BENCH_SLOTS; asn++) {
+        mr_slot_info_t slot_info = tick(asn);
+        _sink                    = slot_info.radio_action ^ slot_info.channel;
+    }
+    return bench_now() - start;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Simulated device identification driver
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+
+#include "mr_device.h"
+#include "sim.h"
+
+//=========================== public ===========================================
+
+uint64_t mr_device_addr(void) {
+    return mr_sim_current()->device_id;
+}
+
+uint64_t mr_device_id(void) {
+    return mr_sim_current()->device_id;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Simulated GPIO driver, all pins are no-ops
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+
+#include "mr_gpio.h"
+
+//=========================== public ===========================================
+
+void mr_gpio_init(const mr_gpio_t *gpio, mr_gpio_mode_t mode) {
+    (void)gpio;
+    (void)mode;
+}
+
+void mr_gpio_init_irq(const mr_gpio_t *gpio, mr_gpio_mode_t mode, mr_gpio_irq_edge_t edge, gpio_cb_t callback, void *ctx) {
+    (void)gpio;
+    (void)mode;
+    (void)edge;
+    (void)callback;
+    (void)ctx;
+}
+
+void mr_gpio_set(const mr_gpio_t *gpio) {
+    (void)gpio;
+}
+
+void mr_gpio_clear(const mr_gpio_t *gpio) {
+    (void)gpio;
+}
+
+void mr_gpio_toggle(const mr_gpio_t *gpio) {
+    (void)gpio;
+}
+
+uint8_t mr_gpio_read(const mr_gpio_t *gpio) {
+    (void)gpio;
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Simulated radio driver (BLE 2M)
+ *
+ * Mirrors the state machine of drv/mr_radio/mr_radio_default.c: the radio only
+ * starts a reception or a transmission from IDLE, ADDRESS marks it BUSY and
+ * reports the start of the frame, END reports the end of the frame (only if
+ * the CRC is valid when receiving) and the END->DISABLE short brings it back
+ * to IDLE.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mr_radio.h"
+#include "mr_timer_hf.h"
+#include "sim.h"
+
+//=========================== defines ==========================================
+
+#define RADIO_TIMER_DEV 2  ///< Same timer used by the firmware to timestamp radio events
+
+//=========================== variables ========================================
+
+static const uint8_t _ble_chan_to_freq[40] = {
+    4, 6, 8,
+    10, 12, 14, 16, 18,
+    20, 22, 24, 28,
+    30, 32, 34, 36, 38,
+    40, 42, 44, 46, 48,
+    50, 52, 54, 56, 58,
+    60, 62, 64, 66, 68,
+    70, 72, 74, 76, 78,
+    2, 26, 80  // Advertising channels
+};
+
+//=========================== public ===========================================
+
+void mr_radio_init(radio_ts_packet_t start_pac_cb, radio_ts_packet_t end_pac_cb, mr_radio_mode_t mode) {
+    (void)mode;  // only BLE 2M is simulated
+    mr_sim_radio_t *radio = &mr_sim_current()->radio;
+    radio->start_cb       = start_pac_cb;
+    radio->end_cb         = end_pac_cb;
+    radio->state          = MR_SIM_RADIO_IDLE;
+}
+
+void mr_radio_set_frequency(uint8_t freq) {
+    mr_sim_current()->radio.channel = freq;
+}
+
+void mr_radio_set_channel(uint8_t channel) {
+    mr_radio_set_frequency(_ble_chan_to_freq[channel]);
+}
+
+void mr_radio_set_network_address(uint32_t addr) {
+    (void)addr;
+}
+
+void mr_radio_disable(void) {
+    mr_sim_radio_t *radio = &mr_sim_current()->radio;
+    radio->state          = MR_SIM_RADIO_IDLE;
+    radio->gen++;
+}
+
+int8_t mr_radio_rssi(void) {
+    return mr_sim_current()->radio.rssi;
+}
+
+bool mr_radio_pending_rx_read(void) {
+    return mr_sim_current()->radio.pending_rx_read;
+}
+
+void mr_radio_get_rx_packet(uint8_t *packet, uint8_t *length) {
+    mr_sim_radio_t *radio = &mr_sim_current()->radio;
+    *length               = radio->rx_length;
+    memcpy(packet, radio->rx_payload, radio->rx_length);
+    radio->pending_rx_read = false;
+}
+
+uint8_t *mr_radio_get_rx_packet_in_place(uint8_t *length) {
+    mr_sim_radio_t *radio  = &mr_sim_current()->radio;
+    *length                = radio->rx_length;
+    radio->pending_rx_read = false;
+    return radio->rx_payload;
+}
+
+void mr_radio_rx(void) {
+    mr_sim_node_t *node = mr_sim_current();
+    if (node->radio.state != MR_SIM_RADIO_IDLE) {
+        return;
+    }
+    node->radio.state       = MR_SIM_RADIO_RX;
+    node->radio.rx_ready_ns = node->cpu_ns + MR_SIM_RADIO_RAMP_UP_US * MR_SIM_NS_PER_US;
+}
+
+void mr_radio_tx_prepare(const uint8_t *tx_buffer, uint8_t length) {
+    mr_sim_radio_t *radio = &mr_sim_current()->radio;
+    radio->tx_length      = length;
+    radio->tx_packet      = radio->tx_payload;
+    memcpy(radio->tx_payload, tx_buffer, length);
+}
+
+void mr_radio_tx_prepare_in_place(uint8_t *packet, uint8_t length) {
+    mr_sim_radio_t *radio = &mr_sim_current()->radio;
+    // same writes to the headroom as the real driver
+    packet[-MR_RADIO_TX_HEADROOM] = 0;
+    packet[-1]                    = length;
+    radio->tx_length              = length;
+    radio->tx_packet              = packet;
+}
+
+void mr_radio_tx_dispatch(void) {
+    mr_sim_node_t *node = mr_sim_current();
+    if (node->radio.state != MR_SIM_RADIO_IDLE) {
+        return;
+    }
+    node->radio.state = MR_SIM_RADIO_TX;
+
+    mr_sim_frame_t *frame = mr_sim_medium_new_frame(node);
+    frame->channel        = node->radio.channel;
+    frame->start_ns       = node->cpu_ns + mr_sim_config()->tx_start_delay_us * MR_SIM_NS_PER_US;
+    frame->address_ns     = frame->start_ns + MR_SIM_PREAMBLE_ADDRESS_US * MR_SIM_NS_PER_US;
+    frame->end_ns         = frame->address_ns + (MR_SIM_PDU_OVERHEAD_BYTES + node->radio.tx_length) * MR_SIM_US_PER_BYTE * MR_SIM_NS_PER_US;
+    frame->length         = node->radio.tx_length;
+    memcpy(frame->payload, node->radio.tx_packet, node->radio.tx_length);
+    node->stats.frames_sent++;
+
+    mr_sim_schedule(node, frame->address_ns, MR_SIM_EVENT_TX_ADDRESS, 0, node->radio.gen);
+    mr_sim_schedule(node, frame->end_ns, MR_SIM_EVENT_TX_END, 0, node->radio.gen);
+}
+
+//=========================== simulator ========================================
+
+void mr_sim_radio_handle_event(mr_sim_node_t *node, const mr_sim_event_t *event) {
+    mr_sim_radio_t *radio = &node->radio;
+
+    if (event->type == MR_SIM_EVENT_RX_ADDRESS) {
+        // the radio only locks on a frame if it was listening on the right channel before the preamble
+        mr_sim_frame_t *frame = mr_sim_medium_get_frame(event->arg);
+        if (frame == NULL || radio->state != MR_SIM_RADIO_RX || radio->channel != frame->channel || radio->rx_ready_ns > frame->start_ns) {
+            return;
+        }
+        double rssi         = round(mr_sim_medium_rssi(frame, node));
+        radio->rssi         = rssi < INT8_MIN ? INT8_MIN : (rssi > 0 ? 0 : (int8_t)rssi);
+        radio->rx_frame_id  = frame->id;
+        radio->state       |= MR_SIM_RADIO_BUSY;
+        mr_sim_schedule(node, frame->end_ns, MR_SIM_EVENT_RX_END, frame->id, radio->gen);
+        if (radio->start_cb) {
+            radio->start_cb(mr_timer_hf_now(RADIO_TIMER_DEV));
+        }
+        return;
+    }
+
+    if (event->gen != radio->gen) {
+        return;  // radio was disabled meanwhile
+    }
+
+    uint32_t gen = radio->gen;
+    switch (event->type) {
+        case MR_SIM_EVENT_TX_ADDRESS:
+            radio->state |= MR_SIM_RADIO_BUSY;
+            if (radio->start_cb) {
+                radio->start_cb(mr_timer_hf_now(RADIO_TIMER_DEV));
+            }
+            return;
+        case MR_SIM_EVENT_TX_END:
+            if (radio->end_cb) {
+                radio->end_cb(mr_timer_hf_now(RADIO_TIMER_DEV));
+            }
+            break;
+        case MR_SIM_EVENT_RX_END:
+        {
+            mr_sim_frame_t *frame = mr_sim_medium_get_frame(event->arg);
+            if (frame != NULL && mr_sim_medium_decode(frame, node)) {
+                node->stats.frames_received++;
+                radio->rx_length = frame->length;
+                memcpy(radio->rx_payload, frame->payload, frame->length);
+                if (radio->end_cb) {
+                    radio->pending_rx_read = true;
+                    radio->end_cb(mr_timer_hf_now(RADIO_TIMER_DEV));
+                }
+            } else {
+                node->stats.frames_lost++;  // invalid CRC
+            }
+            break;
+        }
+        default:
+            return;
+    }
+
+    // END is shorted to DISABLE, unless the callback already changed the radio state
+    if (radio->gen == gen) {
+        radio->state = MR_SIM_RADIO_IDLE;
+        radio->gen++;
+    }
+}
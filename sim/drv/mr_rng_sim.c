@@ -0,0 +1,40 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Simulated random number generator driver
+ *
+ * Each device draws from its own deterministic generator, seeded from the
+ * simulation seed, so that a run can be reproduced.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+
+#include "mr_rng.h"
+#include "sim.h"
+
+//=========================== public ===========================================
+
+void mr_rng_init(void) {}
+
+void mr_rng_read_u8(uint8_t *value) {
+    *value = mr_sim_rng_next(&mr_sim_current()->rng_state) & 0xFF;
+}
+
+void mr_rng_read_u8_fast(uint8_t *value) {
+    mr_rng_read_u8(value);
+}
+
+void mr_rng_read_u16(uint16_t *value) {
+    *value = mr_sim_rng_next(&mr_sim_current()->rng_state) & 0xFFFF;
+}
+
+void mr_rng_read_range(uint8_t *value, uint8_t min, uint8_t max) {
+    do {
+        mr_rng_read_u8(value);
+    } while (!(*value >= min && *value < max));
+}
@@ -0,0 +1,165 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Simulated high frequency timer driver
+ *
+ * Mirrors drv/mr_timer_hf/mr_timer_hf.c: every timer is a free running 32-bit
+ * counter at 1 MHz, driven by the local (drifting) clock of the device, and a
+ * compare channel fires when the counter reaches its CC register, wrapping
+ * around if CC was set in the past. The last channel of each timer is reserved
+ * for captures, as in the firmware.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mr_timer_hf.h"
+#include "sim.h"
+
+//=========================== defines ==========================================
+
+#define TIMER_CC_NUM (MR_SIM_TIMER_CHANNELS - 1)  ///< Last channel is used to capture the counter
+
+//=========================== prototypes =======================================
+
+static uint64_t _local_us(mr_sim_node_t *node);
+static void     _arm(mr_sim_node_t *node, timer_hf_t timer, uint8_t channel);
+static void     _set(timer_hf_t timer, uint8_t channel, uint32_t period_us, bool one_shot, timer_hf_cb_t cb);
+
+//=========================== public ===========================================
+
+void mr_timer_hf_init(timer_hf_t timer) {
+    assert(timer < MR_SIM_TIMER_COUNT);
+    (void)timer;
+}
+
+uint32_t mr_timer_hf_now(timer_hf_t timer) {
+    (void)timer;
+    return (uint32_t)_local_us(mr_sim_current());
+}
+
+void mr_timer_hf_set_periodic_us(timer_hf_t timer, uint8_t channel, uint32_t us, timer_hf_cb_t cb) {
+    _set(timer, channel, us, false, cb);
+}
+
+void mr_timer_hf_adjust_periodic_us(timer_hf_t timer, uint8_t channel, int32_t adjust_us) {
+    assert(channel < TIMER_CC_NUM);
+    mr_sim_node_t *node = mr_sim_current();
+
+    // Only update the CC register, so that the adjust applies only to the current "tick"
+    node->timers[timer][channel].cc += adjust_us;
+    if (node->timers[timer][channel].armed) {
+        _arm(node, timer, channel);
+    }
+}
+
+void mr_timer_hf_set_oneshot_us(timer_hf_t timer, uint8_t channel, uint32_t us, timer_hf_cb_t cb) {
+    _set(timer, channel, us, true, cb);
+}
+
+void mr_timer_hf_set_oneshot_with_ref_us(timer_hf_t timer, uint8_t channel, uint32_t base_us, uint32_t us, timer_hf_cb_t cb) {
+    uint32_t now = mr_timer_hf_now(timer);
+    _set(timer, channel, us + (now - base_us), true, cb);
+}
+
+void mr_timer_hf_set_oneshot_with_ref_diff_us(timer_hf_t timer, uint8_t channel, uint32_t base_us, uint32_t us, timer_hf_cb_t cb) {
+    uint32_t now = mr_timer_hf_now(timer);
+    _set(timer, channel, us - (now - base_us), true, cb);
+}
+
+void mr_timer_hf_set_oneshot_ms(timer_hf_t timer, uint8_t channel, uint32_t ms, timer_hf_cb_t cb) {
+    mr_timer_hf_set_oneshot_us(timer, channel, ms * 1000UL, cb);
+}
+
+void mr_timer_hf_set_oneshot_s(timer_hf_t timer, uint8_t channel, uint32_t s, timer_hf_cb_t cb) {
+    mr_timer_hf_set_oneshot_us(timer, channel, s * 1000UL * 1000UL, cb);
+}
+
+void mr_timer_hf_cancel(timer_hf_t timer, uint8_t channel) {
+    assert(channel < TIMER_CC_NUM);
+    mr_sim_timer_channel_t *timer_channel = &mr_sim_current()->timers[timer][channel];
+
+    timer_channel->period_us = 0;
+    timer_channel->callback  = NULL;
+    timer_channel->armed     = false;
+    timer_channel->cc        = 0;
+    timer_channel->gen++;
+}
+
+// The CPU is busy for the whole delay: nothing else runs on this device meanwhile
+void mr_timer_hf_delay_us(timer_hf_t timer, uint32_t us) {
+    (void)timer;
+    mr_sim_node_t *node = mr_sim_current();
+    uint64_t       end  = mr_sim_local_ns(node, node->cpu_ns) + (uint64_t)us * MR_SIM_NS_PER_US;
+    node->cpu_ns        = mr_sim_global_ns(node, end);
+}
+
+void mr_timer_hf_delay_ms(timer_hf_t timer, uint32_t ms) {
+    mr_timer_hf_delay_us(timer, ms * 1000UL);
+}
+
+void mr_timer_hf_delay_s(timer_hf_t timer, uint32_t s) {
+    mr_timer_hf_delay_us(timer, s * 1000UL * 1000UL);
+}
+
+//=========================== simulator ========================================
+
+void mr_sim_timer_handle_event(mr_sim_node_t *node, const mr_sim_event_t *event) {
+    timer_hf_t              timer         = event->arg >> 8;
+    uint8_t                 channel       = event->arg & 0xFF;
+    mr_sim_timer_channel_t *timer_channel = &node->timers[timer][channel];
+
+    if (event->gen != timer_channel->gen || !timer_channel->armed) {
+        return;  // channel was re-armed or cancelled after this event was scheduled
+    }
+
+    if (timer_channel->one_shot) {
+        timer_channel->armed = false;
+    } else {
+        timer_channel->cc += timer_channel->period_us;
+        _arm(node, timer, channel);
+    }
+    if (timer_channel->callback) {
+        timer_channel->callback();
+    }
+}
+
+//=========================== private ==========================================
+
+static uint64_t _local_us(mr_sim_node_t *node) {
+    return mr_sim_local_ns(node, node->cpu_ns) / MR_SIM_NS_PER_US;
+}
+
+static void _set(timer_hf_t timer, uint8_t channel, uint32_t period_us, bool one_shot, timer_hf_cb_t cb) {
+    assert(timer < MR_SIM_TIMER_COUNT);
+    assert(channel < TIMER_CC_NUM);  // Make sure the required channel is correct
+    assert(cb);                      // Make sure the callback function is valid
+
+    mr_sim_node_t          *node          = mr_sim_current();
+    mr_sim_timer_channel_t *timer_channel = &node->timers[timer][channel];
+
+    timer_channel->period_us = period_us;
+    timer_channel->one_shot  = one_shot;
+    timer_channel->callback  = cb;
+    timer_channel->armed     = true;
+    timer_channel->cc        = (uint32_t)_local_us(node) + period_us;
+    _arm(node, timer, channel);
+}
+
+// Schedule the next time the 32-bit counter matches CC
+static void _arm(mr_sim_node_t *node, timer_hf_t timer, uint8_t channel) {
+    mr_sim_timer_channel_t *timer_channel = &node->timers[timer][channel];
+
+    uint64_t now_us = _local_us(node);
+    uint32_t ticks  = timer_channel->cc - (uint32_t)now_us;
+    uint64_t fire   = now_us + (ticks ? ticks : (1ULL << 32));
+
+    timer_channel->gen++;
+    mr_sim_schedule(node, mr_sim_global_ns(node, fire * MR_SIM_NS_PER_US), MR_SIM_EVENT_TIMER, ((uint64_t)timer << 8) | channel, timer_channel->gen);
+}
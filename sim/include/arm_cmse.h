@@ -0,0 +1,13 @@
+#ifndef __SIM_ARM_CMSE_H
+#define __SIM_ARM_CMSE_H
+
+/**
+ * @file
+ * @ingroup     sim
+ * @brief       Empty stand-in for the ARM CMSE header
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ */
+
+#endif  // __SIM_ARM_CMSE_H
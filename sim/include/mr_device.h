@@ -0,0 +1,25 @@
+#ifndef __MR_DEVICE_H
+#define __MR_DEVICE_H
+
+/**
+ * @defgroup    sim_device  Simulated device identity
+ * @ingroup     sim
+ * @brief       Host replacement for drv/mr_device.h
+ *
+ * On hardware the device id is read from FICR. In the simulator every
+ * simulated device gets its id from the simulation engine.
+ *
+ * @{
+ * @file
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ * @}
+ */
+
+#include <stdint.h>
+
+uint64_t mr_device_addr(void);
+
+uint64_t mr_device_id(void);
+
+#endif /* __MR_DEVICE_H */
@@ -0,0 +1,54 @@
+#ifndef __MR_GPIO_H
+#define __MR_GPIO_H
+
+/**
+ * @defgroup    sim_gpio    Simulated GPIO
+ * @ingroup     sim
+ * @brief       Host replacement for drv/mr_gpio.h
+ *
+ * The mari core toggles debug pins. On the host these calls are no-ops.
+ *
+ * @{
+ * @file
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ * @}
+ */
+
+#include <stdint.h>
+
+//=========================== defines ==========================================
+
+typedef void (*gpio_cb_t)(void *ctx);  ///< Callback function prototype, it is called on each gpio interrupt
+
+/// GPIO mode
+typedef enum {
+    MR_GPIO_OUT,    ///< Floating output
+    MR_GPIO_IN,     ///< Floating input
+    MR_GPIO_IN_PU,  ///< Pull up input
+    MR_GPIO_IN_PD,  ///< Pull down input
+} mr_gpio_mode_t;
+
+/// GPIO interrupt edge
+typedef enum {
+    MR_GPIO_IRQ_EDGE_RISING,   ///< Rising edge
+    MR_GPIO_IRQ_EDGE_FALLING,  ///< Falling edge
+    MR_GPIO_IRQ_EDGE_BOTH,     ///< Both falling and rising edges
+} mr_gpio_irq_edge_t;
+
+/// GPIO instance
+typedef struct {
+    uint8_t port;  ///< Port number of the GPIO
+    uint8_t pin;   ///< Pin number of the GPIO
+} mr_gpio_t;
+
+//============================ public ==========================================
+
+void    mr_gpio_init(const mr_gpio_t *gpio, mr_gpio_mode_t mode);
+void    mr_gpio_init_irq(const mr_gpio_t *gpio, mr_gpio_mode_t mode, mr_gpio_irq_edge_t edge, gpio_cb_t callback, void *ctx);
+void    mr_gpio_set(const mr_gpio_t *gpio);
+void    mr_gpio_clear(const mr_gpio_t *gpio);
+void    mr_gpio_toggle(const mr_gpio_t *gpio);
+uint8_t mr_gpio_read(const mr_gpio_t *gpio);
+
+#endif /* __MR_GPIO_H */
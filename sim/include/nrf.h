@@ -0,0 +1,16 @@
+#ifndef __SIM_NRF_H
+#define __SIM_NRF_H
+
+/**
+ * @file
+ * @ingroup     sim
+ * @brief       Empty stand-in for the nRF MDK device header
+ *
+ * The mari core only includes <nrf.h> for the device types it never uses
+ * on the host, so the simulator provides an empty header.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ */
+
+#endif  // __SIM_NRF_H
@@ -0,0 +1,13 @@
+#ifndef __SIM_NRF_PERIPHERALS_H
+#define __SIM_NRF_PERIPHERALS_H
+
+/**
+ * @file
+ * @ingroup     sim
+ * @brief       Empty stand-in for the nRF MDK peripherals header
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ */
+
+#endif  // __SIM_NRF_PERIPHERALS_H
@@ -0,0 +1,153 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Loads one private copy of the mari core per simulated device
+ *
+ * dlopen only loads a given file once, so the library is copied to a new
+ * temporary file for every device, opened, and unlinked right away. The
+ * library is linked with -Bsymbolic, so each copy binds to its own variables,
+ * while the driver symbols resolve to the simulator executable.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "instance.h"
+
+//=========================== variables ========================================
+
+static struct {
+    uint8_t *data;
+    size_t   len;
+    char     dir[64];  ///< Private directory for the temporary copies
+    uint32_t copies;
+} _library = { 0 };
+
+//=========================== prototypes =======================================
+
+static void *_lookup(struct mr_sim_instance *instance, const char *symbol);
+
+//=========================== public ===========================================
+
+int mr_sim_instance_load_library(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    free(_library.data);
+    _library.data = malloc(len);
+    _library.len  = fread(_library.data, 1, len, file);
+    fclose(file);
+
+    return _library.len == (size_t)len ? 0 : -1;
+}
+
+void mr_sim_instance_unload_library(void) {
+    if (_library.dir[0] != '\0') {
+        rmdir(_library.dir);
+    }
+    free(_library.data);
+    memset(&_library, 0, sizeof(_library));
+}
+
+struct mr_sim_instance *mr_sim_instance_new(void) {
+    if (_library.dir[0] == '\0') {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(_library.dir, sizeof(_library.dir), "%s/mari_sim.XXXXXX", tmp ? tmp : "/tmp");
+        if (mkdtemp(_library.dir) == NULL) {
+            perror(_library.dir);
+            _library.dir[0] = '\0';
+            return NULL;
+        }
+    }
+
+    char path[96];
+    snprintf(path, sizeof(path), "%s/libmari_sim_%u.so", _library.dir, _library.copies++);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+    size_t written = fwrite(_library.data, 1, _library.len, file);
+    fclose(file);
+
+    void *handle = written == _library.len ? dlopen(path, RTLD_NOW | RTLD_LOCAL) : NULL;
+    unlink(path);  // the mapping stays valid
+    if (handle == NULL) {
+        fprintf(stderr, "dlopen: %s\n", dlerror());
+        return NULL;
+    }
+
+    struct mr_sim_instance *instance = calloc(1, sizeof(struct mr_sim_instance));
+    instance->handle                 = handle;
+    instance->init                   = _lookup(instance, "mari_init");
+    instance->event_loop             = _lookup(instance, "mari_event_loop");
+    instance->tx                     = _lookup(instance, "mari_tx");
+    instance->tx_buffer              = _lookup(instance, "mari_tx_buffer");
+    instance->tx_commit              = _lookup(instance, "mari_tx_commit");
+    instance->gateway_get_nodes      = _lookup(instance, "mari_gateway_get_nodes");
+    instance->gateway_count_nodes    = _lookup(instance, "mari_gateway_count_nodes");
+    instance->node_tx_payload        = _lookup(instance, "mari_node_tx_payload");
+    instance->node_is_connected      = _lookup(instance, "mari_node_is_connected");
+    instance->node_gateway_id        = _lookup(instance, "mari_node_gateway_id");
+    instance->mac_get_asn            = _lookup(instance, "mr_mac_get_asn");
+    instance->build_schedule         = _lookup(instance, "mr_scheduler_build_schedule");
+
+    if (instance->init == NULL || instance->event_loop == NULL || instance->tx == NULL) {
+        mr_sim_instance_free(instance);
+        return NULL;
+    }
+    return instance;
+}
+
+void mr_sim_instance_free(struct mr_sim_instance *instance) {
+    if (instance == NULL) {
+        return;
+    }
+    if (instance->handle != NULL) {
+        dlclose(instance->handle);
+    }
+    free(instance);
+}
+
+// Returns NULL if there is no such schedule, or if the auto schedule cannot fit n_nodes
+const schedule_t *mr_sim_instance_schedule(struct mr_sim_instance *instance, const char *name, uint32_t n_nodes) {
+    if (strcmp(name, MR_SIM_SCHEDULE_AUTO) == 0) {
+        mr_schedule_params_t params = {
+            .id                   = MR_SIM_SCHEDULE_AUTO_ID,
+            .n_beacons            = 3,
+            .n_uplinks            = n_nodes > UINT16_MAX ? 0 : n_nodes,
+            .uplinks_per_downlink = 5,
+            .uplinks_per_shared   = 5,
+        };
+        return instance->build_schedule(&instance->built_schedule, &params) ? &instance->built_schedule : NULL;
+    }
+
+    char symbol[64];
+    snprintf(symbol, sizeof(symbol), "schedule_%s", name);
+    return _lookup(instance, symbol);
+}
+
+//=========================== private ==========================================
+
+static void *_lookup(struct mr_sim_instance *instance, const char *symbol) {
+    void *address = dlsym(instance->handle, symbol);
+    if (address == NULL) {
+        fprintf(stderr, "dlsym: %s\n", dlerror());
+    }
+    return address;
+}
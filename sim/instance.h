@@ -0,0 +1,61 @@
+#ifndef __INSTANCE_H
+#define __INSTANCE_H
+
+/**
+ * @ingroup     sim
+ * @brief       Private copies of the mari core, one per simulated device
+ *
+ * The mari core keeps its whole state in static variables, like any firmware.
+ * To run many devices in a single process, every device gets its own copy of
+ * libmari_sim.so, loaded with dlopen from an anonymous file. The simulated
+ * drivers are exported by the simulator executable and shared by all copies.
+ *
+ * @{
+ * @file
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ * @}
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "models.h"
+
+//=========================== defines ==========================================
+
+#define MR_SIM_SCHEDULE_AUTO    "auto"  ///< Schedule name asking for a schedule built for the number of nodes
+#define MR_SIM_SCHEDULE_AUTO_ID 0x10    ///< Id of the built schedule, does not collide with the built-in ones
+
+struct mr_sim_instance {
+    void *handle;
+
+    // public api of the core, see mari.h
+    void (*init)(mr_node_type_t node_type, uint16_t net_id, const schedule_t *app_schedule, mr_event_cb_t app_event_callback);
+    void (*event_loop)(void);
+    bool (*tx)(uint8_t *packet, uint8_t length);
+    uint8_t *(*tx_buffer)(void);
+    bool (*tx_commit)(uint64_t dst, uint8_t payload_len);
+    size_t (*gateway_get_nodes)(uint64_t *nodes);
+    size_t (*gateway_count_nodes)(void);
+    bool (*node_tx_payload)(uint8_t *payload, uint8_t payload_len);
+    bool (*node_is_connected)(void);
+    uint64_t (*node_gateway_id)(void);
+
+    // internal api, see mac.h and scheduler.h
+    uint64_t (*mac_get_asn)(void);
+    bool (*build_schedule)(schedule_t *schedule, const mr_schedule_params_t *params);
+
+    schedule_t built_schedule;  ///< Schedule built for the deployment, see mr_sim_instance_schedule
+};
+
+//=========================== prototypes =======================================
+
+int                     mr_sim_instance_load_library(const char *path);
+void                    mr_sim_instance_unload_library(void);
+struct mr_sim_instance *mr_sim_instance_new(void);
+void                    mr_sim_instance_free(struct mr_sim_instance *instance);
+const schedule_t       *mr_sim_instance_schedule(struct mr_sim_instance *instance, const char *name, uint32_t n_nodes);
+
+#endif  // __INSTANCE_H
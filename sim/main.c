@@ -0,0 +1,273 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Command line front-end of the mari network simulator
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+//=========================== defines ==========================================
+
+#define SIM_DEFAULT_LIBRARY "libmari_sim.so"  ///< Looked up next to the executable
+
+#define SIM_PROBE_MIN_LEN 17  ///< Payload bytes needed to carry the latency probe
+
+enum {
+    OPT_SEED = 0x100,
+    OPT_AREA,
+    OPT_SPEED,
+    OPT_FADING,
+    OPT_BOOT_SPREAD,
+    OPT_UPLINK_PERIOD,
+    OPT_DOWNLINK_PERIOD,
+    OPT_PAYLOAD,
+    OPT_PPM,
+    OPT_LIBRARY,
+};
+
+//=========================== variables ========================================
+
+static const struct option _options[] = {
+    { "gateways", required_argument, NULL, 'g' },
+    { "nodes", required_argument, NULL, 'n' },
+    { "schedule", required_argument, NULL, 's' },
+    { "duration", required_argument, NULL, 'd' },
+    { "seed", required_argument, NULL, OPT_SEED },
+    { "area", required_argument, NULL, OPT_AREA },
+    { "speed", required_argument, NULL, OPT_SPEED },
+    { "fading", required_argument, NULL, OPT_FADING },
+    { "boot-spread", required_argument, NULL, OPT_BOOT_SPREAD },
+    { "uplink-period-ms", required_argument, NULL, OPT_UPLINK_PERIOD },
+    { "downlink-period-ms", required_argument, NULL, OPT_DOWNLINK_PERIOD },
+    { "payload", required_argument, NULL, OPT_PAYLOAD },
+    { "ppm", required_argument, NULL, OPT_PPM },
+    { "library", required_argument, NULL, OPT_LIBRARY },
+    { "threads", required_argument, NULL, 'j' },
+    { "verbose", no_argument, NULL, 'v' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+};
+
+//=========================== prototypes =======================================
+
+static void _usage(const char *name);
+static void _print_latency(const char *name, mr_sim_series_t *series);
+static void _report(const mr_sim_result_t *result);
+
+//=========================== main =============================================
+
+int main(int argc, char **argv) {
+    mr_sim_config_t config;
+    mr_sim_config_default(&config);
+    const char *library = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:n:s:d:j:vh", _options, NULL)) != -1) {
+        switch (opt) {
+            case 'g':
+                config.n_gateways = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                config.n_nodes = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                config.schedule_name = optarg;
+                break;
+            case 'd':
+                config.duration_ns = strtod(optarg, NULL) * MR_SIM_NS_PER_S;
+                break;
+            case OPT_SEED:
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case OPT_AREA:
+                config.area_m = strtod(optarg, NULL);
+                break;
+            case OPT_SPEED:
+                config.speed_mps = strtod(optarg, NULL);
+                break;
+            case OPT_FADING:
+                config.fading_sigma_db = strtod(optarg, NULL);
+                break;
+            case OPT_BOOT_SPREAD:
+                config.boot_spread_ns = strtod(optarg, NULL) * MR_SIM_NS_PER_S;
+                break;
+            case OPT_UPLINK_PERIOD:
+                config.uplink_period_ns = strtoull(optarg, NULL, 0) * MR_SIM_NS_PER_MS;
+                break;
+            case OPT_DOWNLINK_PERIOD:
+                config.downlink_period_ns = strtoull(optarg, NULL, 0) * MR_SIM_NS_PER_MS;
+                break;
+            case OPT_PAYLOAD:
+                config.uplink_payload_len   = strtoul(optarg, NULL, 0);
+                config.downlink_payload_len = config.uplink_payload_len;
+                break;
+            case OPT_PPM:
+                config.clock_ppm_max = strtol(optarg, NULL, 0);
+                break;
+            case OPT_LIBRARY:
+                library = optarg;
+                break;
+            case 'j':
+                config.threads = strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                config.verbose = true;
+                break;
+            case 'h':
+                _usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                _usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (config.n_gateways == 0 || config.threads == 0 || config.uplink_payload_len < SIM_PROBE_MIN_LEN || config.uplink_payload_len > 200) {
+        _usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char default_library[PATH_MAX + sizeof(SIM_DEFAULT_LIBRARY)];
+    if (library == NULL) {
+        char    exe[PATH_MAX] = { 0 };
+        ssize_t len           = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        snprintf(default_library, sizeof(default_library), "%s/%s", len > 0 ? dirname(exe) : ".", SIM_DEFAULT_LIBRARY);
+        library = default_library;
+    }
+
+    if (mr_sim_init(&config, library) != 0) {
+        fprintf(stderr, "Failed to initialize the simulation\n");
+        mr_sim_deinit();
+        return EXIT_FAILURE;
+    }
+
+    printf("Simulating %u gateway(s) and %u node(s), schedule %s, %.1f s, seed %llu\n",
+           config.n_gateways, config.n_nodes, config.schedule_name, config.duration_ns * 1e-9, (unsigned long long)config.seed);
+
+    mr_sim_result_t result = { 0 };
+    mr_sim_run(&result);
+    _report(&result);
+
+    mr_sim_deinit();
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static void _usage(const char *name) {
+    printf("Usage: %s [options]\n", name);
+    printf("  -g, --gateways N            number of gateways (default 1)\n");
+    printf("  -n, --nodes N               number of nodes (default 10)\n");
+    printf("  -s, --schedule NAME         tiny, medium, big, huge, or auto to build one for the nodes (default huge)\n");
+    printf("  -d, --duration S            simulated time, in seconds (default 30)\n");
+    printf("      --seed N                seed of the simulation (default 1)\n");
+    printf("      --area M                side of the square hall, in meters (default 20)\n");
+    printf("      --speed M/S             nodes walk between random points of the hall at this speed (default 0)\n");
+    printf("      --fading DB             standard deviation of the fading of every frame, in dB (default 0)\n");
+    printf("      --boot-spread S         nodes power up within the first S seconds (default 1)\n");
+    printf("      --uplink-period-ms MS   period of the uplink packets of each node, 0 disables (default 500)\n");
+    printf("      --downlink-period-ms MS period of the gateway downlink packets, 0 disables (default 0)\n");
+    printf("      --payload N             application payload bytes, %d to 200 (default 20)\n", SIM_PROBE_MIN_LEN);
+    printf("      --ppm N                 maximum clock drift, in ppm (default 20)\n");
+    printf("      --library PATH          mari core shared library (default: %s next to this program)\n", SIM_DEFAULT_LIBRARY);
+    printf("  -j, --threads N             threads running the devices, does not change the results (default 1)\n");
+    printf("  -v, --verbose               print association events\n");
+}
+
+static void _print_latency(const char *name, mr_sim_series_t *series) {
+    mr_sim_series_sort(series);
+    if (series->len == 0) {
+        printf("%-18s n/a\n", name);
+        return;
+    }
+    printf("%-18s p50 %7.1f ms  p95 %7.1f ms  p99 %7.1f ms  max %7.1f ms\n", name,
+           mr_sim_series_percentile(series, 50) / 1000.0,
+           mr_sim_series_percentile(series, 95) / 1000.0,
+           mr_sim_series_percentile(series, 99) / 1000.0,
+           series->values_us[series->len - 1] / 1000.0);
+}
+
+static void _report(const mr_sim_result_t *result) {
+    mr_sim_series_t join_time        = { 0 };
+    mr_sim_series_t uplink_latency   = { 0 };
+    mr_sim_series_t downlink_latency = { 0 };
+    mr_sim_series_t handover_time    = { 0 };
+    mr_sim_stats_t  total            = { 0 };
+    uint32_t        n_nodes          = 0;
+
+    for (size_t i = 0; i < mr_sim_node_count(); i++) {
+        const mr_sim_node_t  *node  = mr_sim_node_get(i);
+        const mr_sim_stats_t *stats = &node->stats;
+
+        total.uplink_sent += stats->uplink_sent;
+        total.uplink_received += stats->uplink_received;
+        total.downlink_sent += stats->downlink_sent;
+        total.downlink_received += stats->downlink_received;
+        total.disconnects += stats->disconnects;
+        total.handovers += stats->handovers;
+        total.handbacks += stats->handbacks;
+        total.frames_sent += stats->frames_sent;
+        total.frames_lost += stats->frames_lost;
+        total.tx_held += stats->tx_held;
+        total.tx_refused += stats->tx_refused;
+
+        for (size_t j = 0; j < stats->uplink_latency.len; j++) {
+            mr_sim_series_add(&uplink_latency, stats->uplink_latency.values_us[j]);
+        }
+        for (size_t j = 0; j < stats->downlink_latency.len; j++) {
+            mr_sim_series_add(&downlink_latency, stats->downlink_latency.values_us[j]);
+        }
+        for (size_t j = 0; j < stats->handover_time.len; j++) {
+            mr_sim_series_add(&handover_time, stats->handover_time.values_us[j]);
+        }
+
+        if (node->role != MARI_NODE) {
+            continue;
+        }
+        n_nodes++;
+        if (stats->first_connected_ns) {
+            mr_sim_series_add(&join_time, (stats->first_connected_ns - stats->boot_ns) / MR_SIM_NS_PER_US);
+        }
+    }
+
+    printf("\n");
+    printf("%-18s %zu / %u nodes\n", "joined", join_time.len, n_nodes);
+    _print_latency("join time", &join_time);
+    printf("%-18s %u disconnects, %u handovers, %u back to the previous gateway\n", "association", total.disconnects, total.handovers, total.handbacks);
+    if (handover_time.len) {
+        _print_latency("handover time", &handover_time);
+    }
+    if (total.uplink_sent) {
+        printf("%-18s %.2f %% (%u / %u)\n", "uplink pdr", 100.0 * total.uplink_received / total.uplink_sent, total.uplink_received, total.uplink_sent);
+    }
+    _print_latency("uplink latency", &uplink_latency);
+    if (total.downlink_sent) {
+        printf("%-18s %.2f %% (%u / %u)\n", "downlink pdr", 100.0 * total.downlink_received / total.downlink_sent, total.downlink_received, total.downlink_sent);
+        _print_latency("downlink latency", &downlink_latency);
+    }
+    if (total.tx_held || total.tx_refused) {
+        printf("%-18s %u held by the application, %u refused by a full queue\n", "tx queue", total.tx_held, total.tx_refused);
+    }
+    printf("%-18s %u sent, %u lost at a receiver\n", "frames", total.frames_sent, total.frames_lost);
+    printf("%-18s %.1f s simulated in %.2f s (%.1fx real time), %llu events\n", "simulation",
+           result->sim_ns * 1e-9, result->wall_s, result->wall_s > 0 ? result->sim_ns * 1e-9 / result->wall_s : 0.0, (unsigned long long)result->events);
+
+    free(join_time.values_us);
+    free(uplink_latency.values_us);
+    free(downlink_latency.values_us);
+    free(handover_time.values_us);
+}
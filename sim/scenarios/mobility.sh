@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Gateway selection and handovers of nodes walking among 4 gateways, with fading.
+# Runs fixed seeds, with the nodes standing still and walking at 1.5 m/s, and fails
+# if a run does not meet the criteria below.
+#
+# Usage: sim/scenarios/mobility.sh [path to mari_sim]
+
+SIM=${1:-$(dirname "$0")/../build/mari_sim}
+
+SEEDS="1 2 3 4"
+SPEEDS="0 1.5"
+NODES=50
+
+# pass/fail criteria, per run
+MIN_JOINED=$NODES      # every node joins
+MAX_DISCONNECTS=5      # nodes lost by their gateway
+MAX_HANDOVERS=100      # 2 per node and per minute, more is flapping between gateways
+MAX_HANDBACKS=2        # handovers back to the previous gateway within 30 s, i.e. ping-pong
+MAX_HANDOVER_P95=500   # ms, from the handover to the connection with the new gateway
+MIN_UPLINK_PDR=99.0    # %
+
+if [ ! -x "$SIM" ]; then
+  echo "Error: $SIM not found, build it with make -C sim"
+  exit 1
+fi
+
+FAILED=0
+for SPEED in $SPEEDS; do
+  for SEED in $SEEDS; do
+    RESULT=$("$SIM" -g 4 -n $NODES -d 60 --area 80 --fading 6 --speed "$SPEED" --seed "$SEED" -j 4 | awk '
+      /^joined/        { joined = $2 }
+      /^association/   { disconnects = $2; handovers = $4; handbacks = $6 }
+      /^handover time/ { p95 = $7 }
+      /^uplink pdr/    { pdr = $3 }
+      END { print joined + 0, disconnects + 0, handovers + 0, handbacks + 0, p95 + 0, pdr + 0 }')
+    read -r JOINED DISCONNECTS HANDOVERS HANDBACKS P95 PDR <<< "$RESULT"
+
+    VERDICT=pass
+    if [ "$JOINED" -lt $MIN_JOINED ] || [ "$DISCONNECTS" -gt $MAX_DISCONNECTS ] || [ "$HANDOVERS" -gt $MAX_HANDOVERS ] \
+      || [ "$HANDBACKS" -gt $MAX_HANDBACKS ] \
+      || awk -v p95="$P95" -v pdr="$PDR" "BEGIN { exit !(p95 > $MAX_HANDOVER_P95 || pdr < $MIN_UPLINK_PDR) }"; then
+      VERDICT=FAIL
+      FAILED=1
+    fi
+    printf "speed %-4s seed %s: joined %3d, disconnects %2d, handovers %3d, back %2d, handover p95 %6.1f ms, uplink pdr %6.2f %%  %s\n" \
+      "$SPEED" "$SEED" "$JOINED" "$DISCONNECTS" "$HANDOVERS" "$HANDBACKS" "$P95" "$PDR" "$VERDICT"
+  done
+done
+
+if [ $FAILED -ne 0 ]; then
+  echo "Mobility scenario failed"
+  exit 1
+fi
+echo "Mobility scenario passed"
@@ -0,0 +1,752 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Discrete-event engine of the mari network simulator
+ *
+ * Devices only interact through the radio medium, and a frame always reaches
+ * the air at least tx_start_delay_us after the START task that sent it. The
+ * engine uses that as lookahead: it advances time in windows no longer than
+ * that delay, lets every device with events in the window run up to the end
+ * of the window, and only then publishes the frames sent during the window.
+ * Frames can therefore never reach a device "in the past".
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "sim.h"
+#include "instance.h"
+
+//=========================== defines ==========================================
+
+#define MR_SIM_GATEWAY_BOOT_SPREAD_NS (10 * MR_SIM_NS_PER_MS)  ///< Gateways power up within the first 10 ms
+#define MR_SIM_CLOCK_OFFSET_MAX_NS    (1000 * MR_SIM_NS_PER_S)  ///< Local clocks start anywhere within the first 1000 s
+
+#define MR_SIM_PARALLEL_MIN_ACTIVE 8     ///< Windows with fewer active devices per thread run on the main thread only
+#define MR_SIM_WORKER_SPINS        4096  ///< Busy-wait iterations before a waiting worker yields its CPU
+
+typedef struct {
+    pthread_t    *threads;
+    uint32_t      n_threads;   ///< Worker threads, on top of the main thread
+    atomic_ullong generation;  ///< Incremented by the main thread to start a window
+    atomic_size_t next;        ///< Next active device to run
+    atomic_ullong done;        ///< Workers done with the current window
+    atomic_bool   stop;
+    uint32_t      spins;  ///< Busy-wait iterations before yielding, 0 when there are more threads than CPUs
+    uint64_t      window_end_ns;
+} sim_workers_t;
+
+typedef struct {
+    mr_sim_config_t config;
+    mr_sim_node_t  *nodes;
+    size_t          n_nodes;
+
+    // devices ordered by their next event
+    mr_sim_node_t **heap;
+    size_t          heap_len;
+
+    // frames that may still be on air or interfere with a frame on air
+    mr_sim_frame_t *frames;
+    size_t          frames_len;
+    size_t          frames_cap;
+    uint64_t        next_frame_id;
+
+    // devices that run in the current window
+    mr_sim_node_t **active;
+    size_t          active_len;
+
+    sim_workers_t workers;
+
+    uint64_t windows;
+} sim_vars_t;
+
+//=========================== variables ========================================
+
+static sim_vars_t _sim_vars = { 0 };
+
+static __thread mr_sim_node_t *_current = NULL;
+
+//=========================== prototypes =======================================
+
+static uint64_t _node_next_ns(const mr_sim_node_t *node);
+static void     _heap_update(mr_sim_node_t *node);
+static void     _heap_remove(mr_sim_node_t *node);
+static void     _queue_push(mr_sim_event_queue_t *queue, mr_sim_event_t event);
+static bool     _queue_pop_before(mr_sim_event_queue_t *queue, uint64_t before_ns, mr_sim_event_t *event);
+static void     _run_node(mr_sim_node_t *node, uint64_t window_end_ns);
+static void     _run_window(uint64_t window_end_ns);
+static void     _run_active(uint64_t window_end_ns);
+static void     _wait_while(atomic_ullong *value, unsigned long long current, bool stoppable);
+static void    *_worker(void *arg);
+static void     _workers_start(void);
+static void     _workers_stop(void);
+static void     _publish_frames(mr_sim_node_t *node);
+static void     _collect_frames(uint64_t window_start_ns);
+static void     _node_move(mr_sim_node_t *node, uint64_t time_ns);
+static void     _node_next_waypoint(mr_sim_node_t *node);
+static double   _normal(uint64_t h);
+static uint64_t _hash64(uint64_t x);
+
+//=========================== public ===========================================
+
+void mr_sim_config_default(mr_sim_config_t *config) {
+    memset(config, 0, sizeof(mr_sim_config_t));
+    config->n_gateways           = 1;
+    config->n_nodes              = 10;
+    config->schedule_name        = "huge";
+    config->seed                 = 1;
+    config->duration_ns          = 30 * MR_SIM_NS_PER_S;
+    config->area_m               = 20.0;
+    config->boot_spread_ns       = 1 * MR_SIM_NS_PER_S;
+    config->uplink_period_ns     = 500 * MR_SIM_NS_PER_MS;  // same as the status packet of 03app_node
+    config->uplink_payload_len   = 20;
+    config->downlink_period_ns   = 0;
+    config->downlink_payload_len = 20;
+    config->tx_start_delay_us    = 29;  // with two interrupt latencies and 24 us of preamble and address, matches the 59 us used by fix_drift
+    config->isr_latency_us       = 3;
+    config->threads              = 1;
+    config->clock_ppm_max        = 20;
+    config->tx_power_dbm         = 0.0;
+    config->path_loss_d0_db      = 40.0;
+    config->path_loss_exponent   = 2.5;
+    config->shadowing_sigma_db   = 4.0;
+    config->fading_sigma_db      = 0.0;
+    config->sensitivity_dbm      = -90.0;
+    config->capture_threshold_db = 6.0;
+}
+
+int mr_sim_init(const mr_sim_config_t *config, const char *mari_library_path) {
+    memset(&_sim_vars, 0, sizeof(_sim_vars));
+    _sim_vars.config  = *config;
+    _sim_vars.n_nodes = config->n_gateways + config->n_nodes;
+    _sim_vars.nodes   = calloc(_sim_vars.n_nodes, sizeof(mr_sim_node_t));
+    _sim_vars.heap    = calloc(_sim_vars.n_nodes, sizeof(mr_sim_node_t *));
+    _sim_vars.active  = calloc(_sim_vars.n_nodes, sizeof(mr_sim_node_t *));
+    if (_sim_vars.nodes == NULL || _sim_vars.heap == NULL || _sim_vars.active == NULL) {
+        return -1;
+    }
+
+    if (mr_sim_instance_load_library(mari_library_path) != 0) {
+        return -1;
+    }
+
+    uint64_t rng = config->seed;
+
+    // gateways on a regular grid, nodes spread uniformly over the hall
+    uint32_t grid = (uint32_t)ceil(sqrt((double)config->n_gateways));
+    for (size_t i = 0; i < _sim_vars.n_nodes; i++) {
+        mr_sim_node_t *node = &_sim_vars.nodes[i];
+        node->index         = i;
+        node->device_id     = _hash64(config->seed ^ _hash64(i + 1)) | 1;  // never zero, mari uses 0 for "no node"
+        node->rng_state     = _hash64(node->device_id ^ config->seed);
+        node->heap_pos      = SIZE_MAX;
+
+        if (i < config->n_gateways) {
+            node->role = MARI_GATEWAY;
+            node->x    = config->area_m * ((i % grid) + 0.5) / grid;
+            node->y    = config->area_m * ((i / grid) + 0.5) / grid;
+        } else {
+            node->role     = MARI_NODE;
+            node->x        = config->area_m * (mr_sim_rng_next(&rng) >> 11) * 0x1.0p-53;
+            node->y        = config->area_m * (mr_sim_rng_next(&rng) >> 11) * 0x1.0p-53;
+            node->move_rng = _hash64(node->device_id ^ ~config->seed);  // apart from rng, so that moving does not change the placement
+            _node_next_waypoint(node);
+        }
+
+        node->clock_offset_ns = mr_sim_rng_next(&rng) % MR_SIM_CLOCK_OFFSET_MAX_NS;
+        if (config->clock_ppm_max > 0) {
+            node->clock_ppm = (int32_t)(mr_sim_rng_next(&rng) % (2 * config->clock_ppm_max + 1)) - config->clock_ppm_max;
+        }
+
+        node->mari = mr_sim_instance_new();
+        if (node->mari == NULL) {
+            fprintf(stderr, "sim: could not load mari instance %zu\n", i);
+            return -1;
+        }
+        if (mr_sim_instance_schedule(node->mari, config->schedule_name, config->n_nodes) == NULL) {
+            fprintf(stderr, "sim: no schedule %s for %u nodes\n", config->schedule_name, config->n_nodes);
+            return -1;
+        }
+
+        uint64_t spread     = node->role == MARI_GATEWAY ? MR_SIM_GATEWAY_BOOT_SPREAD_NS : config->boot_spread_ns;
+        uint64_t boot_ns    = spread ? mr_sim_rng_next(&rng) % spread : 0;
+        node->stats.boot_ns = boot_ns;
+        mr_sim_schedule(node, boot_ns, MR_SIM_EVENT_BOOT, 0, 0);
+        _heap_update(node);
+    }
+
+    return 0;
+}
+
+void mr_sim_run(mr_sim_result_t *result) {
+    struct timespec wall_start, wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    _workers_start();
+
+    uint64_t window_ns = _sim_vars.config.tx_start_delay_us * MR_SIM_NS_PER_US;
+    uint64_t now_ns    = 0;
+
+    while (_sim_vars.heap_len > 0) {
+        uint64_t window_start_ns = _node_next_ns(_sim_vars.heap[0]);
+        if (window_start_ns >= _sim_vars.config.duration_ns) {
+            break;
+        }
+        uint64_t window_end_ns = window_start_ns + window_ns;
+        now_ns                 = window_start_ns;
+        _sim_vars.windows++;
+
+        // take every device with something to do in this window out of the heap
+        _sim_vars.active_len = 0;
+        while (_sim_vars.heap_len > 0 && _node_next_ns(_sim_vars.heap[0]) < window_end_ns) {
+            mr_sim_node_t *node                         = _sim_vars.heap[0];
+            _sim_vars.active[_sim_vars.active_len++] = node;
+            _heap_remove(node);
+        }
+
+        // devices are independent within a window
+        _run_window(window_end_ns);
+
+        // barrier: publish the new frames, always in the same order, so that the result never depends on the threads
+        for (size_t i = 0; i < _sim_vars.active_len; i++) {
+            _publish_frames(_sim_vars.active[i]);
+        }
+        for (size_t i = 0; i < _sim_vars.active_len; i++) {
+            _heap_update(_sim_vars.active[i]);
+        }
+        _collect_frames(window_start_ns);
+    }
+
+    _workers_stop();
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    for (size_t i = 0; i < _sim_vars.n_nodes; i++) {
+        result->events += _sim_vars.nodes[i].events_handled;
+    }
+    result->sim_ns  = now_ns > _sim_vars.config.duration_ns ? _sim_vars.config.duration_ns : now_ns;
+    result->wall_s  = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) * 1e-9;
+    result->windows = _sim_vars.windows;
+    result->frames  = _sim_vars.next_frame_id;
+}
+
+void mr_sim_deinit(void) {
+    for (size_t i = 0; i < _sim_vars.n_nodes; i++) {
+        mr_sim_node_t *node = &_sim_vars.nodes[i];
+        mr_sim_instance_free(node->mari);
+        free(node->events.items);
+        free(node->pending_frames);
+        free(node->stats.uplink_latency.values_us);
+        free(node->stats.downlink_latency.values_us);
+        free(node->stats.handover_time.values_us);
+        free(node->app);
+    }
+    free(_sim_vars.nodes);
+    free(_sim_vars.heap);
+    free(_sim_vars.active);
+    free(_sim_vars.frames);
+    mr_sim_instance_unload_library();
+    memset(&_sim_vars, 0, sizeof(_sim_vars));
+}
+
+size_t mr_sim_node_count(void) {
+    return _sim_vars.n_nodes;
+}
+
+mr_sim_node_t *mr_sim_node_get(size_t index) {
+    return &_sim_vars.nodes[index];
+}
+
+const mr_sim_config_t *mr_sim_config(void) {
+    return &_sim_vars.config;
+}
+
+mr_sim_node_t *mr_sim_current(void) {
+    return _current;
+}
+
+void mr_sim_set_current(mr_sim_node_t *node) {
+    _current = node;
+}
+
+uint64_t mr_sim_now_ns(void) {
+    return _current->cpu_ns;
+}
+
+uint64_t mr_sim_local_ns(mr_sim_node_t *node, uint64_t global_ns) {
+    unsigned __int128 scaled = (unsigned __int128)global_ns * (uint64_t)(1000000 + node->clock_ppm);
+    return node->clock_offset_ns + (uint64_t)(scaled / 1000000);
+}
+
+uint64_t mr_sim_global_ns(mr_sim_node_t *node, uint64_t local_ns) {
+    if (local_ns <= (uint64_t)node->clock_offset_ns) {
+        return 0;
+    }
+    unsigned __int128 scaled = (unsigned __int128)(local_ns - node->clock_offset_ns) * 1000000;
+    uint64_t          rate   = 1000000 + node->clock_ppm;
+    return (uint64_t)((scaled + rate - 1) / rate);
+}
+
+void mr_sim_schedule(mr_sim_node_t *node, uint64_t time_ns, mr_sim_event_type_t type, uint64_t arg, uint32_t gen) {
+    mr_sim_event_t event = {
+        .time_ns = time_ns,
+        .type    = type,
+        .arg     = arg,
+        .gen     = gen,
+    };
+    _queue_push(&node->events, event);
+}
+
+// -------- medium ---------
+
+mr_sim_frame_t *mr_sim_medium_new_frame(mr_sim_node_t *node) {
+    if (node->pending_frames_len == node->pending_frames_cap) {
+        node->pending_frames_cap = node->pending_frames_cap ? 2 * node->pending_frames_cap : 4;
+        node->pending_frames     = realloc(node->pending_frames, node->pending_frames_cap * sizeof(mr_sim_frame_t));
+    }
+    mr_sim_frame_t *frame = &node->pending_frames[node->pending_frames_len++];
+    memset(frame, 0, sizeof(mr_sim_frame_t));
+    frame->tx_index = node->index;
+    frame->x        = node->x;
+    frame->y        = node->y;
+    return frame;
+}
+
+mr_sim_frame_t *mr_sim_medium_get_frame(uint64_t frame_id) {
+    // frames are stored by increasing id
+    size_t lo = 0, hi = _sim_vars.frames_len;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (_sim_vars.frames[mid].id < frame_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < _sim_vars.frames_len && _sim_vars.frames[lo].id == frame_id) {
+        return &_sim_vars.frames[lo];
+    }
+    return NULL;
+}
+
+// Log-distance path loss plus a per-link shadowing term that does not change over time, and optionally a per-frame fading term
+double mr_sim_medium_rssi(const mr_sim_frame_t *frame, const mr_sim_node_t *receiver) {
+    const mr_sim_config_t *config = &_sim_vars.config;
+
+    double dx = frame->x - receiver->x;
+    double dy = frame->y - receiver->y;
+    double d2 = dx * dx + dy * dy;
+    if (d2 < 1.0) {
+        d2 = 1.0;
+    }
+    double path_loss = config->path_loss_d0_db + 5.0 * config->path_loss_exponent * log10(d2);
+
+    uint32_t a    = frame->tx_index < receiver->index ? frame->tx_index : receiver->index;
+    uint32_t b    = frame->tx_index < receiver->index ? receiver->index : frame->tx_index;
+    double   rssi = config->tx_power_dbm - path_loss + config->shadowing_sigma_db * _normal(_hash64(config->seed ^ ((uint64_t)a << 32 | b)));
+
+    if (config->fading_sigma_db > 0) {
+        // the same frame fades the same way when its rssi is sampled and when it is decoded
+        rssi += config->fading_sigma_db * _normal(_hash64(config->seed ^ frame->id ^ ((uint64_t)receiver->index << 44)));
+    }
+    return rssi;
+}
+
+// A frame is decoded if it is above sensitivity and above the sum of all the frames overlapping it on the same channel
+bool mr_sim_medium_decode(const mr_sim_frame_t *frame, const mr_sim_node_t *receiver) {
+    const mr_sim_config_t *config = &_sim_vars.config;
+
+    double signal_dbm = mr_sim_medium_rssi(frame, receiver);
+    if (signal_dbm < config->sensitivity_dbm) {
+        return false;
+    }
+
+    double interference_mw = 0;
+    for (size_t i = 0; i < _sim_vars.frames_len; i++) {
+        const mr_sim_frame_t *other = &_sim_vars.frames[i];
+        if (other->id == frame->id || other->channel != frame->channel || other->tx_index == receiver->index) {
+            continue;
+        }
+        if (other->start_ns >= frame->end_ns || other->end_ns <= frame->start_ns) {
+            continue;
+        }
+        interference_mw += pow(10.0, mr_sim_medium_rssi(other, receiver) / 10.0);
+    }
+    if (interference_mw == 0) {
+        return true;
+    }
+    return signal_dbm - 10.0 * log10(interference_mw) >= config->capture_threshold_db;
+}
+
+uint64_t mr_sim_rng_next(uint64_t *state) {
+    // splitmix64
+    *state += 0x9E3779B97F4A7C15ULL;
+    return _hash64(*state);
+}
+
+// -------- statistics ---------
+
+void mr_sim_series_add(mr_sim_series_t *series, uint32_t value_us) {
+    if (series->len == series->cap) {
+        series->cap       = series->cap ? 2 * series->cap : 64;
+        series->values_us = realloc(series->values_us, series->cap * sizeof(uint32_t));
+    }
+    series->values_us[series->len++] = value_us;
+}
+
+static int _compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void mr_sim_series_sort(mr_sim_series_t *series) {
+    if (series->len > 1) {
+        qsort(series->values_us, series->len, sizeof(uint32_t), _compare_u32);
+    }
+}
+
+// the series must be sorted
+uint32_t mr_sim_series_percentile(const mr_sim_series_t *series, double percentile) {
+    if (series->len == 0) {
+        return 0;
+    }
+    size_t idx = (size_t)(percentile / 100.0 * (series->len - 1) + 0.5);
+    return series->values_us[idx];
+}
+
+//=========================== private ==========================================
+
+// Random waypoint model: nodes walk straight to a random point of the hall, then to the next one, without pausing
+static void _node_move(mr_sim_node_t *node, uint64_t time_ns) {
+    double speed_mps = _sim_vars.config.speed_mps;
+    if (node->role != MARI_NODE || speed_mps <= 0 || time_ns <= node->moved_ns) {
+        return;
+    }
+    double step_m  = speed_mps * (time_ns - node->moved_ns) * 1e-9;
+    node->moved_ns = time_ns;
+    while (step_m > 0) {
+        double dx = node->waypoint_x - node->x;
+        double dy = node->waypoint_y - node->y;
+        double d  = sqrt(dx * dx + dy * dy);
+        if (d > step_m) {
+            node->x += dx * step_m / d;
+            node->y += dy * step_m / d;
+            return;
+        }
+        node->x = node->waypoint_x;
+        node->y = node->waypoint_y;
+        step_m -= d;
+        _node_next_waypoint(node);
+    }
+}
+
+static void _node_next_waypoint(mr_sim_node_t *node) {
+    node->waypoint_x = _sim_vars.config.area_m * (mr_sim_rng_next(&node->move_rng) >> 11) * 0x1.0p-53;
+    node->waypoint_y = _sim_vars.config.area_m * (mr_sim_rng_next(&node->move_rng) >> 11) * 0x1.0p-53;
+}
+
+// Approximately normal, from a hash: sum of four uniform 16-bit values (Irwin-Hall)
+static double _normal(uint64_t h) {
+    double sum = (double)(h & 0xFFFF) + ((h >> 16) & 0xFFFF) + ((h >> 32) & 0xFFFF) + ((h >> 48) & 0xFFFF);
+    return (sum / 65536.0 - 2.0) * 1.7320508;  // variance of the sum is 4/12
+}
+
+static uint64_t _hash64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static void _run_node(mr_sim_node_t *node, uint64_t window_end_ns) {
+    mr_sim_set_current(node);
+
+    mr_sim_event_t event;
+    while (_queue_pop_before(&node->events, window_end_ns, &event)) {
+        // peripherals events are handled by an interrupt, which takes a while to start
+        uint64_t start_ns = event.time_ns;
+        if (event.type != MR_SIM_EVENT_BOOT) {
+            start_ns += _sim_vars.config.isr_latency_us * MR_SIM_NS_PER_US;
+        }
+        if (start_ns > node->cpu_ns) {
+            node->cpu_ns = start_ns;
+        }
+        node->events_handled++;
+        _node_move(node, event.time_ns);
+
+        switch (event.type) {
+            case MR_SIM_EVENT_BOOT:
+                mr_sim_app_boot(node);
+                break;
+            case MR_SIM_EVENT_TIMER:
+                mr_sim_timer_handle_event(node, &event);
+                break;
+            case MR_SIM_EVENT_TX_ADDRESS:
+            case MR_SIM_EVENT_TX_END:
+            case MR_SIM_EVENT_RX_ADDRESS:
+            case MR_SIM_EVENT_RX_END:
+                mr_sim_radio_handle_event(node, &event);
+                break;
+        }
+
+        // the firmware main loop runs after every interrupt
+        mr_sim_app_loop(node);
+    }
+
+    mr_sim_set_current(NULL);
+}
+
+// -------- parallel execution ---------
+
+static void _run_window(uint64_t window_end_ns) {
+    sim_workers_t *workers = &_sim_vars.workers;
+
+    if (workers->n_threads == 0 || _sim_vars.active_len < MR_SIM_PARALLEL_MIN_ACTIVE * (workers->n_threads + 1)) {
+        for (size_t i = 0; i < _sim_vars.active_len; i++) {
+            _run_node(_sim_vars.active[i], window_end_ns);
+        }
+        return;
+    }
+
+    workers->window_end_ns = window_end_ns;
+    atomic_store(&workers->next, 0);
+    atomic_store(&workers->done, 0);
+    atomic_fetch_add(&workers->generation, 1);  // go
+
+    _run_active(window_end_ns);
+    _wait_while(&workers->done, workers->n_threads - 1, false);
+}
+
+// Devices are handed out one by one: the order does not matter since they do not share any state
+static void _run_active(uint64_t window_end_ns) {
+    size_t i;
+    while ((i = atomic_fetch_add(&_sim_vars.workers.next, 1)) < _sim_vars.active_len) {
+        _run_node(_sim_vars.active[i], window_end_ns);
+    }
+}
+
+// Wait until the value changes, or the workers are stopped
+static void _wait_while(atomic_ullong *value, unsigned long long current, bool stoppable) {
+    uint32_t spins = 0;
+    while (atomic_load(value) <= current && !(stoppable && atomic_load(&_sim_vars.workers.stop))) {
+        if (++spins > _sim_vars.workers.spins) {
+            sched_yield();
+        }
+    }
+}
+
+static void *_worker(void *arg) {
+    sim_workers_t *workers    = arg;
+    uint64_t       generation = 0;  // workers are started before the first window
+
+    while (true) {
+        _wait_while(&workers->generation, generation, true);
+        if (atomic_load(&workers->stop)) {
+            return NULL;
+        }
+        generation++;
+
+        _run_active(workers->window_end_ns);
+        atomic_fetch_add(&workers->done, 1);
+    }
+}
+
+static void _workers_start(void) {
+    sim_workers_t *workers = &_sim_vars.workers;
+    uint32_t       threads = _sim_vars.config.threads;
+
+    workers->n_threads = 0;
+    if (threads <= 1) {
+        return;
+    }
+    long cpus        = sysconf(_SC_NPROCESSORS_ONLN);
+    workers->spins   = cpus >= (long)threads ? MR_SIM_WORKER_SPINS : 0;
+    workers->threads = calloc(threads - 1, sizeof(pthread_t));
+    atomic_store(&workers->generation, 0);
+    atomic_store(&workers->stop, false);
+    for (uint32_t i = 0; i < threads - 1; i++) {
+        if (pthread_create(&workers->threads[i], NULL, _worker, workers) != 0) {
+            break;  // run with the threads we have
+        }
+        workers->n_threads++;
+    }
+}
+
+static void _workers_stop(void) {
+    sim_workers_t *workers = &_sim_vars.workers;
+
+    atomic_store(&workers->stop, true);
+    for (uint32_t i = 0; i < workers->n_threads; i++) {
+        pthread_join(workers->threads[i], NULL);
+    }
+    free(workers->threads);
+    workers->threads   = NULL;
+    workers->n_threads = 0;
+}
+
+// -------- medium ---------
+
+static void _publish_frames(mr_sim_node_t *node) {
+    for (size_t f = 0; f < node->pending_frames_len; f++) {
+        if (_sim_vars.frames_len == _sim_vars.frames_cap) {
+            _sim_vars.frames_cap = _sim_vars.frames_cap ? 2 * _sim_vars.frames_cap : 64;
+            _sim_vars.frames     = realloc(_sim_vars.frames, _sim_vars.frames_cap * sizeof(mr_sim_frame_t));
+        }
+        mr_sim_frame_t *frame = &_sim_vars.frames[_sim_vars.frames_len++];
+        *frame                = node->pending_frames[f];
+        frame->id             = _sim_vars.next_frame_id++;
+
+        // every device that can hear the frame gets the ADDRESS event, whether it listens or not is decided then
+        for (size_t i = 0; i < _sim_vars.n_nodes; i++) {
+            mr_sim_node_t *receiver = &_sim_vars.nodes[i];
+            if (receiver == node || mr_sim_medium_rssi(frame, receiver) < _sim_vars.config.sensitivity_dbm) {
+                continue;
+            }
+            mr_sim_schedule(receiver, frame->address_ns, MR_SIM_EVENT_RX_ADDRESS, frame->id, 0);
+            _heap_update(receiver);
+        }
+    }
+    node->pending_frames_len = 0;
+}
+
+// forget frames that can no longer be received nor interfere with a frame being received
+static void _collect_frames(uint64_t window_start_ns) {
+    size_t n = 0;
+    while (n < _sim_vars.frames_len && _sim_vars.frames[n].end_ns + 2 * MR_SIM_MAX_FRAME_NS < window_start_ns) {
+        n++;
+    }
+    if (n > 0) {
+        memmove(_sim_vars.frames, &_sim_vars.frames[n], (_sim_vars.frames_len - n) * sizeof(mr_sim_frame_t));
+        _sim_vars.frames_len -= n;
+    }
+}
+
+// -------- per-device event queue (binary heap) ---------
+
+static inline bool _event_before(const mr_sim_event_t *a, const mr_sim_event_t *b) {
+    return a->time_ns < b->time_ns || (a->time_ns == b->time_ns && a->seq < b->seq);
+}
+
+static void _queue_push(mr_sim_event_queue_t *queue, mr_sim_event_t event) {
+    if (queue->len == queue->cap) {
+        queue->cap   = queue->cap ? 2 * queue->cap : 16;
+        queue->items = realloc(queue->items, queue->cap * sizeof(mr_sim_event_t));
+    }
+    event.seq  = queue->next_seq++;
+    size_t pos = queue->len++;
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!_event_before(&event, &queue->items[parent])) {
+            break;
+        }
+        queue->items[pos] = queue->items[parent];
+        pos               = parent;
+    }
+    queue->items[pos] = event;
+}
+
+static bool _queue_pop_before(mr_sim_event_queue_t *queue, uint64_t before_ns, mr_sim_event_t *event) {
+    if (queue->len == 0 || queue->items[0].time_ns >= before_ns) {
+        return false;
+    }
+    *event              = queue->items[0];
+    mr_sim_event_t last = queue->items[--queue->len];
+    size_t         pos  = 0;
+    while (true) {
+        size_t child = 2 * pos + 1;
+        if (child >= queue->len) {
+            break;
+        }
+        if (child + 1 < queue->len && _event_before(&queue->items[child + 1], &queue->items[child])) {
+            child++;
+        }
+        if (!_event_before(&queue->items[child], &last)) {
+            break;
+        }
+        queue->items[pos] = queue->items[child];
+        pos               = child;
+    }
+    if (queue->len > 0) {
+        queue->items[pos] = last;
+    }
+    return true;
+}
+
+// -------- device heap, ordered by next event ---------
+
+static uint64_t _node_next_ns(const mr_sim_node_t *node) {
+    return node->events.len ? node->events.items[0].time_ns : UINT64_MAX;
+}
+
+static inline bool _node_before(const mr_sim_node_t *a, const mr_sim_node_t *b) {
+    uint64_t ta = _node_next_ns(a);
+    uint64_t tb = _node_next_ns(b);
+    return ta < tb || (ta == tb && a->index < b->index);
+}
+
+static void _heap_set(size_t pos, mr_sim_node_t *node) {
+    _sim_vars.heap[pos] = node;
+    node->heap_pos      = pos;
+}
+
+static void _heap_sift(size_t pos) {
+    mr_sim_node_t *node = _sim_vars.heap[pos];
+    // up
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!_node_before(node, _sim_vars.heap[parent])) {
+            break;
+        }
+        _heap_set(pos, _sim_vars.heap[parent]);
+        pos = parent;
+    }
+    // down
+    while (true) {
+        size_t child = 2 * pos + 1;
+        if (child >= _sim_vars.heap_len) {
+            break;
+        }
+        if (child + 1 < _sim_vars.heap_len && _node_before(_sim_vars.heap[child + 1], _sim_vars.heap[child])) {
+            child++;
+        }
+        if (!_node_before(_sim_vars.heap[child], node)) {
+            break;
+        }
+        _heap_set(pos, _sim_vars.heap[child]);
+        pos = child;
+    }
+    _heap_set(pos, node);
+}
+
+// insert the device, or move it after its next event changed
+static void _heap_update(mr_sim_node_t *node) {
+    if (node->heap_pos == SIZE_MAX) {
+        if (node->events.len == 0) {
+            return;
+        }
+        _heap_set(_sim_vars.heap_len++, node);
+    }
+    _heap_sift(node->heap_pos);
+}
+
+static void _heap_remove(mr_sim_node_t *node) {
+    size_t pos     = node->heap_pos;
+    node->heap_pos = SIZE_MAX;
+    _sim_vars.heap_len--;
+    if (pos == _sim_vars.heap_len) {
+        return;
+    }
+    _heap_set(pos, _sim_vars.heap[_sim_vars.heap_len]);
+    _heap_sift(pos);
+}
@@ -0,0 +1,269 @@
+#ifndef __SIM_H
+#define __SIM_H
+
+/**
+ * @defgroup    sim         Mari network simulator
+ * @brief       Discrete-event simulator running the unmodified mari core on the host
+ *
+ * Every simulated device (gateway or node) runs its own private copy of the
+ * mari core, loaded from libmari_sim.so, on top of simulated radio, timer,
+ * rng and device-id drivers. Time is virtual: the engine jumps from one event
+ * to the next, so a simulation runs as fast as the host can process events.
+ *
+ * @{
+ * @file
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ * @copyright Inria, 2025-now
+ * @}
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mr_radio.h"
+#include "mr_timer_hf.h"
+#include "models.h"
+
+//=========================== defines ==========================================
+
+#define MR_SIM_NS_PER_US 1000ULL
+#define MR_SIM_NS_PER_MS (1000ULL * MR_SIM_NS_PER_US)
+#define MR_SIM_NS_PER_S  (1000ULL * MR_SIM_NS_PER_MS)
+
+#define MR_SIM_TIMER_COUNT    5  ///< Number of timer peripherals per device, as on the nRF52840
+#define MR_SIM_TIMER_CHANNELS 6  ///< Number of compare channels per timer, as on the nRF5340 TIMER2
+
+// BLE 2M air interface: 2 bytes preamble, 4 bytes access address, 2 bytes PDU header, 3 bytes CRC
+#define MR_SIM_US_PER_BYTE         4
+#define MR_SIM_PREAMBLE_ADDRESS_US (MR_SIM_US_PER_BYTE * (2 + 4))
+#define MR_SIM_PDU_OVERHEAD_BYTES  (2 + 3)
+#define MR_SIM_RADIO_RAMP_UP_US    40  ///< Fast ramp-up time of the radio (RXEN -> RXREADY)
+
+#define MR_SIM_DRAIN_NS (2 * MR_SIM_NS_PER_S)  ///< Packets sent during the last 2 s are not accounted for in the PDR
+
+#define MR_SIM_MAX_FRAME_NS ((MR_SIM_PREAMBLE_ADDRESS_US + MR_SIM_US_PER_BYTE * (MR_SIM_PDU_OVERHEAD_BYTES + MR_BLE_PAYLOAD_MAX_LENGTH)) * MR_SIM_NS_PER_US)
+
+typedef enum {
+    MR_SIM_EVENT_BOOT = 1,     ///< Device powers up and runs the application init
+    MR_SIM_EVENT_TIMER,        ///< A timer compare channel fired
+    MR_SIM_EVENT_TX_ADDRESS,   ///< Own frame: address sent
+    MR_SIM_EVENT_TX_END,       ///< Own frame: last bit sent
+    MR_SIM_EVENT_RX_ADDRESS,   ///< Someone else's frame: address reached this device
+    MR_SIM_EVENT_RX_END,       ///< Someone else's frame: last bit reached this device
+} mr_sim_event_type_t;
+
+typedef struct {
+    uint64_t            time_ns;  ///< Global virtual time at which the event happens
+    uint64_t            seq;      ///< Insertion order, breaks ties between events at the same time
+    mr_sim_event_type_t type;
+    uint64_t            arg;  ///< Timer: (dev << 8) | channel. Radio: id of the frame in the medium
+    uint32_t            gen;  ///< Generation of the timer channel / radio when the event was scheduled
+} mr_sim_event_t;
+
+typedef struct {
+    mr_sim_event_t *items;
+    size_t          len;
+    size_t          cap;
+    uint64_t        next_seq;
+} mr_sim_event_queue_t;
+
+typedef struct {
+    uint64_t id;          ///< Frame number, unique and increasing across the whole simulation
+    uint32_t tx_index;    ///< Index of the transmitting device
+    uint8_t  channel;     ///< BLE channel
+    uint64_t start_ns;    ///< First bit of the preamble
+    uint64_t address_ns;  ///< Address fully on air (ADDRESS event)
+    uint64_t end_ns;      ///< Last bit of the CRC (END event)
+    double   x;           ///< Position of the transmitter when the frame was sent
+    double   y;
+    uint8_t  length;
+    uint8_t  payload[MR_BLE_PAYLOAD_MAX_LENGTH];
+} mr_sim_frame_t;
+
+typedef struct {
+    uint32_t      cc;        ///< Compare value, in local microseconds
+    uint32_t      period_us;
+    bool          armed;
+    bool          one_shot;
+    uint32_t      gen;
+    timer_hf_cb_t callback;
+} mr_sim_timer_channel_t;
+
+typedef enum {
+    MR_SIM_RADIO_IDLE = 0x00,
+    MR_SIM_RADIO_RX   = 0x01,
+    MR_SIM_RADIO_TX   = 0x02,
+    MR_SIM_RADIO_BUSY = 0x04,
+} mr_sim_radio_state_t;
+
+typedef struct {
+    uint8_t           state;
+    uint8_t           channel;
+    uint32_t          gen;          ///< Bumped every time the radio is disabled, invalidates pending events
+    uint64_t          rx_ready_ns;  ///< When the receiver finished ramping up
+    uint64_t          rx_frame_id;  ///< Frame the receiver is locked on
+    int8_t            rssi;         ///< RSSI sampled at the last ADDRESS event
+    bool              pending_rx_read;
+    uint8_t           tx_length;
+    const uint8_t    *tx_packet;  ///< Packet read when the transmission starts, like the EasyDMA PACKETPTR
+    uint8_t           tx_payload[MR_BLE_PAYLOAD_MAX_LENGTH];
+    uint8_t           rx_length;
+    uint8_t           rx_payload[MR_BLE_PAYLOAD_MAX_LENGTH];
+    radio_ts_packet_t start_cb;
+    radio_ts_packet_t end_cb;
+} mr_sim_radio_t;
+
+typedef struct mr_sim_instance mr_sim_instance_t;
+
+/// Latency samples, in microseconds
+typedef struct {
+    uint32_t *values_us;
+    size_t    len;
+    size_t    cap;
+} mr_sim_series_t;
+
+/// Per-device counters collected by the simulated application
+typedef struct {
+    uint64_t        boot_ns;
+    uint64_t        first_connected_ns;  ///< 0 if never connected
+    uint64_t        handover_ns;         ///< Start of the ongoing handover, 0 if none
+    uint32_t        connects;
+    uint32_t        disconnects;
+    uint32_t        handovers;
+    uint32_t        handbacks;  ///< Node only: handovers back to the previous gateway, shortly after leaving it
+    uint32_t        uplink_sent;
+    uint32_t        uplink_received;  ///< Gateway only: uplink packets received from nodes
+    uint32_t        downlink_sent;    ///< Gateway only
+    uint32_t        downlink_received;
+    uint32_t        nodes_joined;      ///< Gateway only
+    uint32_t        nodes_left;        ///< Gateway only
+    uint32_t        tx_held;           ///< Application packets not handed to mari, between MARI_TX_QUEUE_HIGH and MARI_TX_QUEUE_LOW
+    uint32_t        tx_refused;        ///< Application packets refused by mari, because its transmit queue was full
+    mr_sim_series_t uplink_latency;    ///< Gateway only: enqueue at the node -> delivery at the gateway
+    mr_sim_series_t downlink_latency;  ///< Node only: enqueue at the gateway -> delivery at the node
+    mr_sim_series_t handover_time;     ///< Node only: handover -> connected to the new gateway
+    uint32_t        frames_sent;
+    uint32_t        frames_received;
+    uint32_t        frames_lost;  ///< Frames this device locked on but could not decode (collision, noise)
+} mr_sim_stats_t;
+
+typedef struct {
+    uint32_t       index;
+    uint64_t       device_id;
+    mr_node_type_t role;
+    double         x;
+    double         y;
+
+    // mobility, see mr_sim_config_t.speed_mps
+    double   waypoint_x;
+    double   waypoint_y;
+    uint64_t moved_ns;  ///< Global time of the last position update
+    uint64_t move_rng;
+
+    // clock
+    int64_t  clock_offset_ns;
+    int32_t  clock_ppm;
+    uint64_t cpu_ns;  ///< Global time the device's CPU is at, advanced by events and busy waits
+
+    // drivers
+    mr_sim_event_queue_t   events;
+    mr_sim_timer_channel_t timers[MR_SIM_TIMER_COUNT][MR_SIM_TIMER_CHANNELS];
+    mr_sim_radio_t         radio;
+    uint64_t               rng_state;
+
+    // frames sent during the current window, published to the medium at the barrier
+    mr_sim_frame_t *pending_frames;
+    size_t          pending_frames_len;
+    size_t          pending_frames_cap;
+
+    // mari core and application
+    mr_sim_instance_t *mari;
+    void              *app;
+    mr_sim_stats_t     stats;
+
+    uint64_t events_handled;
+    size_t   heap_pos;  ///< Position in the engine's device heap
+} mr_sim_node_t;
+
+typedef struct {
+    uint32_t    n_gateways;
+    uint32_t    n_nodes;
+    const char *schedule_name;
+    uint64_t    seed;
+    uint64_t    duration_ns;
+    double      area_m;              ///< Side of the square hall where devices are placed
+    double      speed_mps;           ///< Nodes walk between random waypoints of the hall at this speed, 0 for static nodes
+    uint64_t    boot_spread_ns;      ///< Nodes power up uniformly within [0, boot_spread_ns)
+    uint64_t    uplink_period_ns;    ///< Period of the status packet sent by every joined node (0 disables)
+    uint8_t     uplink_payload_len;  ///< Application payload bytes per uplink packet
+    uint64_t    downlink_period_ns;  ///< Gateway sends one packet to a joined node every period (0 disables)
+    uint8_t     downlink_payload_len;
+    uint32_t    tx_start_delay_us;  ///< From the START task to the first bit of the preamble
+    uint32_t    isr_latency_us;     ///< From a peripheral event to the first instruction of its callback
+    int32_t     clock_ppm_max;      ///< Clock drift drawn uniformly in [-ppm, +ppm]
+    double      tx_power_dbm;
+    double      path_loss_d0_db;  ///< Path loss at 1 m
+    double      path_loss_exponent;
+    double      shadowing_sigma_db;
+    double      fading_sigma_db;  ///< Drawn again for every frame at every receiver, on top of the shadowing
+    double      sensitivity_dbm;
+    double      capture_threshold_db;
+    uint32_t    threads;  ///< Threads used to run the devices, results do not depend on it
+    bool        verbose;
+} mr_sim_config_t;
+
+typedef struct {
+    uint64_t sim_ns;
+    double   wall_s;
+    uint64_t events;
+    uint64_t windows;
+    uint64_t frames;
+} mr_sim_result_t;
+
+//=========================== prototypes =======================================
+
+void mr_sim_config_default(mr_sim_config_t *config);
+
+int  mr_sim_init(const mr_sim_config_t *config, const char *mari_library_path);
+void mr_sim_run(mr_sim_result_t *result);
+void mr_sim_deinit(void);
+
+size_t         mr_sim_node_count(void);
+mr_sim_node_t *mr_sim_node_get(size_t index);
+
+const mr_sim_config_t *mr_sim_config(void);
+
+// -------- used by the simulated drivers and the application --------
+
+mr_sim_node_t *mr_sim_current(void);
+void           mr_sim_set_current(mr_sim_node_t *node);
+
+uint64_t mr_sim_now_ns(void);
+uint64_t mr_sim_local_ns(mr_sim_node_t *node, uint64_t global_ns);
+uint64_t mr_sim_global_ns(mr_sim_node_t *node, uint64_t local_ns);
+
+void mr_sim_schedule(mr_sim_node_t *node, uint64_t time_ns, mr_sim_event_type_t type, uint64_t arg, uint32_t gen);
+
+mr_sim_frame_t *mr_sim_medium_new_frame(mr_sim_node_t *node);
+mr_sim_frame_t *mr_sim_medium_get_frame(uint64_t frame_id);
+double          mr_sim_medium_rssi(const mr_sim_frame_t *frame, const mr_sim_node_t *receiver);
+bool            mr_sim_medium_decode(const mr_sim_frame_t *frame, const mr_sim_node_t *receiver);
+
+uint64_t mr_sim_rng_next(uint64_t *state);
+
+void     mr_sim_series_add(mr_sim_series_t *series, uint32_t value_us);
+void     mr_sim_series_sort(mr_sim_series_t *series);
+uint32_t mr_sim_series_percentile(const mr_sim_series_t *series, double percentile);
+
+// -------- implemented by the simulated drivers --------
+
+void mr_sim_timer_handle_event(mr_sim_node_t *node, const mr_sim_event_t *event);
+void mr_sim_radio_handle_event(mr_sim_node_t *node, const mr_sim_event_t *event);
+
+// -------- implemented by the simulated application --------
+
+void mr_sim_app_boot(mr_sim_node_t *node);
+void mr_sim_app_loop(mr_sim_node_t *node);
+
+#endif  // __SIM_H
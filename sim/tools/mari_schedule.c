@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @ingroup     sim
+ *
+ * @brief       Generates a mari schedule, as C code to add to all_schedules.c or to an application
+ *
+ * Calls mr_scheduler_build_schedule, so the output is the same schedule that
+ * the firmware would build at runtime from the same parameters.
+ *
+ * @author Geovane Fedrecheski <geovane.fedrecheski@inria.fr>
+ *
+ * @copyright Inria, 2025
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "models.h"
+#include "scheduler.h"
+
+//=========================== defines ==========================================
+
+enum {
+    OPT_ID = 0x100,
+    OPT_BEACONS,
+    OPT_DOWNLINK_RATIO,
+    OPT_SHARED_RATIO,
+};
+
+//=========================== variables ========================================
+
+static const struct option _options[] = {
+    { "nodes", required_argument, NULL, 'n' },
+    { "name", required_argument, NULL, 'o' },
+    { "id", required_argument, NULL, OPT_ID },
+    { "beacons", required_argument, NULL, OPT_BEACONS },
+    { "downlink-ratio", required_argument, NULL, OPT_DOWNLINK_RATIO },
+    { "shared-ratio", required_argument, NULL, OPT_SHARED_RATIO },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+};
+
+//=========================== prototypes =======================================
+
+static void _usage(const char *name);
+static void _print(const schedule_t *schedule, const char *name);
+
+//=========================== main =============================================
+
+int main(int argc, char **argv) {
+    mr_schedule_params_t params = {
+        .id                   = 0x10,
+        .n_beacons            = 3,
+        .n_uplinks            = 0,
+        .uplinks_per_downlink = 5,
+        .uplinks_per_shared   = 5,
+    };
+    const char *name = "generated";
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:o:h", _options, NULL)) != -1) {
+        switch (opt) {
+            case 'n':
+                params.n_uplinks = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                name = optarg;
+                break;
+            case OPT_ID:
+                params.id = strtoul(optarg, NULL, 0);
+                break;
+            case OPT_BEACONS:
+                params.n_beacons = strtoul(optarg, NULL, 0);
+                break;
+            case OPT_DOWNLINK_RATIO:
+                params.uplinks_per_downlink = strtoul(optarg, NULL, 0);
+                break;
+            case OPT_SHARED_RATIO:
+                params.uplinks_per_shared = strtoul(optarg, NULL, 0);
+                break;
+            case 'h':
+                _usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                _usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    schedule_t schedule;
+    if (!mr_scheduler_build_schedule(&schedule, &params)) {
+        fprintf(stderr, "Cannot build a schedule with these parameters, at most %d cells are supported\n", MARI_N_CELLS_MAX);
+        _usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    _print(&schedule, name);
+    return EXIT_SUCCESS;
+}
+
+//=========================== private ==========================================
+
+static void _usage(const char *name) {
+    printf("Usage: %s -n NODES [options]\n", name);
+    printf("  -n, --nodes N               number of dedicated uplink cells, i.e., maximum number of nodes\n");
+    printf("  -o, --name NAME             the schedule is named schedule_NAME (default generated)\n");
+    printf("      --id N                  schedule id, must not collide with the built-in schedules (default 0x10)\n");
+    printf("      --beacons N             number of beacon cells (default 3)\n");
+    printf("      --downlink-ratio N      one downlink cell for every N uplink cells (default 5)\n");
+    printf("      --shared-ratio N        one shared uplink cell for every N uplink cells (default 5)\n");
+}
+
+// Same layout as all_schedules.c
+static void _print(const schedule_t *schedule, const char *name) {
+    printf("/* Schedule with %zu slots, supporting up to %u nodes */\n", schedule->n_cells, schedule->max_nodes);
+    printf("const schedule_t schedule_%s = {\n", name);
+    printf("    .id = %u,\n", schedule->id);
+    printf("    .max_nodes = %u,\n", schedule->max_nodes);
+    printf("    .backoff_n_min = %u,\n", schedule->backoff_n_min);
+    printf("    .backoff_n_max = %u,\n", schedule->backoff_n_max);
+    printf("    .n_cells = %zu,\n", schedule->n_cells);
+    printf("    .cells = {\n");
+    printf("        // Begin with beacon cells. They use their own channel offsets and frequencies.\n");
+    for (size_t i = 0; i < schedule->n_cells; i++) {
+        if (i > 0 && schedule->cells[i - 1].type == SLOT_TYPE_BEACON && schedule->cells[i].type != SLOT_TYPE_BEACON) {
+            printf("        // Continue with regular cells.\n");
+        }
+        printf("        {'%c', %u}%s\n", schedule->cells[i].type, schedule->cells[i].channel_offset, i + 1 < schedule->n_cells ? "," : "");
+    }
+    printf("    }\n");
+    printf("};\n");
+}